@@ -0,0 +1,167 @@
+// Matches per second of a CodinGame MultiplayerGameRunner with:
+//  + subprocess agents: addAgent(String), the runner spawns this executable
+//    in bot mode for every agent of every match and talks to it over pipes;
+//  + in-process agents: addAgent(Class) with a NativeAgent slot bound to a
+//    C++ callable (java_agent.hpp).
+//
+// Both agents play the same way: every batch of complete lines the referee
+// sends is answered with the same lines, so the match time is dominated by
+// the runner and the transport rather than by the bots.
+//
+// Usage: agents_bench <game class path> <answer> [matches (20)] [players (2)]
+//   answer: the lines sent every turn, separated by ';' (e.g. "WAIT;WAIT")
+// Bot mode, used by the subprocess agents: agents_bench --bot
+
+#include "java_agent.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef JNI_CPP20_JAR
+#define JNI_CPP20_JAR "jni-cpp20.jar"
+#endif
+
+namespace codingame {
+using MultiplayerGameRunner =
+    java_class_desc<"com/codingame/gameengine/runner/MultiplayerGameRunner">;
+} // namespace codingame
+
+namespace {
+
+constexpr const char *answer_variable = "AGENTS_BENCH_ANSWER";
+
+std::string make_answer(std::string_view lines) {
+  std::string answer;
+  for (char c : lines) {
+    answer += c == ';' ? '\n' : c;
+  }
+  return answer + '\n';
+}
+
+// Subprocess agent, reads stdin the way NativeAgent reads System.in
+int run_bot() {
+  const char *lines = std::getenv(answer_variable);
+  if (lines == nullptr) {
+    return EXIT_FAILURE;
+  }
+  auto answer = make_answer(lines);
+  char buffer[8192];
+  ssize_t size;
+  while ((size = ::read(STDIN_FILENO, buffer, sizeof(buffer))) > 0) {
+    if (buffer[size - 1] != '\n') {
+      continue;
+    }
+    if (::write(STDOUT_FILENO, answer.data(), answer.size()) < 0) {
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+void report(const char *name, std::size_t matches, double seconds) {
+  std::cout << std::left << std::setw(16) << name << std::right << std::fixed
+            << std::setprecision(2) << std::setw(10)
+            << (double)matches / seconds << " matches/s" << std::setw(12)
+            << seconds * 1e3 / (double)matches << " ms/match\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string_view{argv[1]} == "--bot") {
+    return run_bot();
+  }
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0]
+              << " <game class path> <answer> [matches] [players]\n";
+    return EXIT_FAILURE;
+  }
+  std::size_t matches = argc > 3 ? (std::size_t)std::atoi(argv[3]) : 20;
+  std::size_t players = argc > 4 ? (std::size_t)std::atoi(argv[4]) : 2;
+  ::setenv(answer_variable, argv[2], 1);
+  auto answer = make_answer(argv[2]);
+
+  auto class_path =
+      std::string{"-Djava.class.path="} + argv[1] + ":" + JNI_CPP20_JAR;
+  JavaVMOption options[] = {{class_path.data(), nullptr}};
+  JavaVMInitArgs vm_args{};
+  vm_args.version = JNI_VERSION_10;
+  vm_args.nOptions = 1;
+  vm_args.options = options;
+  auto created = JVM::create(&vm_args);
+  if (!created) {
+    std::cerr << "failed to create the JVM: " << to_string(created.error())
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  JVM jvm = std::move(created.value());
+  auto &env = *jvm;
+
+  auto runner_cls = jvm.find_class<codingame::MultiplayerGameRunner>();
+  auto properties_cls = jvm.find_class<java::util::Properties>();
+  auto agents = agent_host::create(jvm);
+  if (!runner_cls || !properties_cls || !agents) {
+    std::cerr << "missing classes, check the class path" << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto runner_ctor = *runner_cls->get_constructor_id<>();
+  auto properties_ctor = *properties_cls->get_constructor_id<>();
+  auto add_command = *runner_cls->get_method_id<"addAgent", void(java::lang::String)>();
+  auto add_class = *runner_cls->get_method_id<"addAgent", void(java::lang::Class)>();
+  auto initialize = *runner_cls->get_method_id<"initialize", void(java::util::Properties)>();
+  auto run_agents = *runner_cls->get_method_id<"runAgents", void()>();
+
+  std::vector<native_agent> bots;
+  for (std::size_t i = 0; i < players; ++i) {
+    auto bot = agents->add([&answer](std::string_view, std::string &output) {
+      output += answer;
+    });
+    if (!bot) {
+      std::cerr << "at most " << detail::agent_registry::slot_count
+                << " in-process agents" << std::endl;
+      return EXIT_FAILURE;
+    }
+    bots.push_back(std::move(*bot));
+  }
+  auto command = std::string{argv[0]} + " --bot";
+
+  auto play = [&](auto &&add_agents) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t m = 0; m < matches; ++m) {
+      auto runner = *runner_cls->instantiate(runner_ctor);
+      auto properties = *properties_cls->instantiate(properties_ctor);
+      add_agents(runner);
+      runner_cls->call(initialize, runner, properties);
+      runner_cls->call(run_agents, runner);
+      if (env.ExceptionCheck()) {
+        env.ExceptionDescribe();
+        std::exit(EXIT_FAILURE);
+      }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+  };
+
+  report("subprocess", matches, play([&](auto &runner) {
+           for (std::size_t i = 0; i < players; ++i) {
+             runner_cls->call(add_command, runner, command);
+           }
+         }));
+  report("in-process", matches, play([&](auto &runner) {
+           for (auto &bot : bots) {
+             runner_cls->call(add_class, runner, bot.java_class());
+           }
+         }));
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+// Objects per second when filling a Java array of java.awt.Point from a
+// std::vector of C++ structs:
+//  + per call: java_class::instantiate then SetObjectArrayElement for every
+//    element, each object being a java_object released on its own;
+//  + construct_all: NewObjectA for every element in a single local frame;
+//  + allocate_all: AllocObject and two SetIntField for every element, the
+//    constructor isn't run.
+//
+// Usage: batch_bench [samples (5)]
+
+#include "bench.hpp"
+
+#include "java_batch.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace java::awt {
+using Point = java_class_desc<"java/awt/Point">;
+} // namespace java::awt
+
+namespace {
+
+struct point {
+  int x, y;
+};
+
+void report(std::size_t batch, const char *name, double ns_per_batch) {
+  std::cout << std::setw(10) << batch << "  " << std::left << std::setw(16)
+            << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(14) << (double)batch / ns_per_batch * 1e3
+            << " Mobjects/s\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::size_t samples = argc > 1 ? (std::size_t)std::atoi(argv[1]) : 5;
+
+  JavaVMOption options[] = {{(char *)"-Djava.awt.headless=true", nullptr}};
+  JavaVMInitArgs vm_args{};
+  vm_args.version = JNI_VERSION_10;
+  vm_args.nOptions = 1;
+  vm_args.options = options;
+  auto created = JVM::create(&vm_args);
+  if (!created) {
+    std::cerr << "failed to create the JVM: " << to_string(created.error())
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  JVM jvm = std::move(created.value());
+  auto &env = *jvm;
+
+  auto point_cls = *jvm.find_class<java::awt::Point>();
+  auto ctor = *point_cls.get_constructor_id<int, int>();
+  auto x = *point_cls.get_field_id<"x", int>();
+  auto y = *point_cls.get_field_id<"y", int>();
+
+  for (std::size_t batch : {1'000, 10'000, 100'000}) {
+    std::vector<point> points(batch);
+    for (std::size_t i = 0; i < batch; ++i) {
+      points[i] = {(int)i, (int)(batch - i)};
+    }
+    std::size_t iterations = 1'000'000 / batch;
+
+    auto per_call = [&](std::size_t) {
+      java_ref<jobjectArray> array{
+          env.NewObjectArray((jsize)batch, point_cls.get(), nullptr), &env};
+      jsize i = 0;
+      for (auto &p : points) {
+        auto obj = *point_cls.instantiate(ctor, p.x, p.y);
+        env.SetObjectArrayElement(array.get(), i++, obj.get());
+      }
+      bench::do_not_optimize(array.get());
+    };
+    auto constructed = [&](std::size_t) {
+      auto array = construct_all(point_cls, ctor, points);
+      bench::do_not_optimize(array);
+    };
+    auto allocated = [&](std::size_t) {
+      auto array = allocate_all(point_cls, points, std::tuple{x, y});
+      bench::do_not_optimize(array);
+    };
+    report(batch, "per call", bench::measure_ns(iterations, per_call, samples));
+    report(batch, "construct_all",
+           bench::measure_ns(iterations, constructed, samples));
+    report(batch, "allocate_all",
+           bench::measure_ns(iterations, allocated, samples));
+  }
+  if (env.ExceptionCheck()) {
+    env.ExceptionDescribe();
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Compares the time needed to build benchmarks/build with every build mode of
+# the library:
+#   header-only      the default
+#   no-self-checks   JNI_CPP20_SELF_CHECKS=OFF
+#   pch              precompiled header (jni_cpp20_precompile_headers)
+#   instantiation    JNI_CPP20_EXPLICIT_INSTANTIATION=ON
+#   all              the three above
+#
+# Usage: compare_build_times.sh [units] [jobs]
+set -e
+
+source_dir=$(cd "$(dirname "$0")/../.." && pwd)
+units=${1:-50}
+jobs=${2:-1}
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+run() {
+  name=$1
+  shift
+  build_dir="$work_dir/$name"
+  cmake -S "$source_dir" -B "$build_dir" -DCMAKE_BUILD_TYPE=Release \
+    -DBUILD_TESTING=OFF -DJNI_CPP20_BUILD_TOOLS=OFF \
+    -DJNI_CPP20_BUILD_BENCHMARKS=ON -DJNI_CPP20_BUILD_BENCH_UNITS="$units" \
+    "$@" >/dev/null
+  # The library itself (compiled mode) is built outside of the measure
+  cmake --build "$build_dir" --target JNI_CPP20 >/dev/null 2>&1 || true
+  start=$(date +%s.%N)
+  cmake --build "$build_dir" --target build_bench -j "$jobs" >/dev/null
+  end=$(date +%s.%N)
+  awk -v name="$name" -v start="$start" -v end="$end" \
+    'BEGIN { printf "%-16s %8.2fs\n", name, end - start }'
+}
+
+echo "$units translation units, $jobs jobs"
+run header-only
+run no-self-checks -DJNI_CPP20_SELF_CHECKS=OFF
+run pch -DJNI_CPP20_BUILD_BENCH_PCH=ON
+run instantiation -DJNI_CPP20_EXPLICIT_INSTANTIATION=ON
+run all -DJNI_CPP20_SELF_CHECKS=OFF -DJNI_CPP20_BUILD_BENCH_PCH=ON \
+  -DJNI_CPP20_EXPLICIT_INSTANTIATION=ON
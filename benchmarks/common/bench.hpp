@@ -0,0 +1,59 @@
+#ifndef HEADER_GUARD_DPSG_BENCH_HPP
+#define HEADER_GUARD_DPSG_BENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string_view>
+#include <vector>
+
+namespace bench {
+
+/// Prevents the compiler from optimizing away the computation of value
+template <class T> inline void do_not_optimize(T const &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+using clock = std::chrono::steady_clock;
+
+/// Runs f `iterations` times per sample and returns the best time per
+/// iteration (in nanoseconds) over `samples` samples
+template <class F>
+double measure_ns(std::size_t iterations, F &&f, std::size_t samples = 5) {
+  double best = -1;
+  for (std::size_t s = 0; s < samples; ++s) {
+    auto start = clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+      f(i);
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start)
+                       .count() /
+                   (double)iterations;
+    if (best < 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best;
+}
+
+/// Nearest-rank percentile of a set of samples (p in [0, 1])
+inline double percentile(std::vector<double> &samples, double p) {
+  if (samples.empty()) {
+    return 0;
+  }
+  auto n = (std::size_t)(p * (double)(samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+  return samples[n];
+}
+
+inline void report(std::string_view name, double ns_per_op) {
+  std::cout << std::left << std::setw(48) << name << std::right
+            << std::setw(12) << std::fixed << std::setprecision(2)
+            << ns_per_op << " ns/op\n";
+}
+
+} // namespace bench
+
+#endif // HEADER_GUARD_DPSG_BENCH_HPP
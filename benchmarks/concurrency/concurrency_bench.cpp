@@ -0,0 +1,291 @@
+// Throughput scaling and tail latency of the wrapper when used from several
+// threads at once.
+//
+// Every workload runs on 1, 2, 4... up to max_threads threads attached to the
+// same JVM. Each thread resolves its own classes (attached_thread::find_class)
+// and runs the operation in a loop for duration_ms, timing every operation.
+// The report gives, per thread count, the total throughput, the scaling
+// efficiency (throughput / (threads * single thread throughput)) and the
+// latency percentiles. Workloads whose efficiency drops below 50% at the
+// highest thread count are listed as contention points.
+//
+// Usage: concurrency_bench [duration_ms (200)] [max_threads (all cores)]
+
+#include "bench.hpp"
+
+#include "java_bulk.hpp"
+#include "java_chunks.hpp"
+#include "jvm.hpp"
+#include "jvm_thread.hpp"
+
+#include <jni.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <latch>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace java::lang {
+using Integer = java_class_desc<"java/lang/Integer">;
+using Math = java_class_desc<"java/lang/Math">;
+} // namespace java::lang
+
+namespace {
+
+// Latency samples kept per thread, the remaining operations are only counted
+constexpr std::size_t max_samples = 1 << 18;
+
+struct thread_result {
+  std::size_t operations = 0;
+  double elapsed_ns = 0;
+  std::vector<double> latencies;
+};
+
+// Times every call of op until stop is set
+class runner {
+  const std::atomic<bool> &_stop;
+  thread_result &_result;
+
+public:
+  runner(const std::atomic<bool> &stop, thread_result &result)
+      : _stop(stop), _result(result) {}
+
+  void loop(const std::function<void(std::size_t)> &op) {
+    _result.latencies.reserve(max_samples);
+    auto start = bench::clock::now();
+    std::size_t i = 0;
+    while (!_stop.load(std::memory_order_relaxed)) {
+      auto before = bench::clock::now();
+      op(i);
+      auto after = bench::clock::now();
+      if (i < max_samples) {
+        _result.latencies.push_back(
+            std::chrono::duration<double, std::nano>(after - before).count());
+      }
+      ++i;
+    }
+    _result.operations = i;
+    _result.elapsed_ns =
+        std::chrono::duration<double, std::nano>(bench::clock::now() - start)
+            .count();
+  }
+};
+
+using workload_fn = void (*)(attached_thread &, runner &);
+
+struct workload {
+  std::string_view name;
+  workload_fn run;
+};
+
+void static_call(attached_thread &thread, runner &r) {
+  auto math = *thread.find_class<java::lang::Math>();
+  auto max = *math.get_static_method_id<"max", int(int, int)>();
+  r.loop([&](std::size_t i) {
+    bench::do_not_optimize(math.call(max, (int)i, 42));
+  });
+}
+
+void instance_call(attached_thread &thread, runner &r) {
+  auto object = *thread.find_class<java::lang::Object>();
+  auto ctor = *object.get_constructor_id<>();
+  auto hash_code = *object.get_method_id<"hashCode", int()>();
+  auto instance = *object.instantiate(ctor);
+  r.loop([&](std::size_t) {
+    bench::do_not_optimize(object.call(hash_code, instance));
+  });
+}
+
+void object_creation(attached_thread &thread, runner &r) {
+  auto object = *thread.find_class<java::lang::Object>();
+  auto ctor = *object.get_constructor_id<>();
+  r.loop([&](std::size_t) {
+    auto instance = object.instantiate(ctor);
+    bench::do_not_optimize(instance);
+  });
+}
+
+// int -> Java String -> UTF-8, then UTF-8 -> Java String -> int
+void string_conversion(attached_thread &thread, runner &r) {
+  auto integer = *thread.find_class<java::lang::Integer>();
+  auto to_string =
+      *integer.get_static_method_id<"toString", java::lang::String(int)>();
+  auto parse_int =
+      *integer.get_static_method_id<"parseInt", int(java::lang::String)>();
+  std::string utf8;
+  r.loop([&](std::size_t i) {
+    auto str = integer.call(to_string, (int)i);
+    utf8.clear();
+    for (std::string_view part : java_string_chunks{str}) {
+      utf8 += part;
+    }
+    bench::do_not_optimize(integer.call(parse_int, utf8));
+  });
+}
+
+void array_region(attached_thread &thread, runner &r) {
+  auto array = make_java_array<jint>(thread.get_env(), 256);
+  std::vector<jint> buffer(256);
+  r.loop([&](std::size_t i) {
+    buffer[i % buffer.size()] = (jint)i;
+    array.set_region(0, std::span<const jint>{buffer});
+    array.get_region(0, std::span<jint>{buffer});
+  });
+}
+
+void array_critical(attached_thread &thread, runner &r) {
+  auto array = make_java_array<jint>(thread.get_env(), 256);
+  auto size = array.size();
+  r.loop([&](std::size_t i) {
+    critical_array<jint> mapped{array, size};
+    mapped.data()[i % 256] = (jint)i;
+  });
+}
+
+// NewGlobalRef/DeleteGlobalRef go through the global reference table
+void global_ref_churn(attached_thread &thread, runner &r) {
+  auto object = *thread.find_class<java::lang::Object>();
+  auto instance = *object.instantiate(*object.get_constructor_id<>());
+  r.loop([&](std::size_t) {
+    auto global = instance.promote();
+    bench::do_not_optimize(global.get());
+  });
+}
+
+// FindClass goes through the class loader, usually behind a lock
+void class_lookup(attached_thread &thread, runner &r) {
+  r.loop([&](std::size_t) {
+    auto cls = thread.find_class<java::lang::Integer>();
+    bench::do_not_optimize(cls);
+  });
+}
+
+constexpr workload workloads[] = {
+    {"static call", static_call},
+    {"instance call", instance_call},
+    {"object creation", object_creation},
+    {"string conversion", string_conversion},
+    {"array region copy", array_region},
+    {"array critical access", array_critical},
+    {"global ref churn", global_ref_churn},
+    {"class lookup", class_lookup},
+};
+
+struct run_result {
+  double ops_per_second;
+  double p50, p99, p999;
+};
+
+run_result run(JavaVM &vm, const workload &w, unsigned threads,
+               std::chrono::milliseconds duration) {
+  std::atomic<bool> stop{false};
+  std::vector<thread_result> results(threads);
+  std::latch ready{threads + 1};
+  std::vector<std::jthread> workers;
+  for (unsigned t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t] {
+      auto thread = attached_thread::attach(vm, "concurrency-bench");
+      if (!thread) {
+        std::cerr << "failed to attach: " << to_string(thread.error())
+                  << std::endl;
+        std::abort();
+      }
+      runner r{stop, results[t]};
+      ready.arrive_and_wait();
+      w.run(thread.value(), r);
+      if (thread.value()->ExceptionCheck()) {
+        thread.value()->ExceptionDescribe();
+        std::abort();
+      }
+    });
+  }
+  ready.arrive_and_wait();
+  std::this_thread::sleep_for(duration);
+  stop = true;
+  workers.clear();
+
+  double ops_per_second = 0;
+  std::vector<double> latencies;
+  for (auto &res : results) {
+    ops_per_second += (double)res.operations / res.elapsed_ns * 1e9;
+    latencies.insert(latencies.end(), res.latencies.begin(),
+                     res.latencies.end());
+  }
+  return {ops_per_second, bench::percentile(latencies, 0.5),
+          bench::percentile(latencies, 0.99),
+          bench::percentile(latencies, 0.999)};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::chrono::milliseconds duration{argc > 1 ? std::atoi(argv[1]) : 200};
+  unsigned max_threads =
+      argc > 2 ? (unsigned)std::atoi(argv[2])
+               : std::max(1u, std::thread::hardware_concurrency());
+
+  JavaVMInitArgs vm_args{};
+  vm_args.version = JNI_VERSION_10;
+  auto created = JVM::create(&vm_args);
+  if (!created) {
+    std::cerr << "failed to create the JVM: " << to_string(created.error())
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+  JVM jvm = std::move(created.value());
+
+  std::vector<unsigned> counts;
+  for (unsigned n = 1; n < max_threads; n *= 2) {
+    counts.push_back(n);
+  }
+  counts.push_back(max_threads);
+
+  struct contention {
+    std::string_view name;
+    double efficiency;
+  };
+  std::vector<contention> contended;
+
+  for (auto &w : workloads) {
+    std::cout << "\n" << w.name << "\n"
+              << std::setw(8) << "threads" << std::setw(14) << "Mops/s"
+              << std::setw(12) << "scaling" << std::setw(12) << "p50 ns"
+              << std::setw(12) << "p99 ns" << std::setw(12) << "p99.9 ns"
+              << "\n";
+    double single = 0;
+    double efficiency = 1;
+    for (auto n : counts) {
+      auto res = run(*jvm.get_vm(), w, n, duration);
+      if (n == 1) {
+        single = res.ops_per_second;
+      }
+      efficiency = res.ops_per_second / (single * n);
+      std::cout << std::setw(8) << n << std::fixed << std::setprecision(3)
+                << std::setw(14) << res.ops_per_second / 1e6
+                << std::setprecision(2) << std::setw(12) << efficiency
+                << std::setprecision(0) << std::setw(12) << res.p50
+                << std::setw(12) << res.p99 << std::setw(12) << res.p999
+                << "\n";
+    }
+    if (counts.back() > 1 && efficiency < 0.5) {
+      contended.push_back({w.name, efficiency});
+    }
+  }
+
+  std::cout << "\ncontention points (scaling < 0.50 at " << counts.back()
+            << " threads):\n";
+  if (contended.empty()) {
+    std::cout << "  none\n";
+  }
+  for (auto &c : contended) {
+    std::cout << "  " << std::left << std::setw(28) << c.name << std::right
+              << std::setprecision(2) << c.efficiency << "\n";
+  }
+  return EXIT_SUCCESS;
+}
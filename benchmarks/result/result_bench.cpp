@@ -0,0 +1,150 @@
+// Compares dpsg::result with the std::variant based implementation it
+// replaced, on chains of fallible operations similar to the lookups and calls
+// of the JNI wrapper.
+
+#include "bench.hpp"
+#include "result.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <variant>
+#include <vector>
+
+namespace variant_based {
+// The previous implementation of result.hpp, reduced to what is measured
+template <class T, class E> using result = std::variant<T, E>;
+
+template <class T, class U> constexpr bool ok(const result<T, U> &r) noexcept {
+  return r.index() == 0;
+}
+constexpr decltype(auto)
+get_result(dpsg::template_instance_of<std::variant> auto &&r) {
+  return std::get<0>(std::forward<decltype(r)>(r));
+}
+constexpr decltype(auto)
+get_error(dpsg::template_instance_of<std::variant> auto &&r) {
+  return std::get<1>(std::forward<decltype(r)>(r));
+}
+} // namespace variant_based
+
+enum class error : std::uint8_t { not_found, exception };
+
+struct handle {
+  void *ptr;
+  std::uint32_t id;
+};
+
+inline int anchor;
+
+// Each step fails when the input has the corresponding bit set
+template <template <class, class> class R> struct steps {
+  static R<handle, error> find(std::uint32_t x) {
+    if (x & 1) {
+      return error::not_found;
+    }
+    return handle{&anchor, x};
+  }
+  static R<handle, error> lookup(handle h) {
+    if (h.id & 2) {
+      return error::not_found;
+    }
+    return handle{h.ptr, h.id >> 2};
+  }
+  static R<std::int64_t, error> call(handle h) {
+    if (h.id & 4) {
+      return error::exception;
+    }
+    return (std::int64_t)h.id * 3;
+  }
+};
+
+std::int64_t run_variant(std::uint32_t x) {
+  using namespace variant_based;
+  using s = steps<variant_based::result>;
+  auto a = s::find(x);
+  if (!ok(a)) {
+    return -1;
+  }
+  auto b = s::lookup(get_result(a));
+  if (!ok(b)) {
+    return -2;
+  }
+  auto c = s::call(get_result(b));
+  if (!ok(c)) {
+    return -3;
+  }
+  return get_result(c);
+}
+
+std::int64_t run_result(std::uint32_t x) {
+  using namespace dpsg;
+  using s = steps<dpsg::result>;
+  auto a = s::find(x);
+  if (!ok(a)) {
+    return -1;
+  }
+  auto b = s::lookup(get_result(a));
+  if (!ok(b)) {
+    return -2;
+  }
+  auto c = s::call(get_result(b));
+  if (!ok(c)) {
+    return -3;
+  }
+  return get_result(c);
+}
+
+// Replaces the error of a step with its code, as returned by the other runs
+template <class T, std::int64_t Code>
+dpsg::result<T, std::int64_t> failed_at(error) {
+  return dpsg::result<T, std::int64_t>{dpsg::in_place_error, Code};
+}
+
+std::int64_t run_monadic(std::uint32_t x) {
+  using s = steps<dpsg::result>;
+  auto r = s::find(x)
+               .or_else(failed_at<handle, -1>)
+               .and_then([](handle h) {
+                 return s::lookup(h).or_else(failed_at<handle, -2>);
+               })
+               .and_then([](handle h) {
+                 return s::call(h).or_else(failed_at<std::int64_t, -3>);
+               });
+  return r ? r.value() : r.error();
+}
+
+int main() {
+  constexpr std::size_t count = 1 << 16;
+  std::vector<std::uint32_t> inputs(count);
+  std::mt19937 rng{42};
+  for (auto &i : inputs) {
+    // ~3% of the chains fail, at various steps
+    i = (rng() % 32 == 0) ? rng() : (rng() & ~7u);
+  }
+
+  // The three runs must compute the same thing
+  for (auto i : inputs) {
+    auto expected = run_variant(i);
+    if (run_result(i) != expected || run_monadic(i) != expected) {
+      std::cerr << "results differ for input " << i << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  constexpr std::size_t iterations = 1 << 22;
+  auto bench = [&](auto f) {
+    return bench::measure_ns(iterations, [&](std::size_t i) {
+      bench::do_not_optimize(f(inputs[i % count]));
+    });
+  };
+
+  std::cout << "sizeof(std::variant<handle, error>) = "
+            << sizeof(std::variant<handle, error>)
+            << ", sizeof(dpsg::result<handle, error>) = "
+            << sizeof(dpsg::result<handle, error>) << "\n";
+  bench::report("std::variant + get_result", bench(run_variant));
+  bench::report("dpsg::result + get_result", bench(run_result));
+  bench::report("dpsg::result + and_then", bench(run_monadic));
+}
@@ -0,0 +1,55 @@
+# jni_cpp20_generate_bindings(<target>
+#   OUTPUT <header name>
+#   [CLASSES <class files or directories>...]
+#   [JARS <jar files>...]
+#   [DEPENDS <targets or files>...]
+#   [ALL_ACCESS])
+#
+# Generates a header with java_class_desc aliases, exact prototypes and
+# pre-resolved binding structs for the given compiled Java classes, and makes
+# it available to <target>. Jars are extracted at build time. DEPENDS lists the
+# targets producing the classes (e.g. a javac custom target) so that bindings
+# are regenerated when they change.
+function(jni_cpp20_generate_bindings TARGET)
+  cmake_parse_arguments(ARG "ALL_ACCESS" "OUTPUT" "CLASSES;JARS;DEPENDS" ${ARGN})
+  if (NOT ARG_OUTPUT)
+    message(FATAL_ERROR "jni_cpp20_generate_bindings: OUTPUT is required")
+  endif()
+
+  set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/jni_bindings)
+  set(output ${output_dir}/${ARG_OUTPUT})
+  string(MAKE_C_IDENTIFIER "${TARGET}_${ARG_OUTPUT}" guard)
+  string(TOUPPER "HEADER_GUARD_JNI_BINDGEN_${guard}" guard)
+
+  set(inputs ${ARG_CLASSES})
+  set(extract_commands)
+  foreach(jar IN LISTS ARG_JARS)
+    get_filename_component(jar_name ${jar} NAME_WE)
+    set(jar_dir ${output_dir}/${ARG_OUTPUT}.jars/${jar_name})
+    list(APPEND extract_commands
+      COMMAND ${CMAKE_COMMAND} -E rm -rf ${jar_dir}
+      COMMAND ${CMAKE_COMMAND} -E make_directory ${jar_dir}
+      COMMAND ${CMAKE_COMMAND} -E chdir ${jar_dir} ${CMAKE_COMMAND} -E tar xf ${jar})
+    list(APPEND inputs ${jar_dir})
+  endforeach()
+
+  set(flags)
+  if (ARG_ALL_ACCESS)
+    set(flags --all-access)
+  endif()
+
+  # jni_bindgen leaves the header untouched when it doesn't change, the stamp
+  # records that the command ran so that it isn't rerun on every build
+  add_custom_command(
+    OUTPUT ${output}.stamp
+    BYPRODUCTS ${output}
+    ${extract_commands}
+    COMMAND jni_bindgen -o ${output} --guard ${guard} ${flags} ${inputs}
+    COMMAND ${CMAKE_COMMAND} -E touch ${output}.stamp
+    DEPENDS jni_bindgen ${ARG_CLASSES} ${ARG_JARS} ${ARG_DEPENDS}
+    COMMENT "Generating JNI bindings ${ARG_OUTPUT}"
+  )
+  add_custom_target(${TARGET}_${guard} DEPENDS ${output}.stamp)
+  add_dependencies(${TARGET} ${TARGET}_${guard})
+  target_include_directories(${TARGET} PRIVATE ${output_dir})
+endfunction()
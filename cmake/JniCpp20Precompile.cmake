@@ -0,0 +1,21 @@
+set(JNI_CPP20_INCLUDE_DIR ${CMAKE_CURRENT_LIST_DIR}/../include)
+
+# jni_cpp20_precompile_headers(<target>
+#   [HEADERS <headers of the library>...])
+#
+# Precompiles <jni.h>, jvm.hpp and java_class.hpp (and through them the
+# standard headers and the DSL) for <target>, so that they are parsed once per
+# target instead of once per translation unit. HEADERS adds other headers of
+# the library, e.g. call_plan.hpp. Requires CMake 3.16.
+function(jni_cpp20_precompile_headers TARGET)
+  cmake_parse_arguments(ARG "" "" "HEADERS" ${ARGN})
+  if (CMAKE_VERSION VERSION_LESS 3.16)
+    message(FATAL_ERROR "jni_cpp20_precompile_headers requires CMake 3.16")
+  endif()
+
+  set(headers)
+  foreach(header jvm.hpp java_class.hpp ${ARG_HEADERS})
+    list(APPEND headers ${JNI_CPP20_INCLUDE_DIR}/${header})
+  endforeach()
+  target_precompile_headers(${TARGET} PRIVATE <jni.h> ${headers})
+endfunction()
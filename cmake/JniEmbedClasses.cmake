@@ -0,0 +1,67 @@
+# jni_cpp20_embed_classes(<target>
+#   OUTPUT <header name>
+#   [CLASSES <class files or directories>...]
+#   [JARS <jar files>...]
+#   [VARIABLE <name>]
+#   [DEPENDS <targets or files>...])
+#
+# Generates a header defining `inline constexpr embedded_class <name>[]` with
+# the bytecode of the given compiled Java classes, to be loaded with
+# embedded_classes::define (see java_embedded.hpp), and makes it available to
+# <target>. Directories are package roots: their .class files are named after
+# their path relative to the directory. Single class files must belong to the
+# default package. Jars are extracted at build time, only their classes are
+# embedded. <name> defaults to the header name without extension.
+#
+# DEPENDS lists the targets producing the classes (e.g. a javac custom target)
+# so that the header is regenerated when they change.
+
+set(_JNI_CPP20_EMBED_SCRIPT ${CMAKE_CURRENT_LIST_DIR}/JniEmbedClassesGenerate.cmake)
+
+function(jni_cpp20_embed_classes TARGET)
+  cmake_parse_arguments(ARG "" "OUTPUT;VARIABLE" "CLASSES;JARS;DEPENDS" ${ARGN})
+  if (NOT ARG_OUTPUT)
+    message(FATAL_ERROR "jni_cpp20_embed_classes: OUTPUT is required")
+  endif()
+  if (NOT ARG_VARIABLE)
+    get_filename_component(ARG_VARIABLE ${ARG_OUTPUT} NAME_WE)
+  endif()
+  string(MAKE_C_IDENTIFIER "${ARG_VARIABLE}" variable)
+
+  set(output_dir ${CMAKE_CURRENT_BINARY_DIR}/jni_embedded)
+  set(output ${output_dir}/${ARG_OUTPUT})
+  string(MAKE_C_IDENTIFIER "${TARGET}_${ARG_OUTPUT}" guard)
+  string(TOUPPER "HEADER_GUARD_JNI_EMBED_${guard}" guard)
+
+  set(inputs ${ARG_CLASSES})
+  set(extract_commands)
+  foreach(jar IN LISTS ARG_JARS)
+    get_filename_component(jar_name ${jar} NAME_WE)
+    set(jar_dir ${output_dir}/${ARG_OUTPUT}.jars/${jar_name})
+    list(APPEND extract_commands
+      COMMAND ${CMAKE_COMMAND} -E rm -rf ${jar_dir}
+      COMMAND ${CMAKE_COMMAND} -E make_directory ${jar_dir}
+      COMMAND ${CMAKE_COMMAND} -E chdir ${jar_dir} ${CMAKE_COMMAND} -E tar xf ${jar})
+    list(APPEND inputs ${jar_dir})
+  endforeach()
+  # Passed as a single argument to the generator
+  string(REPLACE ";" "|" inputs "${inputs}")
+
+  # The generator leaves the header untouched when it doesn't change, the
+  # stamp records that the command ran so that it isn't rerun on every build
+  add_custom_command(
+    OUTPUT ${output}.stamp
+    BYPRODUCTS ${output}
+    ${extract_commands}
+    COMMAND ${CMAKE_COMMAND}
+      "-DINPUTS=${inputs}" -DOUTPUT=${output} -DVARIABLE=${variable}
+      -DGUARD=${guard} -P ${_JNI_CPP20_EMBED_SCRIPT}
+    COMMAND ${CMAKE_COMMAND} -E touch ${output}.stamp
+    DEPENDS ${_JNI_CPP20_EMBED_SCRIPT} ${ARG_CLASSES} ${ARG_JARS} ${ARG_DEPENDS}
+    COMMENT "Embedding Java classes ${ARG_OUTPUT}"
+    VERBATIM
+  )
+  add_custom_target(${TARGET}_${guard} DEPENDS ${output}.stamp)
+  add_dependencies(${TARGET} ${TARGET}_${guard})
+  target_include_directories(${TARGET} PRIVATE ${output_dir})
+endfunction()
@@ -0,0 +1,63 @@
+# Script run by jni_cpp20_embed_classes at build time:
+#   cmake -DINPUTS=<a|b|...> -DOUTPUT=<header> -DVARIABLE=<name>
+#         -DGUARD=<include guard> -P JniEmbedClassesGenerate.cmake
+
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+
+set(arrays "")
+set(entries "")
+set(index 0)
+
+function(_embed_class name path)
+  # module-info and package-info aren't definable classes
+  if (name MATCHES "(^|/)(module|package)-info$")
+    return()
+  endif()
+  file(READ ${path} hex HEX)
+  string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," hex "${hex}")
+  # 16 bytes per line (CMake regexes have no {n} quantifier)
+  set(line "0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,0x..,")
+  string(REGEX REPLACE "(${line})" "\\1\n    " hex "${hex}")
+  string(APPEND arrays
+    "inline constexpr unsigned char ${VARIABLE}_${index}[] = {\n    ${hex}};\n")
+  string(APPEND entries "    embedded_class{\"${name}\", ${VARIABLE}_${index}},\n")
+  math(EXPR next "${index} + 1")
+  set(index ${next} PARENT_SCOPE)
+  set(arrays "${arrays}" PARENT_SCOPE)
+  set(entries "${entries}" PARENT_SCOPE)
+endfunction()
+
+foreach(input IN LISTS INPUTS)
+  if (IS_DIRECTORY ${input})
+    file(GLOB_RECURSE files RELATIVE ${input} ${input}/*.class)
+    list(SORT files)
+    foreach(file IN LISTS files)
+      string(REGEX REPLACE "\\.class$" "" name ${file})
+      _embed_class(${name} ${input}/${file})
+    endforeach()
+  else()
+    get_filename_component(name ${input} NAME)
+    string(REGEX REPLACE "\\.class$" "" name ${name})
+    _embed_class(${name} ${input})
+  endif()
+endforeach()
+
+if (index EQUAL 0)
+  message(FATAL_ERROR "jni_cpp20_embed_classes: no class found in ${INPUTS}")
+endif()
+
+file(WRITE ${OUTPUT}.tmp
+"// Generated by jni_cpp20_embed_classes, do not edit
+#ifndef ${GUARD}
+#define ${GUARD}
+
+#include \"java_embedded.hpp\"
+
+${arrays}
+inline constexpr embedded_class ${VARIABLE}[] = {
+${entries}};
+
+#endif // ${GUARD}
+")
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${OUTPUT}.tmp ${OUTPUT})
+file(REMOVE ${OUTPUT}.tmp)
@@ -0,0 +1,323 @@
+#ifndef HEADER_GUARD_DPSG_BULK_KERNELS_HPP
+#define HEADER_GUARD_DPSG_BULK_KERNELS_HPP
+
+/** Layout and type conversion kernels used by java_bulk.hpp.
+ *
+ * Pure functions over raw buffers, they don't call into the JVM and can run
+ * inside a critical region. SSE2 versions are used on x86-64 (SSE2 is part
+ * of the base instruction set there); every kernel has a scalar fallback,
+ * also used for the tail of the buffers, and forced by defining
+ * JNI_CPP20_NO_SIMD.
+ *
+ * Narrowing follows the Java casts: integers are truncated (`(short)i`),
+ * doubles rounded to the nearest float, floating point values converted to
+ * an integer saturate (NaN being 0, and types narrower than int going through
+ * int first), and anything non zero becomes JNI_TRUE when converted to
+ * jboolean.
+ */
+
+#include <jni.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if !defined(JNI_CPP20_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define JNI_CPP20_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace detail::kernels {
+
+template <class T>
+concept word32 = sizeof(T) == 4 && std::is_trivially_copyable_v<T>;
+
+/// Splits `count` records of 2 or 3 consecutive 32-bit fields into one
+/// array per field.
+template <word32 T>
+void deinterleave(const T *in, std::size_t count, T *out0, T *out1) noexcept {
+  std::size_t i = 0;
+#ifdef JNI_CPP20_SIMD_SSE2
+  auto src = reinterpret_cast<const float *>(in);
+  for (; i + 4 <= count; i += 4) {
+    __m128 a = _mm_loadu_ps(src + 2 * i);     // x0 y0 x1 y1
+    __m128 b = _mm_loadu_ps(src + 2 * i + 4); // x2 y2 x3 y3
+    _mm_storeu_ps(reinterpret_cast<float *>(out0 + i),
+                  _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(reinterpret_cast<float *>(out1 + i),
+                  _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+#endif
+  for (; i < count; ++i) {
+    out0[i] = in[2 * i];
+    out1[i] = in[2 * i + 1];
+  }
+}
+
+template <word32 T>
+void deinterleave(const T *in, std::size_t count, T *out0, T *out1,
+                  T *out2) noexcept {
+  std::size_t i = 0;
+#ifdef JNI_CPP20_SIMD_SSE2
+  auto src = reinterpret_cast<const float *>(in);
+  for (; i + 4 <= count; i += 4) {
+    __m128 a = _mm_loadu_ps(src + 3 * i);     // x0 y0 z0 x1
+    __m128 b = _mm_loadu_ps(src + 3 * i + 4); // y1 z1 x2 y2
+    __m128 c = _mm_loadu_ps(src + 3 * i + 8); // z2 x3 y3 z3
+    __m128 x = _mm_shuffle_ps(
+        a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)),
+        _MM_SHUFFLE(2, 0, 3, 0));
+    __m128 y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)),
+                              _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)),
+                              _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    _mm_storeu_ps(reinterpret_cast<float *>(out0 + i), x);
+    _mm_storeu_ps(reinterpret_cast<float *>(out1 + i), y);
+    _mm_storeu_ps(reinterpret_cast<float *>(out2 + i), z);
+  }
+#endif
+  for (; i < count; ++i) {
+    out0[i] = in[3 * i];
+    out1[i] = in[3 * i + 1];
+    out2[i] = in[3 * i + 2];
+  }
+}
+
+/// Inverse of deinterleave
+template <word32 T>
+void interleave(const T *in0, const T *in1, std::size_t count,
+                T *out) noexcept {
+  std::size_t i = 0;
+#ifdef JNI_CPP20_SIMD_SSE2
+  auto dst = reinterpret_cast<float *>(out);
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(reinterpret_cast<const float *>(in0 + i));
+    __m128 y = _mm_loadu_ps(reinterpret_cast<const float *>(in1 + i));
+    _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(x, y));
+    _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(x, y));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[2 * i] = in0[i];
+    out[2 * i + 1] = in1[i];
+  }
+}
+
+template <word32 T>
+void interleave(const T *in0, const T *in1, const T *in2, std::size_t count,
+                T *out) noexcept {
+  std::size_t i = 0;
+#ifdef JNI_CPP20_SIMD_SSE2
+  auto dst = reinterpret_cast<float *>(out);
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(reinterpret_cast<const float *>(in0 + i));
+    __m128 y = _mm_loadu_ps(reinterpret_cast<const float *>(in1 + i));
+    __m128 z = _mm_loadu_ps(reinterpret_cast<const float *>(in2 + i));
+    __m128 a = _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)),
+                              _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)),
+                              _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 c = _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)),
+                              _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    _mm_storeu_ps(dst + 3 * i, a);
+    _mm_storeu_ps(dst + 3 * i + 4, b);
+    _mm_storeu_ps(dst + 3 * i + 8, c);
+  }
+#endif
+  for (; i < count; ++i) {
+    out[3 * i] = in0[i];
+    out[3 * i + 1] = in1[i];
+    out[3 * i + 2] = in2[i];
+  }
+}
+
+/// Floating point to integer Java cast: `(int)d` saturates and maps NaN to
+/// 0, `(short)d` is `(short)(int)d`.
+template <class To, class From>
+To floating_to_integral(From value) noexcept {
+  using wide = std::conditional_t<(sizeof(To) < sizeof(jint)), jint, To>;
+  constexpr auto max = std::numeric_limits<wide>::max();
+  constexpr auto min = std::numeric_limits<wide>::min();
+  if (value != value) {
+    return 0;
+  }
+  // (From)max rounds up to a power of 2, which is already out of range
+  if (value >= static_cast<From>(max)) {
+    return static_cast<To>(max);
+  }
+  if (value <= static_cast<From>(min)) {
+    return static_cast<To>(min);
+  }
+  return static_cast<To>(static_cast<wide>(value));
+}
+
+/// Element-wise conversion with the semantic of a Java cast
+template <class From, class To>
+void convert(const From *in, std::size_t count, To *out) noexcept {
+  if constexpr (std::is_same_v<From, To> ||
+                (std::is_same_v<From, bool> && std::is_same_v<To, jboolean>)) {
+    // bool is stored as a 0/1 byte, like jboolean
+    std::memcpy(out, in, count * sizeof(To));
+  } else if constexpr (std::is_same_v<To, jboolean>) {
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = in[i] != 0 ? JNI_TRUE : JNI_FALSE;
+    }
+  } else if constexpr (std::is_same_v<To, bool>) {
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = in[i] != 0;
+    }
+  } else if constexpr (std::is_floating_point_v<From> &&
+                       std::is_integral_v<To>) {
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = floating_to_integral<To>(in[i]);
+    }
+  } else {
+    for (std::size_t i = 0; i < count; ++i) {
+      out[i] = (To)in[i];
+    }
+  }
+}
+
+#ifdef JNI_CPP20_SIMD_SSE2
+template <>
+inline void convert(const double *in, std::size_t count, float *out) noexcept {
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(in + i));
+    __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(in + i + 2));
+    _mm_storeu_ps(out + i, _mm_movelh_ps(lo, hi));
+  }
+  for (; i < count; ++i) {
+    out[i] = (float)in[i];
+  }
+}
+
+template <>
+inline void convert(const float *in, std::size_t count, double *out) noexcept {
+  std::size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 v = _mm_loadu_ps(in + i);
+    _mm_storeu_pd(out + i, _mm_cvtps_pd(v));
+    _mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+  }
+  for (; i < count; ++i) {
+    out[i] = in[i];
+  }
+}
+
+template <>
+inline void convert(const jint *in, std::size_t count, jshort *out) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    // Sign extending the low half first makes the saturating pack a
+    // truncation
+    auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 4));
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_packs_epi32(lo, hi));
+  }
+  for (; i < count; ++i) {
+    out[i] = (jshort)in[i];
+  }
+}
+
+template <>
+inline void convert(const jint *in, std::size_t count, jbyte *out) noexcept {
+  std::size_t i = 0;
+  auto load = [&](std::size_t at) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + at));
+    return _mm_srai_epi32(_mm_slli_epi32(v, 24), 24);
+  };
+  for (; i + 16 <= count; i += 16) {
+    auto lo = _mm_packs_epi32(load(i), load(i + 4));
+    auto hi = _mm_packs_epi32(load(i + 8), load(i + 12));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_packs_epi16(lo, hi));
+  }
+  for (; i < count; ++i) {
+    out[i] = (jbyte)in[i];
+  }
+}
+
+template <>
+inline void convert(const jint *in, std::size_t count,
+                    jboolean *out) noexcept {
+  std::size_t i = 0;
+  const auto zero = _mm_setzero_si128();
+  const auto one = _mm_set1_epi8(1);
+  auto is_zero = [&](std::size_t at) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + at));
+    return _mm_cmpeq_epi32(v, zero);
+  };
+  for (; i + 16 <= count; i += 16) {
+    auto lo = _mm_packs_epi32(is_zero(i), is_zero(i + 4));
+    auto hi = _mm_packs_epi32(is_zero(i + 8), is_zero(i + 12));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_andnot_si128(_mm_packs_epi16(lo, hi), one));
+  }
+  for (; i < count; ++i) {
+    out[i] = in[i] != 0 ? JNI_TRUE : JNI_FALSE;
+  }
+}
+
+template <>
+inline void convert(const jshort *in, std::size_t count, jint *out) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i + 4),
+                     _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+  }
+  for (; i < count; ++i) {
+    out[i] = in[i];
+  }
+}
+
+template <>
+inline void convert(const jbyte *in, std::size_t count, jint *out) noexcept {
+  std::size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    auto lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+    auto hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+    auto dst = reinterpret_cast<__m128i *>(out + i);
+    _mm_storeu_si128(dst, _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16));
+    _mm_storeu_si128(dst + 1, _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16));
+    _mm_storeu_si128(dst + 2, _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16));
+    _mm_storeu_si128(dst + 3, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16));
+  }
+  for (; i < count; ++i) {
+    out[i] = in[i];
+  }
+}
+
+template <>
+inline void convert(const jboolean *in, std::size_t count, bool *out) noexcept {
+  std::size_t i = 0;
+  const auto zero = _mm_setzero_si128();
+  const auto one = _mm_set1_epi8(1);
+  for (; i + 16 <= count; i += 16) {
+    auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_andnot_si128(_mm_cmpeq_epi8(v, zero), one));
+  }
+  for (; i < count; ++i) {
+    out[i] = in[i] != 0;
+  }
+}
+#endif // JNI_CPP20_SIMD_SSE2
+
+} // namespace detail::kernels
+
+#endif // HEADER_GUARD_DPSG_BULK_KERNELS_HPP
@@ -0,0 +1,261 @@
+#ifndef HEADER_GUARD_DPSG_CALL_PLAN_HPP
+#define HEADER_GUARD_DPSG_CALL_PLAN_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_method.hpp"
+#include "java_object.hpp"
+#include "java_ref.hpp"
+#include "jni_call.hpp"
+#include "jni_convert.hpp"
+#include "result.hpp"
+
+#include <jni.h>
+
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+/** Pre-resolved sequences of calls on one class.
+ *
+ * A call_plan is built once from the method handles of the sequence. Running
+ * it binds fresh arguments to every step, pushes a single local frame for
+ * all the intermediate references, and calls every step through the jvalue
+ * (`Call<Type>MethodA`) variant of the JNI functions, checking for a Java
+ * exception once after each step. The first exception interrupts the
+ * sequence and is returned along with the index of the failing step. On
+ * success the return value of the last step is returned, every other
+ * intermediate value is discarded with the frame.
+ *
+ * @code
+ * auto match = make_call_plan(runner_cls, add_agent, add_agent, initialize,
+ *                             run_agents, get_json_result);
+ * auto json = match.run(runner, std::forward_as_tuple(cmd1, cmd1),
+ *                       std::forward_as_tuple(cmd2, cmd2),
+ *                       std::forward_as_tuple(properties), std::tuple{},
+ *                       std::tuple{});
+ * @endcode
+ *
+ * The plan keeps a global reference to the class, bound to the JNIEnv of the
+ * thread that created it: it must be run and destroyed on that thread.
+ */
+
+/// Error of a call plan: the step that threw and the exception it threw. The
+/// exception is cleared from the JNIEnv.
+struct plan_error {
+  /// Used as `step` when the local frame couldn't be created
+  constexpr static inline std::size_t no_step = (std::size_t)-1;
+
+  std::size_t step;
+  java_ref<jthrowable> exception;
+};
+
+namespace detail {
+template <class T> struct plan_step_traits;
+
+template <meta::fixed_string CN, class Ret, class... Params>
+struct plan_step_traits<java_method<CN, Ret(Params...)>> {
+  constexpr static inline bool is_static = false;
+  using proto = Ret(Params...);
+  using return_type = Ret;
+};
+
+template <meta::fixed_string CN, class Ret, class... Params>
+struct plan_step_traits<java_static_method<CN, Ret(Params...)>> {
+  constexpr static inline bool is_static = true;
+  using proto = Ret(Params...);
+  using return_type = Ret;
+};
+
+template <class Proto, class Tuple> struct plan_args_match : std::false_type {};
+template <class Proto, class... Args>
+struct plan_args_match<Proto, std::tuple<Args...>>
+    : std::bool_constant<is_jni_callable<Proto, std::decay_t<Args>...>> {};
+
+// Number of arguments of a step converted to a new local reference (strings,
+// primitive arrays, see jni_convert.hpp)
+template <class T> struct is_owned_ref : std::false_type {};
+template <class Ref> struct is_owned_ref<owned_ref<Ref>> : std::true_type {};
+
+template <class Proto, class Tuple> struct plan_local_args;
+template <class Ret, class... Expected, class... Args>
+struct plan_local_args<Ret(Expected...), std::tuple<Args...>> {
+  constexpr static inline jint value =
+      (0 + ... +
+       (jint)is_owned_ref<decltype(jni_arg_converter<
+                                   std::remove_cvref_t<Expected>,
+                                   std::decay_t<Args>>::
+                                       convert(std::declval<JNIEnv &>(),
+                                               std::declval<const std::decay_t<
+                                                   Args> &>()))>::value);
+};
+
+template <class T> constexpr bool is_primitive_return_v =
+    std::is_void_v<T> || native_jni_type<T> || std::is_same_v<T, signed char>;
+} // namespace detail
+
+template <meta::fixed_string ClassName, class... Steps> class call_plan {
+  static_assert(sizeof...(Steps) > 0, "a call plan needs at least one step");
+  static_assert(((Steps::class_name == ClassName) && ...),
+                "every step must be a method of the plan's class");
+
+  using last_step =
+      detail::plan_step_traits<std::tuple_element_t<sizeof...(Steps) - 1,
+                                                    std::tuple<Steps...>>>;
+  using last_return = typename last_step::return_type;
+
+  constexpr static inline bool has_instance_steps =
+      (!detail::plan_step_traits<Steps>::is_static || ...);
+
+  // Every step may create one local reference, plus the pending exception,
+  // plus the references its arguments are converted to
+  template <class... Args>
+  constexpr static inline jint frame_capacity =
+      (jint)sizeof...(Steps) + 1 +
+      (0 + ... +
+       detail::plan_local_args<typename detail::plan_step_traits<Steps>::proto,
+                               Args>::value);
+
+  java_class<ClassName, false> _class;
+  jmethodID _ids[sizeof...(Steps)];
+
+public:
+  using return_type = std::conditional_t<
+      std::is_void_v<last_return>, std::monostate,
+      typename detail::deduce_return_type<typename last_step::proto>::type>;
+  using result_type = dpsg::result<return_type, plan_error>;
+
+  template <bool L>
+  explicit call_plan(const java_class<ClassName, L> &cls,
+                     const Steps &...steps) noexcept
+      : _class{(jclass)cls.env().NewGlobalRef(cls.get()), cls.get_env()},
+        _ids{steps.id()...} {}
+
+  constexpr static std::size_t size() noexcept { return sizeof...(Steps); }
+
+  /** @brief Runs every step in order.
+   *
+   * @param[in] target Object the instance methods are called on
+   * @param[in] args One tuple of arguments per step (e.g.
+   * std::forward_as_tuple(a, b), std::tuple{} for no argument)
+   *
+   * @return The return value of the last step (std::monostate for void), or
+   * the first exception thrown.
+   */
+  template <class... Args>
+    requires(sizeof...(Args) == sizeof...(Steps))
+  result_type run(const java_object<ClassName> &target, Args &&...args) {
+    return _run(target.get(), std::index_sequence_for<Steps...>{},
+                std::forward<Args>(args)...);
+  }
+
+  /// Same as above, for plans made of static methods only
+  template <class... Args>
+    requires(sizeof...(Args) == sizeof...(Steps) && !has_instance_steps)
+  result_type run(Args &&...args) {
+    return _run(nullptr, std::index_sequence_for<Steps...>{},
+                std::forward<Args>(args)...);
+  }
+
+private:
+  template <std::size_t... Is, class... Args>
+  result_type _run(jobject target, std::index_sequence<Is...>,
+                   Args &&...args) {
+    (_check_args<Is, std::remove_cvref_t<Args>>(), ...);
+    auto &env = _class.env();
+    if (env.PushLocalFrame(frame_capacity<std::remove_cvref_t<Args>...>) !=
+        JNI_OK) {
+      return _fail(env, plan_error::no_step, false);
+    }
+
+    using stored_type =
+        std::conditional_t<detail::is_primitive_return_v<last_return>,
+                           std::conditional_t<std::is_void_v<last_return>,
+                                              std::monostate, last_return>,
+                           jobject>;
+    stored_type last{};
+    std::size_t failed = sizeof...(Steps);
+    bool ok = ((_step<Is>(env, target, args, last) ||
+                (failed = Is, false)) &&
+               ...);
+    if (!ok) {
+      return _fail(env, failed, true);
+    }
+
+    if constexpr (detail::is_primitive_return_v<last_return>) {
+      env.PopLocalFrame(nullptr);
+      return result_type{dpsg::in_place_value, last};
+    } else {
+      auto ptr = env.PopLocalFrame(last);
+      return result_type{
+          dpsg::in_place_value,
+          return_type{(typename return_type::pointer)ptr, _class.get_env()}};
+    }
+  }
+
+  template <std::size_t I, class Tuple> constexpr static void _check_args() {
+    using step = detail::plan_step_traits<
+        std::tuple_element_t<I, std::tuple<Steps...>>>;
+    static_assert(detail::plan_args_match<typename step::proto, Tuple>::value,
+                  "the arguments bound to a step don't match its prototype");
+  }
+
+  template <std::size_t I, class Tuple, class Stored>
+  bool _step(JNIEnv &env, jobject target, const Tuple &args, Stored &last) {
+    using step = detail::plan_step_traits<
+        std::tuple_element_t<I, std::tuple<Steps...>>>;
+    using ret = typename step::return_type;
+    jobject self = step::is_static ? (jobject)_class.get() : target;
+    assert(self != nullptr && "instance step run without a target");
+
+    std::apply(
+        [&](const auto &...a) {
+          jni_invoker<typename step::proto>::invoke_a(
+              env,
+              [&](const jvalue *values) {
+                using result = detail::jni_return_t<ret>;
+                auto id = _ids[I];
+                if constexpr (I + 1 == sizeof...(Steps) &&
+                              !std::is_void_v<ret>) {
+                  last = (Stored)(step::is_static
+                                      ? detail::call_static_method_a<result>(
+                                            env, (jclass)self, id, values)
+                                      : detail::call_method_a<result>(
+                                            env, self, id, values));
+                } else if constexpr (step::is_static) {
+                  detail::call_static_method_a<result>(env, (jclass)self, id,
+                                                       values);
+                } else {
+                  detail::call_method_a<result>(env, self, id, values);
+                }
+              },
+              a...);
+        },
+        args);
+    return !env.ExceptionCheck();
+  }
+
+  result_type _fail(JNIEnv &env, std::size_t step, bool pop) {
+    jthrowable exception = env.ExceptionOccurred();
+    env.ExceptionClear();
+    if (pop) {
+      exception = (jthrowable)env.PopLocalFrame(exception);
+    }
+    return result_type{
+        dpsg::in_place_error,
+        plan_error{step, java_ref<jthrowable>{exception, _class.get_env()}}};
+  }
+};
+
+/// Builds a call plan running the given methods of cls in order
+template <meta::fixed_string ClassName, bool L, class... Steps>
+call_plan<ClassName, std::remove_cvref_t<Steps>...>
+make_call_plan(const java_class<ClassName, L> &cls, const Steps &...steps) {
+  return call_plan<ClassName, std::remove_cvref_t<Steps>...>{cls, steps...};
+}
+
+#endif // HEADER_GUARD_DPSG_CALL_PLAN_HPP
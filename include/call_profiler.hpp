@@ -0,0 +1,205 @@
+#ifndef HEADER_GUARD_DPSG_CALL_PROFILER_HPP
+#define HEADER_GUARD_DPSG_CALL_PROFILER_HPP
+
+/** Spans of the calls made through java_class, for mixed-mode profiling.
+ *
+ * Enabled by defining JNI_CPP20_PROFILE_CALLS (CMake option of the same
+ * name). When disabled call_label and call_span are empty and java_class is
+ * unchanged.
+ *
+ * When enabled, every java_class::call and instantiate records two nested
+ * spans on the calling thread:
+ *  + "call": the whole wrapper, argument conversions included, named after
+ *    the method ("Class.name(descriptor)", e.g. `Hello.repeat(I)Ljava/lang/String;`);
+ *  + "jni": the JNI function alone, i.e. the transition and the Java method.
+ * The difference between the two is the time spent in the C++ wrapper.
+ *
+ * Spans are kept in memory (one buffer per thread, behind an uncontended
+ * lock) until written with write_chrome_trace, in the JSON format of
+ * chrome://tracing and Perfetto. Timestamps are read from CLOCK_MONOTONIC
+ * (std::chrono::steady_clock), as `perf record -k mono` does, so that the
+ * spans can be lined up with a perf profile. For perf to name the frames of
+ * JIT-compiled Java methods, start the JVM with jvm_options::perf_map().
+ *
+ * @code
+ * call_profiler::clear();
+ * play_match(jvm);
+ * std::ofstream trace{"match.trace.json"};
+ * call_profiler::write_chrome_trace(trace);
+ * @endcode
+ */
+
+#include <cstddef>
+
+#ifdef JNI_CPP20_PROFILE_CALLS
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
+#endif
+
+#ifdef JNI_CPP20_PROFILE_CALLS
+
+/// Name of the spans of a method, a string with static storage
+class call_label {
+  const char *_name = "<unnamed>";
+
+public:
+  constexpr call_label() noexcept = default;
+  constexpr explicit call_label(const char *name) noexcept : _name(name) {}
+  constexpr const char *c_str() const noexcept { return _name; }
+};
+
+class call_profiler {
+public:
+  struct span {
+    const char *name;
+    const char *category;
+    std::int64_t start_ns;
+    std::int64_t end_ns;
+  };
+
+private:
+  struct thread_buffer {
+    std::mutex mutex;
+    std::uint32_t tid;
+    std::vector<span> spans;
+  };
+
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<thread_buffer>> _threads;
+
+  static call_profiler &instance() {
+    static call_profiler profiler;
+    return profiler;
+  }
+
+  static thread_buffer &this_thread() {
+    thread_local std::shared_ptr<thread_buffer> buffer = [] {
+      auto &self = instance();
+      auto b = std::make_shared<thread_buffer>();
+      std::lock_guard lock{self._mutex};
+      b->tid = (std::uint32_t)self._threads.size() + 1;
+      self._threads.push_back(b);
+      return b;
+    }();
+    return *buffer;
+  }
+
+  static void write_string(std::ostream &os, std::string_view s) {
+    os << '"';
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        os << '\\';
+      }
+      os << c;
+    }
+    os << '"';
+  }
+
+  // Microseconds with a nanosecond fraction, without going through double
+  static void write_us(std::ostream &os, std::int64_t ns) {
+    os << ns / 1000 << '.' << (char)('0' + ns % 1000 / 100)
+       << (char)('0' + ns % 100 / 10) << (char)('0' + ns % 10);
+  }
+
+public:
+  static std::int64_t now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  static void record(const span &s) {
+    auto &buffer = this_thread();
+    std::lock_guard lock{buffer.mutex};
+    buffer.spans.push_back(s);
+  }
+
+  /// Number of spans recorded on every thread
+  static std::size_t size() {
+    auto &self = instance();
+    std::lock_guard lock{self._mutex};
+    std::size_t total = 0;
+    for (auto &t : self._threads) {
+      std::lock_guard thread_lock{t->mutex};
+      total += t->spans.size();
+    }
+    return total;
+  }
+
+  /// Drops the spans recorded so far
+  static void clear() {
+    auto &self = instance();
+    std::lock_guard lock{self._mutex};
+    for (auto &t : self._threads) {
+      std::lock_guard thread_lock{t->mutex};
+      t->spans.clear();
+    }
+  }
+
+  /// Writes the spans as complete ("X") events of a Chrome trace, in
+  /// microseconds of CLOCK_MONOTONIC
+  static void write_chrome_trace(std::ostream &os) {
+    auto &self = instance();
+    std::lock_guard lock{self._mutex};
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    const char *separator = "\n";
+    for (auto &t : self._threads) {
+      std::lock_guard thread_lock{t->mutex};
+      for (auto &s : t->spans) {
+        os << separator << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << t->tid
+           << ",\"ts\":";
+        write_us(os, s.start_ns);
+        os << ",\"dur\":";
+        write_us(os, s.end_ns - s.start_ns);
+        os << ",\"cat\":";
+        write_string(os, s.category);
+        os << ",\"name\":";
+        write_string(os, s.name);
+        os << '}';
+        separator = ",\n";
+      }
+    }
+    os << "\n]}\n";
+  }
+};
+
+/// Records a span from its construction to its destruction
+class call_span {
+  call_profiler::span _span;
+
+public:
+  explicit call_span(call_label label, const char *category = "call") noexcept
+      : _span{label.c_str(), category, call_profiler::now(), 0} {}
+  call_span(const call_span &) = delete;
+  call_span &operator=(const call_span &) = delete;
+  ~call_span() {
+    _span.end_ns = call_profiler::now();
+    call_profiler::record(_span);
+  }
+};
+
+#else // JNI_CPP20_PROFILE_CALLS
+
+struct call_label {
+  constexpr call_label() noexcept = default;
+  constexpr explicit call_label(const char *) noexcept {}
+  constexpr const char *c_str() const noexcept { return ""; }
+};
+
+struct call_span {
+  constexpr explicit call_span(call_label, const char * = nullptr) noexcept {}
+};
+
+struct call_profiler {
+  static constexpr std::size_t size() noexcept { return 0; }
+  static constexpr void clear() noexcept {}
+};
+
+#endif // JNI_CPP20_PROFILE_CALLS
+
+#endif // HEADER_GUARD_DPSG_CALL_PROFILER_HPP
@@ -0,0 +1,307 @@
+#ifndef HEADER_GUARD_DPSG_CRITICAL_SCHEDULER_HPP
+#define HEADER_GUARD_DPSG_CRITICAL_SCHEDULER_HPP
+
+#include "java_array.hpp"
+#include "java_bulk.hpp"
+#include "java_object.hpp"
+
+#include <jni.h>
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** Budgeted access to the content of Java arrays and strings.
+ *
+ * GetPrimitiveArrayCritical and GetStringCritical give direct access to the
+ * Java heap, but may hold the garbage collector off for as long as the
+ * section lasts. A critical_scheduler only hands out critical access to
+ * sections within its budget, and copies the others with
+ * Get<Type>ArrayRegion/GetStringRegion (and Set<Type>ArrayRegion to write
+ * them back):
+ *  + sections larger than max_bytes are copied;
+ *  + sections expected to stay pinned longer than max_pinned_time are
+ *    copied. The estimate is the pinned time per byte observed by the
+ *    calling thread, decayed every time it causes a copy so that pinning is
+ *    attempted again;
+ *  + at most max_concurrent threads hold a critical section at the same
+ *    time, the others copy instead of waiting.
+ *
+ * The callback must not call JNI functions, nor block on another thread that
+ * may call them: it may run in a critical section. Pinned time, bytes and
+ * budget overruns are recorded per thread, see metrics().
+ *
+ * @code
+ * critical_scheduler scheduler{{.max_bytes = 64 * 1024}};
+ * scheduler.with_elements(positions, critical_access::read_only,
+ *                         [&](std::span<jfloat> xs) { index.update(xs); });
+ * for (auto &m : scheduler.metrics()) {
+ *   log(m.thread, m.values.pinned_time, m.values.overruns);
+ * }
+ * @endcode
+ */
+
+struct critical_budget {
+  /// Sections accessing more bytes are copied
+  std::size_t max_bytes = 256 * 1024;
+  /// Sections expected to stay pinned longer are copied
+  std::chrono::nanoseconds max_pinned_time = std::chrono::microseconds{100};
+  /// Threads allowed in a critical section at the same time
+  unsigned max_concurrent = 2;
+};
+
+/// How a section accessed the Java data
+enum class critical_path {
+  pinned,
+  copied,
+  /// Pinning raised an exception (OutOfMemoryError), left pending: the
+  /// callback was not called
+  failed,
+};
+
+struct critical_metrics {
+  std::uint64_t pinned_sections = 0;
+  std::uint64_t copied_sections = 0;
+  std::uint64_t pinned_bytes = 0;
+  std::uint64_t copied_bytes = 0;
+  /// Pinned sections that exceeded max_pinned_time
+  std::uint64_t overruns = 0;
+  std::chrono::nanoseconds pinned_time{0};
+  std::chrono::nanoseconds max_pinned_time{0};
+};
+
+struct thread_critical_metrics {
+  std::thread::id thread;
+  critical_metrics values;
+};
+
+class critical_scheduler {
+  using clock = std::chrono::steady_clock;
+
+  // Written by its thread only, read by metrics()
+  struct thread_slot {
+    std::thread::id thread = std::this_thread::get_id();
+    std::atomic<std::uint64_t> pinned_sections{0};
+    std::atomic<std::uint64_t> copied_sections{0};
+    std::atomic<std::uint64_t> pinned_bytes{0};
+    std::atomic<std::uint64_t> copied_bytes{0};
+    std::atomic<std::uint64_t> overruns{0};
+    std::atomic<std::int64_t> pinned_ns{0};
+    std::atomic<std::int64_t> max_pinned_ns{0};
+    // Pinned nanoseconds per byte, exponential moving average
+    double ns_per_byte = 0;
+  };
+
+  critical_budget _budget;
+  std::uint64_t _id;
+  std::atomic<unsigned> _active{0};
+  mutable std::mutex _slots_mutex;
+  std::vector<std::unique_ptr<thread_slot>> _slots;
+
+  static std::uint64_t _next_id() noexcept {
+    static std::atomic<std::uint64_t> next{0};
+    return next.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Slot of the calling thread, cached for the last scheduler it used
+  thread_slot &_slot() {
+    struct cache {
+      std::uint64_t owner = (std::uint64_t)-1;
+      thread_slot *slot = nullptr;
+    };
+    thread_local cache last;
+    if (last.owner != _id) {
+      std::lock_guard lock{_slots_mutex};
+      auto id = std::this_thread::get_id();
+      thread_slot *found = nullptr;
+      for (auto &s : _slots) {
+        if (s->thread == id) {
+          found = s.get();
+          break;
+        }
+      }
+      if (found == nullptr) {
+        found = _slots.emplace_back(std::make_unique<thread_slot>()).get();
+      }
+      last = {_id, found};
+    }
+    return *last.slot;
+  }
+
+  // Leaves the critical section, even if the callback throws
+  struct admission {
+    std::atomic<unsigned> &active;
+    ~admission() { active.fetch_sub(1, std::memory_order_release); }
+  };
+
+  // Reserves a critical section if bytes fits in the budget
+  bool _admit(thread_slot &slot, std::size_t bytes) noexcept {
+    if (bytes > _budget.max_bytes) {
+      return false;
+    }
+    if (slot.ns_per_byte * (double)bytes >
+        (double)_budget.max_pinned_time.count()) {
+      slot.ns_per_byte *= 0.875;
+      return false;
+    }
+    auto active = _active.load(std::memory_order_relaxed);
+    do {
+      if (active >= _budget.max_concurrent) {
+        return false;
+      }
+    } while (!_active.compare_exchange_weak(active, active + 1,
+                                            std::memory_order_acquire,
+                                            std::memory_order_relaxed));
+    return true;
+  }
+
+  void _record_pinned(thread_slot &slot, std::size_t bytes,
+                      clock::time_point start) noexcept {
+    auto elapsed = clock::now() - start;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+                  .count();
+    auto sample = (double)ns / (double)(bytes == 0 ? 1 : bytes);
+    slot.ns_per_byte = slot.ns_per_byte == 0
+                           ? sample
+                           : 0.75 * slot.ns_per_byte + 0.25 * sample;
+    slot.pinned_sections.fetch_add(1, std::memory_order_relaxed);
+    slot.pinned_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    slot.pinned_ns.fetch_add(ns, std::memory_order_relaxed);
+    if (ns > slot.max_pinned_ns.load(std::memory_order_relaxed)) {
+      slot.max_pinned_ns.store(ns, std::memory_order_relaxed);
+    }
+    if (elapsed > _budget.max_pinned_time) {
+      slot.overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  static void _record_copied(thread_slot &slot, std::size_t bytes) noexcept {
+    slot.copied_sections.fetch_add(1, std::memory_order_relaxed);
+    slot.copied_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+public:
+  explicit critical_scheduler(critical_budget budget = {}) noexcept
+      : _budget(budget), _id(_next_id()) {}
+
+  critical_scheduler(const critical_scheduler &) = delete;
+  critical_scheduler &operator=(const critical_scheduler &) = delete;
+
+  const critical_budget &budget() const noexcept { return _budget; }
+
+  /** @brief Calls f with the elements of array, pinned or copied.
+   *
+   * @details With critical_access::read_write, changes made to a copy are
+   * written back to the array.
+   */
+  template <jni_primitive_element T, bool L, class F>
+    requires std::invocable<F &, std::span<T>>
+  critical_path with_elements(const java_array<T, L> &array,
+                              critical_access access, F &&f) {
+    auto size = array.size();
+    auto bytes = (std::size_t)size * sizeof(T);
+    auto &slot = _slot();
+    if (_admit(slot, bytes)) {
+      auto start = clock::now();
+      bool pinned = false;
+      {
+        admission section{_active};
+        critical_array<T> mapped{array, size, access};
+        if (mapped) {
+          pinned = true;
+          f(mapped.span());
+        }
+      }
+      if (pinned) {
+        _record_pinned(slot, bytes, start);
+        return critical_path::pinned;
+      }
+      if (array.env().ExceptionCheck()) {
+        return critical_path::failed;
+      }
+    }
+    // Not reused across calls: f may access another array
+    std::vector<T> copy((std::size_t)size);
+    array.get_region(0, copy);
+    f(std::span<T>{copy});
+    if (access == critical_access::read_write) {
+      array.set_region(0, std::span<const T>{copy});
+    }
+    _record_copied(slot, bytes);
+    return critical_path::copied;
+  }
+
+  /// Calls f with the UTF-16 code units of str, pinned or copied
+  template <bool L, class F>
+    requires std::invocable<F &, std::span<const jchar>>
+  critical_path with_chars(const java_string<L> &str, F &&f) {
+    auto &env = str.env();
+    auto length = env.GetStringLength(str.get());
+    auto bytes = (std::size_t)length * sizeof(jchar);
+    auto &slot = _slot();
+    if (_admit(slot, bytes)) {
+      struct critical_chars {
+        JNIEnv &env;
+        jstring str;
+        const jchar *chars;
+        ~critical_chars() {
+          if (chars != nullptr) {
+            env.ReleaseStringCritical(str, chars);
+          }
+        }
+      };
+      auto start = clock::now();
+      bool pinned = false;
+      {
+        admission section{_active};
+        critical_chars mapped{env, str.get(),
+                              env.GetStringCritical(str.get(), nullptr)};
+        if (mapped.chars != nullptr) {
+          pinned = true;
+          f(std::span<const jchar>{mapped.chars, (std::size_t)length});
+        }
+      }
+      if (pinned) {
+        _record_pinned(slot, bytes, start);
+        return critical_path::pinned;
+      }
+      if (env.ExceptionCheck()) {
+        return critical_path::failed;
+      }
+    }
+    std::vector<jchar> copy((std::size_t)length);
+    env.GetStringRegion(str.get(), 0, length, copy.data());
+    f(std::span<const jchar>{copy});
+    _record_copied(slot, bytes);
+    return critical_path::copied;
+  }
+
+  /// Metrics of every thread that used the scheduler
+  std::vector<thread_critical_metrics> metrics() const {
+    std::lock_guard lock{_slots_mutex};
+    std::vector<thread_critical_metrics> result;
+    result.reserve(_slots.size());
+    for (auto &s : _slots) {
+      constexpr auto relaxed = std::memory_order_relaxed;
+      result.push_back(thread_critical_metrics{
+          s->thread,
+          critical_metrics{
+              s->pinned_sections.load(relaxed),
+              s->copied_sections.load(relaxed), s->pinned_bytes.load(relaxed),
+              s->copied_bytes.load(relaxed), s->overruns.load(relaxed),
+              std::chrono::nanoseconds{s->pinned_ns.load(relaxed)},
+              std::chrono::nanoseconds{s->max_pinned_ns.load(relaxed)}}});
+    }
+    return result;
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_CRITICAL_SCHEDULER_HPP
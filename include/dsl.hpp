@@ -11,6 +11,10 @@ template <meta::fixed_string str> struct java_class_desc {
   constexpr static const meta::fixed_string name = str;
 };
 
+// Array types can't be used in prototypes: parameters are adjusted to pointers
+// and functions can't return arrays. java_array_desc<T> stands for T[] there.
+template <class T> struct java_array_desc {};
+
 template <class T> struct jni_desc;
 
 template <> struct jni_desc<bool> {
@@ -45,10 +49,18 @@ template <> struct jni_desc<short> {
   static constexpr const meta::fixed_string name{"S"};
 };
 
+template <> struct jni_desc<signed char> {
+  static constexpr const meta::fixed_string name{"B"};
+};
+
 template <typename T> struct jni_desc<T[]> {
   static constexpr const meta::fixed_string name = "[" + jni_desc<T>::name;
 };
 
+template <typename T> struct jni_desc<java_array_desc<T>> {
+  static constexpr const meta::fixed_string name = "[" + jni_desc<T>::name;
+};
+
 template <typename Ret, typename... Args> struct jni_desc<Ret(Args...)> {
   static constexpr const meta::fixed_string name =
       "(" + (jni_desc<Args>::name + ...) + ")" + jni_desc<Ret>::name;
@@ -79,6 +91,8 @@ namespace java {
 namespace lang {
 using String = java_class_desc<"java/lang/String">;
 using Object = java_class_desc<"java/lang/Object">;
+using Class = java_class_desc<"java/lang/Class">;
+using ClassLoader = java_class_desc<"java/lang/ClassLoader">;
 } // namespace lang
 namespace util {
 using Properties = java_class_desc<"java/util/Properties">;
@@ -87,7 +101,13 @@ using Properties = java_class_desc<"java/util/Properties">;
 
 template <class T> constexpr static inline auto jni_desc_v = jni_desc<T>{};
 
+// Compiled in every translation unit, disabled by JNI_CPP20_NO_SELF_CHECKS
+#ifndef JNI_CPP20_NO_SELF_CHECKS
 static_assert(jni_desc<int[]>::name == "[I");
+static_assert(jni_desc<signed char[]>::name == "[B");
+static_assert(jni_desc<java_array_desc<java_array_desc<int>>(
+                  java_array_desc<java::lang::String>)>::name ==
+              meta::fixed_string{"([Ljava/lang/String;)[[I"});
 static_assert(jni_desc<int(int)>::name == "(I)I");
 static_assert(jni_desc<java::lang::String>::name == "Ljava/lang/String;");
 static_assert(jni_desc<int(int, int)>::name == "(II)I");
@@ -99,6 +119,7 @@ static_assert(jni_desc<void()>::name ==
 constexpr static inline auto n = jni_desc<void(java::util::Properties)>::name;
 static_assert(n ==
               meta::fixed_string{"(Ljava/util/Properties;)V"});
+#endif
 
 template<class T>
 concept jni_type_desc = requires {
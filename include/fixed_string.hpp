@@ -83,6 +83,7 @@ constexpr fixed_string<N1 + N2 - 1> operator+(const fixed_string<N1> &s1,
 
 template <size_t N> constexpr size_t size(fixed_string<N>) { return N; }
 
+#ifndef JNI_CPP20_NO_SELF_CHECKS
 constexpr static inline meta::fixed_string s = "abc";
 constexpr static inline meta::fixed_string s2 = "def";
 static_assert(s == "abc");
@@ -94,6 +95,7 @@ static_assert(s2 != "dfe");
 static_assert(size(s2) == 4);
 static_assert(size(s + s2) == 7);
 static_assert(s + s2 == "abcdef");
+#endif
 } // namespace meta
 
 namespace literals {
@@ -0,0 +1,392 @@
+#ifndef HEADER_GUARD_DPSG_HEAP_MONITOR_HPP
+#define HEADER_GUARD_DPSG_HEAP_MONITOR_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_ref.hpp"
+#include "jni_call.hpp"
+#include "jvm.hpp"
+#include "jvm_thread.hpp"
+
+#include <jni.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** Java heap pressure, for C++ code feeding work to Java.
+ *
+ * A heap_monitor polls the JVM on a background thread attached as a daemon:
+ *  + Runtime.totalMemory/freeMemory/maxMemory for the heap (no allocation on
+ *    the Java side);
+ *  + GarbageCollectorMXBean.getCollectionCount/getCollectionTime of every
+ *    collector, when java.management is available.
+ * Method IDs and the beans are resolved once, by start().
+ *
+ * The latest values are published as a heap_snapshot behind a sequence lock:
+ * snapshot() never blocks and never calls into the JVM, it can be used on
+ * every submission.
+ *
+ * From every snapshot the monitor derives a heap_pressure, compared to the
+ * heap_limits it was started with: the share of the maximum heap in use, and
+ * the share of the last interval spent collecting (a GC storm shows there
+ * before the heap fills up). Producers throttle themselves with:
+ *  + try_admit(): false under critical pressure, for callers that can drop or
+ *    postpone work;
+ *  + wait_admit(timeout): blocks until the pressure falls below critical;
+ *  + a callback passed to start(), called on the monitor thread when the
+ *    level changes, e.g. to pause and resume an executor.
+ *
+ * @code
+ * auto heap = unwrap(heap_monitor::start(jvm, {.interval = 50ms}));
+ * for (auto &batch : batches) {
+ *   if (!heap.wait_admit(1s)) {
+ *     log_overload(heap.snapshot());
+ *   }
+ *   construct_all(move_cls, move_ctor, batch);
+ * }
+ * @endcode
+ *
+ * The monitor must be destroyed before the JVM, it stops and joins the
+ * background thread.
+ */
+
+namespace java::lang {
+using Runtime = java_class_desc<"java/lang/Runtime">;
+namespace management {
+using ManagementFactory =
+    java_class_desc<"java/lang/management/ManagementFactory">;
+using GarbageCollectorMXBean =
+    java_class_desc<"java/lang/management/GarbageCollectorMXBean">;
+} // namespace management
+} // namespace java::lang
+
+namespace java::util {
+using List = java_class_desc<"java/util/List">;
+} // namespace java::util
+
+/// Heap figures, in bytes, as of the last poll
+struct heap_snapshot {
+  std::int64_t used = 0;
+  std::int64_t committed = 0;
+  /// -1 if the heap has no limit
+  std::int64_t max = -1;
+  /// Collections and milliseconds spent collecting since the start of the
+  /// JVM, summed over every collector, -1 if unavailable
+  std::int64_t gc_count = -1;
+  std::int64_t gc_time_ms = -1;
+  /// Number of polls so far, 0 before the first one
+  std::uint64_t polls = 0;
+  /// steady_clock time of the poll, in nanoseconds
+  std::int64_t timestamp_ns = 0;
+
+  /// Share of the maximum heap in use, of the committed heap if unlimited
+  double usage() const noexcept {
+    auto limit = max > 0 ? max : committed;
+    return limit > 0 ? (double)used / (double)limit : 0;
+  }
+};
+
+enum class heap_pressure {
+  normal,
+  /// Over the soft limit: producers should slow down
+  elevated,
+  /// Over the hard limit or collecting most of the time: try_admit fails
+  critical,
+};
+
+struct heap_limits {
+  std::chrono::milliseconds interval{100};
+  /// Share of the heap over which the pressure is elevated
+  double soft = 0.75;
+  /// Share of the heap over which the pressure is critical
+  double hard = 0.9;
+  /// Share of the time between two polls spent collecting over which the
+  /// pressure is critical
+  double gc_time = 0.5;
+};
+
+namespace detail {
+// Published by the monitor thread, read from anywhere
+class heap_state {
+  // Odd while the monitor writes the fields
+  std::atomic<std::uint64_t> _sequence{0};
+  std::atomic<std::int64_t> _used{0};
+  std::atomic<std::int64_t> _committed{0};
+  std::atomic<std::int64_t> _max{-1};
+  std::atomic<std::int64_t> _gc_count{-1};
+  std::atomic<std::int64_t> _gc_time_ms{-1};
+  std::atomic<std::uint64_t> _polls{0};
+  std::atomic<std::int64_t> _timestamp_ns{0};
+
+public:
+  std::atomic<heap_pressure> pressure{heap_pressure::normal};
+  std::mutex mutex;
+  std::condition_variable admitted;
+  std::function<void(heap_pressure)> on_pressure;
+
+  void publish(const heap_snapshot &s) noexcept {
+    auto sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _used.store(s.used, std::memory_order_relaxed);
+    _committed.store(s.committed, std::memory_order_relaxed);
+    _max.store(s.max, std::memory_order_relaxed);
+    _gc_count.store(s.gc_count, std::memory_order_relaxed);
+    _gc_time_ms.store(s.gc_time_ms, std::memory_order_relaxed);
+    _polls.store(s.polls, std::memory_order_relaxed);
+    _timestamp_ns.store(s.timestamp_ns, std::memory_order_relaxed);
+    _sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  heap_snapshot read() const noexcept {
+    heap_snapshot s;
+    std::uint64_t before, after;
+    do {
+      before = _sequence.load(std::memory_order_acquire);
+      s.used = _used.load(std::memory_order_relaxed);
+      s.committed = _committed.load(std::memory_order_relaxed);
+      s.max = _max.load(std::memory_order_relaxed);
+      s.gc_count = _gc_count.load(std::memory_order_relaxed);
+      s.gc_time_ms = _gc_time_ms.load(std::memory_order_relaxed);
+      s.polls = _polls.load(std::memory_order_relaxed);
+      s.timestamp_ns = _timestamp_ns.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = _sequence.load(std::memory_order_relaxed);
+    } while (before != after || (before & 1) != 0);
+    return s;
+  }
+};
+} // namespace detail
+
+/// Pressure of snapshot given the previous one, see heap_limits. The GC time
+/// is compared to the time measured between the two polls, which is longer
+/// than limits.interval when polls are late.
+inline heap_pressure evaluate(const heap_limits &limits,
+                              const heap_snapshot &previous,
+                              const heap_snapshot &current) noexcept {
+  auto usage = current.usage();
+  auto interval_ms =
+      (double)(current.timestamp_ns - previous.timestamp_ns) / 1e6;
+  if (usage >= limits.hard ||
+      (previous.gc_time_ms >= 0 && interval_ms > 0 &&
+       (double)(current.gc_time_ms - previous.gc_time_ms) / interval_ms >=
+           limits.gc_time)) {
+    return heap_pressure::critical;
+  }
+  return usage >= limits.soft ? heap_pressure::elevated : heap_pressure::normal;
+}
+
+class heap_monitor {
+  struct probes {
+    java_ref<jobject, false> runtime;
+    jmethodID total_memory;
+    jmethodID free_memory;
+    jmethodID max_memory;
+    std::vector<java_ref<jobject, false>> collectors;
+    jmethodID collection_count = nullptr;
+    jmethodID collection_time = nullptr;
+  };
+
+  std::shared_ptr<detail::heap_state> _state;
+  std::shared_ptr<const probes> _probes;
+  // Last member: stopped and joined before the probes are released
+  std::jthread _thread;
+
+  static heap_snapshot _poll(JNIEnv &env, const probes &p,
+                             std::uint64_t polls) noexcept {
+    heap_snapshot s;
+    auto total = detail::call_method_a<long>(env, p.runtime.get(),
+                                             p.total_memory, nullptr);
+    auto free = detail::call_method_a<long>(env, p.runtime.get(),
+                                            p.free_memory, nullptr);
+    auto max = detail::call_method_a<long>(env, p.runtime.get(), p.max_memory,
+                                           nullptr);
+    s.used = total - free;
+    s.committed = total;
+    s.max = max == std::numeric_limits<long>::max() ? -1 : max;
+    if (!p.collectors.empty()) {
+      s.gc_count = 0;
+      s.gc_time_ms = 0;
+      for (auto &collector : p.collectors) {
+        // -1 when a collector doesn't count
+        s.gc_count += std::max<long>(0, detail::call_method_a<long>(
+                                       env, collector.get(),
+                                       p.collection_count, nullptr));
+        s.gc_time_ms += std::max<long>(0, detail::call_method_a<long>(
+                                         env, collector.get(),
+                                         p.collection_time, nullptr));
+      }
+    }
+    env.ExceptionClear();
+    s.polls = polls;
+    s.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    return s;
+  }
+
+  static void _run(std::stop_token stop, JavaVM *vm,
+                   std::shared_ptr<detail::heap_state> state,
+                   std::shared_ptr<const probes> p, heap_limits limits) {
+    auto thread = attached_thread::attach(*vm, "jni-cpp20-heap-monitor", true);
+    if (!thread) {
+      return;
+    }
+    auto &env = thread.value().get_env();
+    heap_snapshot previous;
+    std::mutex sleep_mutex;
+    std::condition_variable_any sleep;
+    for (std::uint64_t polls = 1; !stop.stop_requested(); ++polls) {
+      auto current = _poll(env, *p, polls);
+      state->publish(current);
+      auto pressure = evaluate(limits, previous, current);
+      if (state->pressure.exchange(pressure) != pressure) {
+        if (pressure != heap_pressure::critical) {
+          std::lock_guard lock{state->mutex};
+          state->admitted.notify_all();
+        }
+        if (state->on_pressure) {
+          state->on_pressure(pressure);
+        }
+      }
+      previous = current;
+      std::unique_lock lock{sleep_mutex};
+      sleep.wait_for(lock, stop, limits.interval, [] { return false; });
+    }
+  }
+
+  heap_monitor(std::shared_ptr<detail::heap_state> state,
+               std::shared_ptr<const probes> p, JavaVM *vm,
+               const heap_limits &limits)
+      : _state(std::move(state)), _probes(std::move(p)),
+        _thread([vm, state = _state, p = _probes,
+                 limits](std::stop_token stop) {
+          _run(stop, vm, state, p, limits);
+        }) {}
+
+  // Locals are released before the monitor thread starts
+  static std::shared_ptr<const probes> _resolve(JVM &jvm) {
+    auto runtime_cls = jvm.find_class<java::lang::Runtime>();
+    if (!runtime_cls) {
+      jvm->ExceptionClear();
+      return nullptr;
+    }
+    auto get_runtime = runtime_cls->get_static_method_id<
+        "getRuntime", java::lang::Runtime()>();
+    auto total_memory = runtime_cls->get_method_id<"totalMemory", long()>();
+    auto free_memory = runtime_cls->get_method_id<"freeMemory", long()>();
+    auto max_memory = runtime_cls->get_method_id<"maxMemory", long()>();
+    if (!get_runtime || !total_memory || !free_memory || !max_memory) {
+      jvm->ExceptionClear();
+      return nullptr;
+    }
+    auto runtime = runtime_cls->call(*get_runtime);
+    if (runtime == nullptr) {
+      jvm->ExceptionClear();
+      return nullptr;
+    }
+    auto p = std::make_shared<probes>(probes{runtime.promote(),
+                                             total_memory->id(),
+                                             free_memory->id(),
+                                             max_memory->id(),
+                                             {}});
+
+    using namespace java::lang::management;
+    auto factory = jvm.find_class<ManagementFactory>();
+    auto bean_cls = jvm.find_class<GarbageCollectorMXBean>();
+    auto list_cls = jvm.find_class<java::util::List>();
+    auto get_collectors =
+        factory ? factory->get_static_method_id<"getGarbageCollectorMXBeans",
+                                                java::util::List()>()
+                : std::nullopt;
+    auto to_array =
+        list_cls ? list_cls->get_method_id<
+                       "toArray", java_array_desc<java::lang::Object>()>()
+                 : std::nullopt;
+    auto count =
+        bean_cls ? bean_cls->get_method_id<"getCollectionCount", long()>()
+                 : std::nullopt;
+    auto time =
+        bean_cls ? bean_cls->get_method_id<"getCollectionTime", long()>()
+                 : std::nullopt;
+    if (get_collectors && to_array && count && time) {
+      auto list = factory->call(*get_collectors);
+      auto beans = java_ref<jobjectArray>{
+          list == nullptr ? nullptr
+                          : (jobjectArray)detail::call_method_a<jobject>(
+                                *jvm, list.get(), to_array->id(), nullptr),
+          &*jvm};
+      jsize size = beans == nullptr ? 0 : jvm->GetArrayLength(beans.get());
+      for (jsize i = 0; i < size; ++i) {
+        java_ref<jobject> bean{jvm->GetObjectArrayElement(beans.get(), i),
+                               &*jvm};
+        p->collectors.push_back(bean.promote());
+      }
+      p->collection_count = count->id();
+      p->collection_time = time->id();
+    }
+    jvm->ExceptionClear();
+    return p;
+  }
+
+public:
+  /** @brief Resolves the probes and starts polling every limits.interval.
+   *
+   * @details on_pressure is called on the monitor thread whenever the
+   * pressure level changes. Returns std::nullopt if Runtime can't be
+   * queried. Without java.management the GC figures stay at -1.
+   */
+  static std::optional<heap_monitor>
+  start(JVM &jvm, heap_limits limits = {},
+        std::function<void(heap_pressure)> on_pressure = {}) {
+    auto p = _resolve(jvm);
+    if (p == nullptr) {
+      return std::nullopt;
+    }
+    auto state = std::make_shared<detail::heap_state>();
+    state->on_pressure = std::move(on_pressure);
+    return heap_monitor{std::move(state), std::move(p), jvm.get_vm(), limits};
+  }
+
+  heap_monitor(heap_monitor &&) noexcept = default;
+  heap_monitor &operator=(heap_monitor &&) noexcept = default;
+  heap_monitor(const heap_monitor &) = delete;
+  heap_monitor &operator=(const heap_monitor &) = delete;
+
+  /// Latest figures, without blocking nor calling into the JVM
+  heap_snapshot snapshot() const noexcept { return _state->read(); }
+
+  heap_pressure pressure() const noexcept {
+    return _state->pressure.load(std::memory_order_relaxed);
+  }
+
+  /// False under critical pressure
+  bool try_admit() const noexcept {
+    return pressure() != heap_pressure::critical;
+  }
+
+  /// Waits until the pressure is below critical, false on timeout
+  template <class Rep, class Period>
+  bool wait_admit(std::chrono::duration<Rep, Period> timeout) const {
+    if (try_admit()) {
+      return true;
+    }
+    std::unique_lock lock{_state->mutex};
+    return _state->admitted.wait_for(lock, timeout,
+                                     [this] { return try_admit(); });
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_HEAP_MONITOR_HPP
@@ -0,0 +1,304 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_AGENT_HPP
+#define HEADER_GUARD_DPSG_JAVA_AGENT_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_ref.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+/** C++ agents run inside the JVM by the CodinGame game runner.
+ *
+ * An agent passed to MultiplayerGameRunner.addAgent as a command line is a
+ * process the runner spawns and talks to through pipes. An agent passed as a
+ * class has its main method run in a thread of the runner instead, with
+ * System.in and System.out connected to the referee.
+ *
+ * dpsg.jni.NativeAgent (java/ directory, built into ${JNI_CPP20_JAR}) has
+ * eight such classes, NativeAgent$Slot0 to NativeAgent$Slot7. Their main
+ * method reads what the referee sends into a direct buffer and hands every
+ * batch of complete lines to the C++ agent bound to the slot, in a single
+ * native call (`turn0`, registered once with RegisterNatives). The answer is
+ * written back into a second direct buffer. No process, no string is
+ * created per turn. A match takes a handle to the agent bound to its slot
+ * when it starts (`acquire0`): once the agent is unbound, its matches fail
+ * even if the slot is bound to another agent.
+ *
+ * Agents are callables `void(std::string_view input, std::string &output)`:
+ * input is made of complete lines, normally a whole turn as the referee
+ * writes it at once. Lines appended to output are sent to the referee, an
+ * empty output waits for more input. The agent is called from the thread of
+ * the runner, one turn at a time. C++ exceptions are rethrown in Java as
+ * RuntimeException.
+ *
+ * @code
+ * auto agents = unwrap(agent_host::create(jvm));
+ * auto bot = unwrap(agents.add([state = game_state{}](std::string_view input,
+ *                                                     std::string &output) mutable {
+ *   state.read(input);
+ *   output += state.best_move() + '\n';
+ * }));
+ * runner_cls.call(add_agent, runner, bot.java_class());
+ * @endcode
+ *
+ * The slot classes must be loaded by the loader the natives are registered
+ * with (the application class loader), which is the case for runners that
+ * delegate to their parent loader.
+ */
+
+namespace java::nio {
+using ByteBuffer = java_class_desc<"java/nio/ByteBuffer">;
+} // namespace java::nio
+
+namespace dpsg::jni {
+using NativeAgent = java_class_desc<"dpsg/jni/NativeAgent">;
+} // namespace dpsg::jni
+
+using agent_callback = std::function<void(std::string_view, std::string &)>;
+
+namespace detail {
+struct agent_state {
+  agent_callback callback;
+  // Reused between turns
+  std::string output;
+};
+
+// Agents bound to the slots of NativeAgent. A match takes a handle to its
+// slot when it starts: the slot index in the low half and the generation of
+// the slot in the high half, so that a match outliving its agent can't reach
+// the agent bound to the slot after it.
+class agent_registry {
+public:
+  constexpr static inline std::size_t slot_count = 8;
+
+private:
+  struct slot {
+    std::uint32_t generation = 0;
+    std::shared_ptr<agent_state> state;
+  };
+
+  std::shared_mutex _mutex;
+  std::array<slot, slot_count> _slots;
+
+  static std::uint32_t index_of(jlong handle) noexcept {
+    return (std::uint32_t)((std::uint64_t)handle & 0xFFFFFFFF);
+  }
+  static std::uint32_t generation_of(jlong handle) noexcept {
+    return (std::uint32_t)((std::uint64_t)handle >> 32);
+  }
+  static jlong make_handle(std::uint32_t index, const slot &s) noexcept {
+    return (jlong)(((std::uint64_t)s.generation << 32) | index);
+  }
+
+public:
+  static agent_registry &instance() {
+    static agent_registry registry;
+    return registry;
+  }
+
+  /// Handle of the slot now bound to state, -1 if every slot is taken
+  jlong add(std::shared_ptr<agent_state> state) {
+    std::unique_lock lock{_mutex};
+    for (std::uint32_t i = 0; i < slot_count; ++i) {
+      if (_slots[i].state == nullptr) {
+        _slots[i].state = std::move(state);
+        return make_handle(i, _slots[i]);
+      }
+    }
+    return -1;
+  }
+
+  void remove(jlong handle) {
+    std::unique_lock lock{_mutex};
+    auto index = index_of(handle);
+    if (index >= slot_count ||
+        _slots[index].generation != generation_of(handle)) {
+      return;
+    }
+    _slots[index].state.reset();
+    ++_slots[index].generation;
+  }
+
+  /// Handle of the agent currently bound to slot, -1 if none
+  jlong acquire(jint slot) {
+    if (slot < 0 || (std::size_t)slot >= slot_count) {
+      return -1;
+    }
+    std::shared_lock lock{_mutex};
+    auto &s = _slots[(std::size_t)slot];
+    return s.state == nullptr ? -1 : make_handle((std::uint32_t)slot, s);
+  }
+
+  std::shared_ptr<agent_state> find(jlong handle) {
+    auto index = index_of(handle);
+    if (handle < 0 || index >= slot_count) {
+      return nullptr;
+    }
+    std::shared_lock lock{_mutex};
+    if (_slots[index].generation != generation_of(handle)) {
+      return nullptr;
+    }
+    return _slots[index].state;
+  }
+};
+
+inline jlong JNICALL agent_acquire(JNIEnv *env, jclass, jint slot) {
+  auto handle = agent_registry::instance().acquire(slot);
+  if (handle < 0) {
+    env->ThrowNew(env->FindClass("java/lang/IllegalStateException"),
+                  "no native agent is bound to this slot");
+  }
+  return handle;
+}
+
+inline jint JNICALL agent_turn(JNIEnv *env, jclass, jlong handle,
+                               jobject input, jint length, jobject output) {
+  auto state = agent_registry::instance().find(handle);
+  if (state == nullptr) {
+    env->ThrowNew(env->FindClass("java/lang/IllegalStateException"),
+                  "the native agent of this match was unbound");
+    return 0;
+  }
+  auto in = (const char *)env->GetDirectBufferAddress(input);
+  auto out = (char *)env->GetDirectBufferAddress(output);
+  auto capacity = env->GetDirectBufferCapacity(output);
+  try {
+    state->output.clear();
+    state->callback(std::string_view{in, (std::size_t)length}, state->output);
+  } catch (const std::exception &e) {
+    env->ThrowNew(env->FindClass("java/lang/RuntimeException"), e.what());
+    return 0;
+  } catch (...) {
+    env->ThrowNew(env->FindClass("java/lang/RuntimeException"),
+                  "unknown C++ exception");
+    return 0;
+  }
+  if ((jlong)state->output.size() > capacity) {
+    env->ThrowNew(env->FindClass("java/lang/IllegalStateException"),
+                  "native agent output larger than the output buffer");
+    return 0;
+  }
+  std::memcpy(out, state->output.data(), state->output.size());
+  return (jint)state->output.size();
+}
+} // namespace detail
+
+/// A C++ agent bound to a slot of NativeAgent, unbound on destruction
+class native_agent {
+  jlong _handle = -1;
+  java_ref<jclass, false> _cls;
+
+  native_agent(jlong handle, java_ref<jclass, false> &&cls) noexcept
+      : _handle(handle), _cls(std::move(cls)) {}
+
+  friend class agent_host;
+
+public:
+  native_agent(native_agent &&other) noexcept
+      : _handle(std::exchange(other._handle, -1)),
+        _cls(std::move(other._cls)) {}
+  native_agent &operator=(native_agent &&other) noexcept {
+    if (this != &other) {
+      unbind();
+      _handle = std::exchange(other._handle, -1);
+      _cls = std::move(other._cls);
+    }
+    return *this;
+  }
+  native_agent(const native_agent &) = delete;
+  native_agent &operator=(const native_agent &) = delete;
+  ~native_agent() { unbind(); }
+
+  /// Index of the slot, -1 once unbound
+  int slot() const noexcept {
+    return _handle < 0 ? -1 : (int)(_handle & 0xFFFFFFFF);
+  }
+
+  /// The slot class, to pass to addAgent(Class)
+  const java_ref<jclass, false> &java_class() const noexcept { return _cls; }
+
+  /// Frees the slot. Matches started before keep failing with
+  /// IllegalStateException, even once another agent is bound to the slot.
+  void unbind() noexcept {
+    if (_handle >= 0) {
+      detail::agent_registry::instance().remove(std::exchange(_handle, -1));
+    }
+  }
+};
+
+/// Resolves the slot classes of NativeAgent and binds C++ agents to them
+class agent_host {
+  JNIEnv *_env;
+  std::array<java_ref<jclass, false>, detail::agent_registry::slot_count>
+      _slots;
+
+  agent_host(JNIEnv *env) noexcept : _env(env) {}
+
+public:
+  /// Returns std::nullopt if dpsg.jni.NativeAgent can't be found
+  static std::optional<agent_host> create(JVM &jvm) {
+    auto cls = jvm.find_class<dpsg::jni::NativeAgent>();
+    if (!cls) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    constexpr static auto acquire0_desc = jni_desc<long(int)>::name;
+    constexpr static auto turn0_desc =
+        jni_desc<int(long, java::nio::ByteBuffer, int,
+                     java::nio::ByteBuffer)>::name;
+    JNINativeMethod natives[] = {
+        {const_cast<char *>("acquire0"),
+         const_cast<char *>(acquire0_desc.data),
+         (void *)&detail::agent_acquire},
+        {const_cast<char *>("turn0"), const_cast<char *>(turn0_desc.data),
+         (void *)&detail::agent_turn},
+    };
+    if (jvm->RegisterNatives(cls->get(), natives, 2) != JNI_OK) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    agent_host host{&*jvm};
+    char name[] = "dpsg/jni/NativeAgent$Slot0";
+    for (std::size_t i = 0; i < host._slots.size(); ++i) {
+      name[sizeof(name) - 2] = (char)('0' + i);
+      java_ref<jclass> slot{jvm->FindClass(name), &*jvm};
+      if (slot == nullptr) {
+        jvm->ExceptionClear();
+        return std::nullopt;
+      }
+      host._slots[i] = slot.promote();
+    }
+    return host;
+  }
+
+  /// Binds agent to a free slot, std::nullopt if all of them are taken
+  template <class F> std::optional<native_agent> add(F &&agent) {
+    auto state = std::make_shared<detail::agent_state>();
+    state->callback = std::forward<F>(agent);
+    auto handle = detail::agent_registry::instance().add(std::move(state));
+    if (handle < 0) {
+      return std::nullopt;
+    }
+    auto cls = _slots[(std::size_t)(handle & 0xFFFFFFFF)].get();
+    return native_agent{
+        handle,
+        java_ref<jclass, false>{(jclass)_env->NewGlobalRef(cls), _env}};
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_AGENT_HPP
@@ -0,0 +1,119 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_ARRAY_HPP
+#define HEADER_GUARD_DPSG_JAVA_ARRAY_HPP
+
+#include "java_ref.hpp"
+
+#include <jni.h>
+
+#include <span>
+
+template <class T> struct jni_array_traits;
+
+template <> struct jni_array_traits<jboolean> {
+  using array_type = jbooleanArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewBooleanArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetBooleanArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetBooleanArrayRegion;
+};
+
+template <> struct jni_array_traits<jbyte> {
+  using array_type = jbyteArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewByteArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetByteArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetByteArrayRegion;
+};
+
+template <> struct jni_array_traits<jchar> {
+  using array_type = jcharArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewCharArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetCharArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetCharArrayRegion;
+};
+
+template <> struct jni_array_traits<jshort> {
+  using array_type = jshortArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewShortArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetShortArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetShortArrayRegion;
+};
+
+template <> struct jni_array_traits<jint> {
+  using array_type = jintArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewIntArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetIntArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetIntArrayRegion;
+};
+
+template <> struct jni_array_traits<jlong> {
+  using array_type = jlongArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewLongArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetLongArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetLongArrayRegion;
+};
+
+template <> struct jni_array_traits<jfloat> {
+  using array_type = jfloatArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewFloatArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetFloatArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetFloatArrayRegion;
+};
+
+template <> struct jni_array_traits<jdouble> {
+  using array_type = jdoubleArray;
+  static constexpr inline auto new_array = &JNIEnv_::NewDoubleArray;
+  static constexpr inline auto get_region = &JNIEnv_::GetDoubleArrayRegion;
+  static constexpr inline auto set_region = &JNIEnv_::SetDoubleArrayRegion;
+};
+
+template <class T>
+concept jni_primitive_element = requires { typename jni_array_traits<T>::array_type; };
+
+/// Maps the element type used in a prototype (e.g. the `int` in `int[]`) to
+/// the JNI type stored in the Java array.
+template <class T> struct jni_array_element { using type = T; };
+template <> struct jni_array_element<bool> { using type = jboolean; };
+template <> struct jni_array_element<char> { using type = jchar; };
+
+template <class T>
+using jni_array_element_t = typename jni_array_element<T>::type;
+
+template <jni_primitive_element T, bool Local = true>
+class java_array
+    : public java_ref<typename jni_array_traits<T>::array_type, Local> {
+  using traits = jni_array_traits<T>;
+  using base = java_ref<typename traits::array_type, Local>;
+
+public:
+  using value_type = T;
+  using pointer = typename traits::array_type;
+
+  using base::env;
+  using base::get;
+  using base::get_env;
+
+  constexpr java_array() noexcept = default;
+  constexpr java_array(pointer arr, JNIEnv *env) noexcept : base{arr, env} {}
+  constexpr java_array(java_array &&) noexcept = default;
+  constexpr java_array &operator=(java_array &&) noexcept = default;
+  constexpr java_array(const java_array &) noexcept = delete;
+  constexpr java_array &operator=(const java_array &) noexcept = delete;
+
+  jsize size() const noexcept { return env().GetArrayLength(get()); }
+
+  /// Copies `out.size()` elements starting at `start` into `out`
+  void get_region(jsize start, std::span<T> out) const noexcept {
+    (env().*traits::get_region)(get(), start, (jsize)out.size(), out.data());
+  }
+
+  /// Copies the content of `in` into the array, starting at `start`
+  void set_region(jsize start, std::span<const T> in) const noexcept {
+    (env().*traits::set_region)(get(), start, (jsize)in.size(), in.data());
+  }
+};
+
+template <jni_primitive_element T>
+java_array<T> make_java_array(JNIEnv &env, jsize size) noexcept {
+  return java_array<T>{(env.*jni_array_traits<T>::new_array)(size), &env};
+}
+
+#endif // HEADER_GUARD_DPSG_JAVA_ARRAY_HPP
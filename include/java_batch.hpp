@@ -0,0 +1,229 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_BATCH_HPP
+#define HEADER_GUARD_DPSG_JAVA_BATCH_HPP
+
+#include "java_class.hpp"
+#include "java_method.hpp"
+#include "java_ref.hpp"
+#include "jni_call.hpp"
+#include "jni_convert.hpp"
+
+#include <jni.h>
+
+#include <cstddef>
+#include <optional>
+#include <ranges>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/** Construction of arrays of Java objects from ranges of C++ values.
+ *
+ * The elements of the range are tuple-like (std::tuple, std::pair,
+ * std::array) or aggregates of at most 8 members, none of them an aggregate
+ * itself. Their members are, in order, either:
+ *  + the arguments of a constructor (construct_all): every object is built
+ *    with NewObjectA from a jvalue array packed on the stack;
+ *  + the values of a list of fields (allocate_all): every object is
+ *    allocated with AllocObject, without running any constructor, and its
+ *    fields are stored directly. Only suitable for plain data classes whose
+ *    constructors do nothing else.
+ *
+ * Members are converted as the arguments of a call (see jni_convert.hpp).
+ * Every reference is created in one local frame, popped before returning:
+ * only the array survives, as a java_object_array of the class that can be
+ * passed to methods expecting an array of the class.
+ *
+ * @code
+ * struct move { int from, to; };
+ * std::vector<move> moves = ...;
+ * auto ctor = unwrap(move_cls.get_constructor_id<int, int>());
+ * auto array = unwrap(construct_all(move_cls, ctor, moves));
+ * engine_cls.call(play_all, engine, array);
+ * @endcode
+ */
+
+namespace detail {
+// Converts to anything, to count the members of aggregates
+struct any_member {
+  template <class T> operator T() const;
+};
+
+template <class S, std::size_t... Is>
+constexpr bool brace_constructible(std::index_sequence<Is...>) noexcept {
+  return requires { S{(Is, any_member{})...}; };
+}
+
+template <class S> constexpr std::size_t member_count() noexcept {
+  std::size_t count = 0;
+  [&]<std::size_t... Ns>(std::index_sequence<Ns...>) {
+    ((brace_constructible<S>(std::make_index_sequence<Ns + 1>{})
+          ? (count = Ns + 1)
+          : 0),
+     ...);
+  }(std::make_index_sequence<8>{});
+  return count;
+}
+
+template <class S>
+concept tuple_like = requires { std::tuple_size<S>::value; };
+
+// References to the members of an aggregate, in declaration order
+template <class S> constexpr auto tie_members(const S &s) noexcept {
+  constexpr auto n = member_count<S>();
+  static_assert(n > 0, "unsupported element type");
+  if constexpr (n == 1) {
+    auto &[a] = s;
+    return std::tie(a);
+  } else if constexpr (n == 2) {
+    auto &[a, b] = s;
+    return std::tie(a, b);
+  } else if constexpr (n == 3) {
+    auto &[a, b, c] = s;
+    return std::tie(a, b, c);
+  } else if constexpr (n == 4) {
+    auto &[a, b, c, d] = s;
+    return std::tie(a, b, c, d);
+  } else if constexpr (n == 5) {
+    auto &[a, b, c, d, e] = s;
+    return std::tie(a, b, c, d, e);
+  } else if constexpr (n == 6) {
+    auto &[a, b, c, d, e, f] = s;
+    return std::tie(a, b, c, d, e, f);
+  } else if constexpr (n == 7) {
+    auto &[a, b, c, d, e, f, g] = s;
+    return std::tie(a, b, c, d, e, f, g);
+  } else {
+    auto &[a, b, c, d, e, f, g, h] = s;
+    return std::tie(a, b, c, d, e, f, g, h);
+  }
+}
+
+/// Calls f with the members of value
+template <class F, class S>
+decltype(auto) apply_members(F &&f, const S &value) {
+  if constexpr (tuple_like<S>) {
+    return std::apply(std::forward<F>(f), value);
+  } else {
+    return std::apply(std::forward<F>(f), tie_members(value));
+  }
+}
+
+// Returns false if the conversion of value threw (e.g. NewStringUTF)
+template <class T, class Arg>
+bool store_field(JNIEnv &env, jobject obj, jfieldID id, const Arg &value) {
+  auto converted =
+      jni_arg_converter<std::remove_cvref_t<T>, std::remove_cvref_t<Arg>>::
+          convert(env, value);
+  if (env.ExceptionCheck()) {
+    return false;
+  }
+  set_field<T>(env, obj, id, converted.get());
+  return true;
+}
+
+// Fills a new array of cls with one object per element of values, made by
+// make(element). Returns nullptr on failure.
+template <class R, class Make>
+jobjectArray fill_object_array(JNIEnv &env, jclass cls, const R &values,
+                               Make &&make) {
+  // The array, the current object, and the references created by the
+  // conversions, released after each object
+  if (env.PushLocalFrame(16) != JNI_OK) {
+    return nullptr;
+  }
+  auto array =
+      env.NewObjectArray((jsize)std::ranges::size(values), cls, nullptr);
+  if (array == nullptr) {
+    env.PopLocalFrame(nullptr);
+    return nullptr;
+  }
+  jsize i = 0;
+  for (const auto &value : values) {
+    jobject obj = make(value);
+    if (obj == nullptr) {
+      env.PopLocalFrame(nullptr);
+      return nullptr;
+    }
+    env.SetObjectArrayElement(array, i++, obj);
+    env.DeleteLocalRef(obj);
+  }
+  return (jobjectArray)env.PopLocalFrame(array);
+}
+} // namespace detail
+
+/** @brief Builds one object per element of values with the constructor ctor.
+ *
+ * @return A local reference to the array, std::nullopt if a constructor threw
+ * or the allocation failed (the exception is left pending).
+ */
+template <meta::fixed_string ClassName, bool L, class... Params,
+          std::ranges::sized_range R>
+std::optional<java_object_array<ClassName>>
+construct_all(const java_class<ClassName, L> &cls,
+              const java_constructor<ClassName, Params...> &ctor,
+              const R &values, ref_site site = ref_site::current()) {
+  auto &env = cls.env();
+  auto array = detail::fill_object_array(
+      env, cls.get(), values, [&](const auto &value) {
+        return detail::apply_members(
+            [&](const auto &...args) {
+              return jni_invoker<void(Params...)>::invoke_a(
+                  env,
+                  [&](const jvalue *packed) {
+                    return env.NewObjectA(cls.get(), ctor.id(), packed);
+                  },
+                  args...);
+            },
+            value);
+      });
+  if (array == nullptr) {
+    return std::nullopt;
+  }
+  return java_object_array<ClassName>{array, &env, site};
+}
+
+/** @brief Allocates one object per element of values without calling any
+ * constructor, and stores the members of the element in fields.
+ *
+ * @details The fields are grouped in a tuple, e.g. `std::tuple{from, to}`,
+ * so that the call site can still be recorded.
+ *
+ * @return A local reference to the array, std::nullopt if the allocation or
+ * the conversion of a member failed (the exception is left pending).
+ */
+template <meta::fixed_string ClassName, bool L, std::ranges::sized_range R,
+          class... Fields>
+std::optional<java_object_array<ClassName>>
+allocate_all(const java_class<ClassName, L> &cls, const R &values,
+             const std::tuple<java_field<ClassName, Fields>...> &fields,
+             ref_site site = ref_site::current()) {
+  auto &env = cls.env();
+  auto array = detail::fill_object_array(
+      env, cls.get(), values, [&](const auto &value) {
+        jobject obj = env.AllocObject(cls.get());
+        if (obj == nullptr) {
+          return obj;
+        }
+        bool stored = detail::apply_members(
+            [&](const auto &...members) {
+              static_assert(sizeof...(members) == sizeof...(Fields),
+                            "one field per member is required");
+              return std::apply(
+                  [&](const auto &...field) {
+                    // Stops at the first conversion that threw
+                    return (detail::store_field<Fields>(env, obj, field.id(),
+                                                        members) &&
+                            ...);
+                  },
+                  fields);
+            },
+            value);
+        return stored ? obj : nullptr;
+      });
+  if (array == nullptr) {
+    return std::nullopt;
+  }
+  return java_object_array<ClassName>{array, &env, site};
+}
+
+#endif // HEADER_GUARD_DPSG_JAVA_BATCH_HPP
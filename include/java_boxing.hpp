@@ -0,0 +1,196 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_BOXING_HPP
+#define HEADER_GUARD_DPSG_JAVA_BOXING_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_object.hpp"
+#include "java_ref.hpp"
+#include "jni_call.hpp"
+#include "jvm.hpp"
+#include "meta/is_one_of.hpp"
+
+#include <jni.h>
+
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+/** Boxing and unboxing of Java primitive wrappers.
+ *
+ * A boxing object resolves, once, global references to the eight wrapper
+ * classes along with their `valueOf` and `<type>Value` methods. Boxing goes
+ * through `valueOf`, which returns the instances cached by Java for small
+ * values (Boolean.TRUE/FALSE, Integer from -128 to 127...) instead of
+ * allocating.
+ *
+ * unbox_all unboxes a whole Object[] (e.g. the result of List.toArray())
+ * into a std::vector within a single local frame.
+ *
+ * @code
+ * auto boxes = unwrap(boxing::create(jvm));
+ * auto scores = unwrap(boxes.unbox_all<double>(*jvm, values_array));
+ * map_cls.call(put, map, key, unwrap(boxes.box(*jvm, 42)));
+ * @endcode
+ *
+ * The class references are bound to the JNIEnv of the thread that created
+ * the boxing object, the method IDs are usable from any thread.
+ */
+
+namespace java {
+namespace lang {
+using Boolean = java_class_desc<"java/lang/Boolean">;
+using Byte = java_class_desc<"java/lang/Byte">;
+using Character = java_class_desc<"java/lang/Character">;
+using Short = java_class_desc<"java/lang/Short">;
+using Integer = java_class_desc<"java/lang/Integer">;
+using Long = java_class_desc<"java/lang/Long">;
+using Float = java_class_desc<"java/lang/Float">;
+using Double = java_class_desc<"java/lang/Double">;
+} // namespace lang
+} // namespace java
+
+template <class T>
+concept boxable = dpsg::meta::is_one_of_v<T, bool, signed char, char, short,
+                                          int, long, float, double>;
+
+namespace detail {
+template <class T> struct box_traits;
+
+#define JNI_CPP20_BOX_TRAITS(type, index, wrapper_class, method)               \
+  template <> struct box_traits<type> {                                        \
+    using wrapper = java::lang::wrapper_class;                                 \
+    constexpr static inline std::size_t slot = index;                          \
+    constexpr static inline meta::fixed_string value_method = method;          \
+  };
+JNI_CPP20_BOX_TRAITS(bool, 0, Boolean, "booleanValue")
+JNI_CPP20_BOX_TRAITS(signed char, 1, Byte, "byteValue")
+JNI_CPP20_BOX_TRAITS(char, 2, Character, "charValue")
+JNI_CPP20_BOX_TRAITS(short, 3, Short, "shortValue")
+JNI_CPP20_BOX_TRAITS(int, 4, Integer, "intValue")
+JNI_CPP20_BOX_TRAITS(long, 5, Long, "longValue")
+JNI_CPP20_BOX_TRAITS(float, 6, Float, "floatValue")
+JNI_CPP20_BOX_TRAITS(double, 7, Double, "doubleValue")
+#undef JNI_CPP20_BOX_TRAITS
+} // namespace detail
+
+/// Wrapper class of T (e.g. java::lang::Integer for int)
+template <boxable T> using box_class = typename detail::box_traits<T>::wrapper;
+
+class boxing {
+  struct entry {
+    java_ref<jclass, false> cls;
+    jmethodID value_of = nullptr;
+    jmethodID value = nullptr;
+  };
+
+  std::array<entry, 8> _entries;
+
+  boxing() noexcept = default;
+
+  template <boxable T> static bool _resolve(JVM &jvm, entry &e) {
+    using traits = detail::box_traits<T>;
+    auto cls = jvm.find_class<typename traits::wrapper>();
+    if (!cls) {
+      return false;
+    }
+    auto value_of = cls->template get_static_method_id<
+        "valueOf", typename traits::wrapper(T)>();
+    auto value = cls->template get_method_id<traits::value_method, T()>();
+    if (!value_of || !value) {
+      return false;
+    }
+    e.cls = java_ref<jclass, false>{(jclass)jvm->NewGlobalRef(cls->get()),
+                                    &*jvm};
+    e.value_of = value_of->id();
+    e.value = value->id();
+    return true;
+  }
+
+  template <boxable T> const entry &_entry() const noexcept {
+    return _entries[detail::box_traits<T>::slot];
+  }
+
+public:
+  /// Resolves every wrapper class, std::nullopt if one couldn't be found
+  static std::optional<boxing> create(JVM &jvm) {
+    boxing result;
+    auto &e = result._entries;
+    if (!(_resolve<bool>(jvm, e[0]) && _resolve<signed char>(jvm, e[1]) &&
+          _resolve<char>(jvm, e[2]) && _resolve<short>(jvm, e[3]) &&
+          _resolve<int>(jvm, e[4]) && _resolve<long>(jvm, e[5]) &&
+          _resolve<float>(jvm, e[6]) && _resolve<double>(jvm, e[7]))) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    return result;
+  }
+
+  /// Wrapper of value, std::nullopt (with an exception pending) if it
+  /// couldn't be allocated
+  template <boxable T>
+  std::optional<java_object<box_class<T>::name>>
+  box(JNIEnv &env, T value, ref_site site = ref_site::current()) const {
+    auto &e = _entry<T>();
+    jvalue arg = detail::to_jvalue<T>(value);
+    jobject boxed =
+        detail::call_static_method_a<jobject>(env, e.cls.get(), e.value_of, &arg);
+    if (boxed == nullptr) {
+      return std::nullopt;
+    }
+    return java_object<box_class<T>::name>{boxed, &env, site};
+  }
+
+  /// Value of obj, std::nullopt if obj is null or isn't an instance of
+  /// box_class<T>
+  template <boxable T>
+  std::optional<T> unbox(JNIEnv &env, jobject obj) const noexcept {
+    auto &e = _entry<T>();
+    if (obj == nullptr || !env.IsInstanceOf(obj, e.cls.get())) {
+      return std::nullopt;
+    }
+    return detail::call_method_a<T>(env, obj, e.value, nullptr);
+  }
+
+  template <boxable T, bool L>
+  std::optional<T> unbox(const java_ref<jobject, L> &obj) const noexcept {
+    return unbox<T>(obj.env(), obj.get());
+  }
+
+  /** @brief Unboxes every element of array.
+   *
+   * @details Returns std::nullopt if an element is null or isn't an instance
+   * of box_class<T>. Every element reference is created in a single local
+   * frame, popped before returning.
+   */
+  template <boxable T>
+  std::optional<std::vector<T>> unbox_all(JNIEnv &env,
+                                          jobjectArray array) const {
+    auto &e = _entry<T>();
+    auto size = env.GetArrayLength(array);
+    std::vector<T> values;
+    values.reserve((std::size_t)size);
+    if (env.PushLocalFrame(2) != JNI_OK) {
+      return std::nullopt;
+    }
+    for (jsize i = 0; i < size; ++i) {
+      jobject element = env.GetObjectArrayElement(array, i);
+      if (element == nullptr || !env.IsInstanceOf(element, e.cls.get())) {
+        env.PopLocalFrame(nullptr);
+        return std::nullopt;
+      }
+      values.push_back(detail::call_method_a<T>(env, element, e.value, nullptr));
+      env.DeleteLocalRef(element);
+    }
+    env.PopLocalFrame(nullptr);
+    return values;
+  }
+
+  template <boxable T, bool L>
+  std::optional<std::vector<T>>
+  unbox_all(const java_ref<jobjectArray, L> &array) const {
+    return unbox_all<T>(array.env(), array.get());
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_BOXING_HPP
@@ -0,0 +1,299 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_BULK_HPP
+#define HEADER_GUARD_DPSG_JAVA_BULK_HPP
+
+#include "bulk_kernels.hpp"
+#include "java_array.hpp"
+
+#include <jni.h>
+
+#include <cstddef>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Bulk transfers between C++ containers and Java primitive arrays.
+ *
+ * The Java arrays are mapped with GetPrimitiveArrayCritical and the
+ * conversion kernels of bulk_kernels.hpp read or write them directly, so
+ * there is no intermediate buffer on either side:
+ *  + scatter/gather convert between an array of structures on the C++ side
+ *    and one Java array per field (structure of arrays). Structures made of
+ *    2 or 3 packed 32-bit fields use the SIMD kernels, other layouts a
+ *    single scalar pass;
+ *  + copy_to_java/copy_from_java convert between element types with the
+ *    semantic of Java casts (int to short, double to float, bool to
+ *    jboolean...).
+ *
+ * No JNI function is called while the arrays are mapped: the lengths are
+ * read before, and the mappings are released before returning.
+ *
+ * @code
+ * struct point { float x, y, z; };
+ * std::vector<point> points = ...;
+ * auto xs = make_java_array<jfloat>(env, n), ys = ..., zs = ...;
+ * scatter(std::span{points}, field(&point::x, xs), field(&point::y, ys),
+ *         field(&point::z, zs));
+ * @endcode
+ */
+
+enum class critical_access {
+  /// Changes are copied back to the Java array
+  read_write,
+  /// Changes are discarded (JNI_ABORT)
+  read_only,
+};
+
+/// RAII mapping of a Java primitive array obtained with
+/// GetPrimitiveArrayCritical. No other JNI function may be called while it
+/// is alive.
+template <jni_primitive_element T> class critical_array {
+  JNIEnv *_env;
+  jarray _array;
+  T *_data;
+  std::size_t _size;
+  jint _mode;
+
+public:
+  /// size must be the length of the array, read before entering any critical
+  /// region
+  template <bool L>
+  critical_array(const java_array<T, L> &array, jsize size,
+                 critical_access access = critical_access::read_write) noexcept
+      : _env(array.get_env()), _array(array.get()),
+        _data((T *)_env->GetPrimitiveArrayCritical(_array, nullptr)),
+        _size(_data == nullptr ? 0 : (std::size_t)size),
+        _mode(access == critical_access::read_only ? JNI_ABORT : 0) {}
+
+  template <bool L>
+  explicit critical_array(
+      const java_array<T, L> &array,
+      critical_access access = critical_access::read_write) noexcept
+      : critical_array(array, array.size(), access) {}
+
+  critical_array(critical_array &&other) noexcept
+      : _env(other._env), _array(other._array),
+        _data(std::exchange(other._data, nullptr)),
+        _size(std::exchange(other._size, 0)), _mode(other._mode) {}
+  critical_array(const critical_array &) = delete;
+  critical_array &operator=(const critical_array &) = delete;
+  critical_array &operator=(critical_array &&) = delete;
+
+  ~critical_array() {
+    if (_data != nullptr) {
+      _env->ReleasePrimitiveArrayCritical(_array, _data, _mode);
+    }
+  }
+
+  explicit operator bool() const noexcept { return _data != nullptr; }
+  T *data() const noexcept { return _data; }
+  std::size_t size() const noexcept { return _size; }
+  std::span<T> span() const noexcept { return {_data, _size}; }
+};
+
+/// A field of S stored in (or read from) a Java array
+template <class S, class F, bool L> struct field_binding {
+  using field_type = F;
+
+  F S::*member;
+  const java_array<F, L> *array;
+};
+
+template <class S, class F, bool L>
+field_binding<S, F, L> field(F S::*member, const java_array<F, L> &array) {
+  return {member, &array};
+}
+
+namespace detail {
+template <class T> struct is_field_binding : std::false_type {};
+template <class S, class F, bool L>
+struct is_field_binding<field_binding<S, F, L>> : std::true_type {};
+
+template <class S, class... Fs, bool... Ls>
+constexpr bool packed_words(
+    std::type_identity<S>,
+    std::type_identity<field_binding<S, Fs, Ls>>...) noexcept {
+  using first = std::tuple_element_t<0, std::tuple<Fs...>>;
+  return (sizeof...(Fs) == 2 || sizeof...(Fs) == 3) &&
+         (std::is_same_v<Fs, first> && ...) && kernels::word32<first> &&
+         sizeof(S) == sizeof...(Fs) * 4;
+}
+
+// True if the fields are laid out in order, at offsets 0, 4 (and 8)
+template <class S, class... Bindings>
+bool in_order(const S &sample, const Bindings &...fields) noexcept {
+  std::size_t expected = 0;
+  auto base = reinterpret_cast<const char *>(&sample);
+  return (((reinterpret_cast<const char *>(&(sample.*fields.member)) - base ==
+            (std::ptrdiff_t)expected) &&
+           (expected += 4, true)) &&
+          ...);
+}
+
+template <class... Bindings>
+bool lengths_at_least(std::size_t count, const Bindings &...fields) noexcept {
+  return ((fields.array->size() >= (jsize)count) && ...);
+}
+} // namespace detail
+
+/** @brief Copies every field of src to its Java array (AoS to SoA).
+ *
+ * @return false if an array is shorter than src or couldn't be mapped
+ */
+template <class S, class... Bindings>
+  requires(sizeof...(Bindings) > 0 &&
+           (detail::is_field_binding<Bindings>::value && ...))
+bool scatter(std::span<const S> src, const Bindings &...fields) {
+  auto count = src.size();
+  if (count == 0) {
+    return true;
+  }
+  if (!detail::lengths_at_least(count, fields...)) {
+    return false;
+  }
+  std::tuple<critical_array<typename Bindings::field_type>...> mapped{
+      critical_array<typename Bindings::field_type>{*fields.array,
+                                                    (jsize)count}...};
+  if (!std::apply([](auto &...m) { return ((bool)m && ...); }, mapped)) {
+    return false;
+  }
+
+  if constexpr (detail::packed_words(std::type_identity<S>{},
+                                     std::type_identity<Bindings>{}...)) {
+    if (detail::in_order(src[0], fields...)) {
+      using word = typename std::tuple_element_t<
+          0, std::tuple<Bindings...>>::field_type;
+      auto words = reinterpret_cast<const word *>(src.data());
+      std::apply(
+          [&](auto &...m) {
+            detail::kernels::deinterleave(words, count, m.data()...);
+          },
+          mapped);
+      return true;
+    }
+  }
+  std::apply(
+      [&](auto &...m) {
+        for (std::size_t i = 0; i < count; ++i) {
+          ((m.data()[i] = src[i].*fields.member), ...);
+        }
+      },
+      mapped);
+  return true;
+}
+
+/** @brief Fills dst from one Java array per field (SoA to AoS).
+ *
+ * @return false if an array is shorter than dst or couldn't be mapped
+ */
+template <class S, class... Bindings>
+  requires(sizeof...(Bindings) > 0 &&
+           (detail::is_field_binding<Bindings>::value && ...))
+bool gather(std::span<S> dst, const Bindings &...fields) {
+  auto count = dst.size();
+  if (count == 0) {
+    return true;
+  }
+  if (!detail::lengths_at_least(count, fields...)) {
+    return false;
+  }
+  std::tuple<critical_array<typename Bindings::field_type>...> mapped{
+      critical_array<typename Bindings::field_type>{*fields.array,
+                                                    (jsize)count, critical_access::read_only}...};
+  if (!std::apply([](auto &...m) { return ((bool)m && ...); }, mapped)) {
+    return false;
+  }
+
+  if constexpr (detail::packed_words(std::type_identity<S>{},
+                                     std::type_identity<Bindings>{}...)) {
+    if (detail::in_order(dst[0], fields...)) {
+      using word = typename std::tuple_element_t<
+          0, std::tuple<Bindings...>>::field_type;
+      auto words = reinterpret_cast<word *>(dst.data());
+      std::apply(
+          [&](auto &...m) {
+            detail::kernels::interleave(
+                const_cast<const word *>(m.data())..., count, words);
+          },
+          mapped);
+      return true;
+    }
+  }
+  std::apply(
+      [&](auto &...m) {
+        for (std::size_t i = 0; i < count; ++i) {
+          ((dst[i].*fields.member = m.data()[i]), ...);
+        }
+      },
+      mapped);
+  return true;
+}
+
+/** @brief Converts src into the first src.size() elements of dst.
+ *
+ * @return false if dst is too short or couldn't be mapped
+ */
+template <class From, jni_primitive_element To, bool L>
+  requires std::is_arithmetic_v<From>
+bool copy_to_java(std::span<const From> src, const java_array<To, L> &dst) {
+  if (src.empty()) {
+    return true;
+  }
+  auto size = dst.size();
+  if ((std::size_t)size < src.size()) {
+    return false;
+  }
+  critical_array<To> mapped{dst, size};
+  if (!mapped) {
+    return false;
+  }
+  detail::kernels::convert(src.data(), src.size(), mapped.data());
+  return true;
+}
+
+/// std::vector<bool> is bit packed, it is unpacked one element at a time
+template <bool L>
+bool copy_to_java(const std::vector<bool> &src,
+                  const java_array<jboolean, L> &dst) {
+  if (src.empty()) {
+    return true;
+  }
+  auto size = dst.size();
+  if ((std::size_t)size < src.size()) {
+    return false;
+  }
+  critical_array<jboolean> mapped{dst, size};
+  if (!mapped) {
+    return false;
+  }
+  for (std::size_t i = 0; i < src.size(); ++i) {
+    mapped.data()[i] = src[i] ? JNI_TRUE : JNI_FALSE;
+  }
+  return true;
+}
+
+/** @brief Converts the first dst.size() elements of src into dst.
+ *
+ * @return false if src is too short or couldn't be mapped
+ */
+template <jni_primitive_element From, class To, bool L>
+  requires std::is_arithmetic_v<To>
+bool copy_from_java(const java_array<From, L> &src, std::span<To> dst) {
+  if (dst.empty()) {
+    return true;
+  }
+  auto size = src.size();
+  if ((std::size_t)size < dst.size()) {
+    return false;
+  }
+  critical_array<From> mapped{src, size, critical_access::read_only};
+  if (!mapped) {
+    return false;
+  }
+  detail::kernels::convert(const_cast<const From *>(mapped.data()), dst.size(),
+                           dst.data());
+  return true;
+}
+
+#endif // HEADER_GUARD_DPSG_JAVA_BULK_HPP
@@ -0,0 +1,276 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_CHUNKS_HPP
+#define HEADER_GUARD_DPSG_JAVA_CHUNKS_HPP
+
+#include "java_array.hpp"
+#include "java_object.hpp"
+
+#include <jni.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/** Single-pass ranges pulling large Java strings and primitive arrays in
+ * fixed-size chunks.
+ *
+ * Every chunk is copied with `Get<Type>ArrayRegion`/`GetStringRegion` into a
+ * buffer owned by the range and reused for the next chunk, so the memory used
+ * on the C++ side is bounded by the chunk size regardless of the size of the
+ * Java payload. Strings are transcoded incrementally from UTF-16 to UTF-8,
+ * surrogate pairs split across two chunks are carried over to the next one.
+ *
+ * @code
+ * auto json = runner_cls.call(get_json_result, runner);
+ * for (std::string_view part : java_string_chunks{json}) {
+ *   parser.feed(part);
+ * }
+ * write_utf8(std::cout, json);
+ * @endcode
+ */
+
+namespace detail {
+template <class Range> class chunk_iterator {
+  Range *_range = nullptr;
+
+public:
+  using value_type = typename Range::value_type;
+  using difference_type = std::ptrdiff_t;
+
+  chunk_iterator() noexcept = default;
+  explicit chunk_iterator(Range &range) noexcept : _range(&range) {}
+
+  value_type operator*() const noexcept { return _range->current(); }
+
+  chunk_iterator &operator++() {
+    _range->advance();
+    return *this;
+  }
+  void operator++(int) { ++*this; }
+
+  friend bool operator==(const chunk_iterator &it,
+                         std::default_sentinel_t) noexcept {
+    return it._done();
+  }
+
+private:
+  bool _done() const noexcept { return _range->done(); }
+};
+
+// Appends the UTF-8 encoding of the code point cp to out.
+inline char *encode_utf8(char32_t cp, char *out) noexcept {
+  if (cp < 0x80) {
+    *out++ = (char)cp;
+  } else if (cp < 0x800) {
+    *out++ = (char)(0xC0 | (cp >> 6));
+    *out++ = (char)(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    *out++ = (char)(0xE0 | (cp >> 12));
+    *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (cp & 0x3F));
+  } else {
+    *out++ = (char)(0xF0 | (cp >> 18));
+    *out++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+    *out++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+    *out++ = (char)(0x80 | (cp & 0x3F));
+  }
+  return out;
+}
+
+inline constexpr char32_t replacement_character = 0xFFFD;
+inline constexpr bool is_high_surrogate(jchar c) noexcept {
+  return c >= 0xD800 && c <= 0xDBFF;
+}
+inline constexpr bool is_low_surrogate(jchar c) noexcept {
+  return c >= 0xDC00 && c <= 0xDFFF;
+}
+} // namespace detail
+
+inline constexpr jsize default_chunk_size = 4096;
+
+template <bool Local = true> class java_string_chunks {
+  JNIEnv *_env;
+  jstring _str;
+  jsize _length;
+  jsize _position = 0;
+  jchar _pending = 0; // high surrogate left at the end of the previous chunk
+  bool _done = false;
+  bool _started = false;
+  std::vector<jchar> _utf16;
+  std::string _utf8;
+
+  friend class detail::chunk_iterator<java_string_chunks>;
+
+  std::string_view current() const noexcept { return _utf8; }
+  bool done() const noexcept { return _done; }
+
+  void advance() {
+    _utf8.clear();
+    while (_utf8.empty()) {
+      if (_position >= _length) {
+        if (_pending != 0) {
+          _utf8.resize(3);
+          _utf8.resize(detail::encode_utf8(detail::replacement_character,
+                                           _utf8.data()) -
+                       _utf8.data());
+          _pending = 0;
+          return;
+        }
+        _done = true;
+        return;
+      }
+      auto count = std::min<jsize>(_length - _position, (jsize)_utf16.size());
+      _env->GetStringRegion(_str, _position, count, _utf16.data());
+      _position += count;
+      _transcode(count);
+    }
+  }
+
+  void _transcode(jsize count) {
+    // Worst case: every jchar becomes 3 bytes, plus a carried surrogate pair
+    _utf8.resize((size_t)count * 3 + 4);
+    char *out = _utf8.data();
+    jsize i = 0;
+    if (_pending != 0) {
+      if (detail::is_low_surrogate(_utf16[0])) {
+        out = detail::encode_utf8(
+            0x10000 + (((char32_t)_pending - 0xD800) << 10) +
+                ((char32_t)_utf16[0] - 0xDC00),
+            out);
+        i = 1;
+      } else {
+        out = detail::encode_utf8(detail::replacement_character, out);
+      }
+      _pending = 0;
+    }
+    for (; i < count; ++i) {
+      jchar c = _utf16[i];
+      if (detail::is_high_surrogate(c)) {
+        if (i + 1 == count) {
+          _pending = c;
+          break;
+        }
+        if (detail::is_low_surrogate(_utf16[i + 1])) {
+          out = detail::encode_utf8(0x10000 + (((char32_t)c - 0xD800) << 10) +
+                                        ((char32_t)_utf16[i + 1] - 0xDC00),
+                                    out);
+          ++i;
+          continue;
+        }
+        out = detail::encode_utf8(detail::replacement_character, out);
+      } else if (detail::is_low_surrogate(c)) {
+        out = detail::encode_utf8(detail::replacement_character, out);
+      } else {
+        out = detail::encode_utf8(c, out);
+      }
+    }
+    _utf8.resize(out - _utf8.data());
+  }
+
+public:
+  using value_type = std::string_view;
+  using iterator = detail::chunk_iterator<java_string_chunks>;
+
+  explicit java_string_chunks(const java_string<Local> &str,
+                              jsize chunk_size = default_chunk_size)
+      : _env(str.get_env()), _str(str.get()),
+        _length(str.env().GetStringLength(str.get())),
+        _utf16((size_t)std::max<jsize>(chunk_size, 1)) {
+    _utf8.reserve(_utf16.size() * 3 + 4);
+  }
+
+  java_string_chunks(const java_string_chunks &) = delete;
+  java_string_chunks &operator=(const java_string_chunks &) = delete;
+
+  /// Single pass: the first call reads the first chunk, subsequent calls
+  /// resume from the current position.
+  iterator begin() {
+    if (!_started) {
+      _started = true;
+      advance();
+    }
+    return iterator{*this};
+  }
+  std::default_sentinel_t end() const noexcept { return {}; }
+};
+
+template <bool L>
+java_string_chunks(const java_string<L> &) -> java_string_chunks<L>;
+template <bool L>
+java_string_chunks(const java_string<L> &, jsize) -> java_string_chunks<L>;
+
+template <jni_primitive_element T, bool Local = true> class java_array_chunks {
+  const java_array<T, Local> *_array;
+  jsize _length;
+  jsize _position = 0;
+  jsize _count = 0;
+  bool _started = false;
+  std::vector<T> _buffer;
+
+  friend class detail::chunk_iterator<java_array_chunks>;
+
+  std::span<const T> current() const noexcept {
+    return {_buffer.data(), (size_t)_count};
+  }
+  bool done() const noexcept { return _count == 0; }
+
+  void advance() {
+    _count = std::min<jsize>(_length - _position, (jsize)_buffer.size());
+    if (_count > 0) {
+      _array->get_region(_position, {_buffer.data(), (size_t)_count});
+      _position += _count;
+    }
+  }
+
+public:
+  using value_type = std::span<const T>;
+  using iterator = detail::chunk_iterator<java_array_chunks>;
+
+  explicit java_array_chunks(const java_array<T, Local> &array,
+                             jsize chunk_size = default_chunk_size)
+      : _array(&array), _length(array.size()),
+        _buffer((size_t)std::max<jsize>(chunk_size, 1)) {}
+
+  java_array_chunks(const java_array_chunks &) = delete;
+  java_array_chunks &operator=(const java_array_chunks &) = delete;
+
+  iterator begin() {
+    if (!_started) {
+      _started = true;
+      advance();
+    }
+    return iterator{*this};
+  }
+  std::default_sentinel_t end() const noexcept { return {}; }
+};
+
+template <class T, bool L>
+java_array_chunks(const java_array<T, L> &) -> java_array_chunks<T, L>;
+template <class T, bool L>
+java_array_chunks(const java_array<T, L> &, jsize) -> java_array_chunks<T, L>;
+
+/// Streams the UTF-8 encoding of a Java string to os, one chunk at a time
+template <bool L>
+std::ostream &write_utf8(std::ostream &os, const java_string<L> &str,
+                         jsize chunk_size = default_chunk_size) {
+  for (std::string_view chunk : java_string_chunks<L>{str, chunk_size}) {
+    os.write(chunk.data(), (std::streamsize)chunk.size());
+  }
+  return os;
+}
+
+/// Streams the raw content of a Java byte[] to os, one chunk at a time
+template <bool L>
+std::ostream &write_bytes(std::ostream &os, const java_array<jbyte, L> &bytes,
+                          jsize chunk_size = default_chunk_size) {
+  for (std::span<const jbyte> chunk : java_array_chunks<jbyte, L>{bytes, chunk_size}) {
+    os.write((const char *)chunk.data(), (std::streamsize)chunk.size());
+  }
+  return os;
+}
+
+#endif // HEADER_GUARD_DPSG_JAVA_CHUNKS_HPP
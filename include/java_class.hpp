@@ -5,8 +5,11 @@
 #include "java_ref.hpp"
 #include "meta/is_one_of.hpp"
 
+#include "java_array.hpp"
 #include "java_method.hpp"
 #include "java_object.hpp"
+#include "jni_call.hpp"
+#include "jni_convert.hpp"
 
 #include <jni.h>
 
@@ -14,25 +17,6 @@
 #include <memory>
 #include <optional>
 
-template <typename T, typename Args>
-struct is_same_jni_type : std::false_type {};
-
-template <typename T, meta::fixed_string ClassName>
-struct is_same_jni_type<T, java_class_desc<ClassName>>
-    : std::is_same<T, java_object<ClassName>> {};
-
-template <typename T>
-struct is_same_jni_type<T, java::lang::String>
-    : std::disjunction<std::is_same<T, java_object<java::lang::String::name>>,
-                       std::is_same<T, java_string<>>> {};
-
-template <typename T>
-concept native_jni_type =
-    dpsg::meta::is_one_of_v<T, bool, int, long, float, double, void, char,
-                            short, unsigned short>;
-
-template <native_jni_type T> struct is_same_jni_type<T, T> : std::true_type {};
-
 namespace detail {
 template <typename T, typename... Args>
 struct is_jni_callable_impl : std::false_type {};
@@ -40,11 +24,11 @@ struct is_jni_callable_impl : std::false_type {};
 template <typename Ret, typename... Expected, typename... Args>
   requires(sizeof...(Expected) == sizeof...(Args))
 struct is_jni_callable_impl<Ret(Expected...), Args...>
-    : std::conjunction<is_same_jni_type<Args, Expected>...> {};
+    : std::bool_constant<(jni_convertible_to<Args, Expected> && ...)> {};
 template <typename Ret, typename... Expected, typename... Args>
   requires(sizeof...(Expected) == sizeof...(Args))
 struct is_jni_callable_impl<Ret (*)(Expected...), Args...>
-    : std::conjunction<is_same_jni_type<Args, Expected>...> {};
+    : std::bool_constant<(jni_convertible_to<Args, Expected> && ...)> {};
 
 template <typename T> struct equivalent_jni_type {
   using type = T;
@@ -55,11 +39,32 @@ struct equivalent_jni_type<java_class_desc<str>> {
   using type = java_object<str>;
 };
 
+template <typename T> struct equivalent_jni_type<java_array_desc<T>> {
+  using type = java_array<jni_array_element_t<T>>;
+};
+
+// Name of the spans of a method, "Class.name(descriptor)"
+#ifdef JNI_CPP20_PROFILE_CALLS
+template <meta::fixed_string ClassName, meta::fixed_string Name, class Proto>
+constexpr inline auto method_label_storage =
+    ClassName + "." + Name + jni_desc<Proto>::name;
+#endif
+
+template <meta::fixed_string ClassName, meta::fixed_string Name, class Proto>
+constexpr call_label method_label() noexcept {
+#ifdef JNI_CPP20_PROFILE_CALLS
+  return call_label{method_label_storage<ClassName, Name, Proto>.data};
+#else
+  return call_label{};
+#endif
+}
+
 template <typename T> struct deduce_return_type;
 
 template <typename Ret, typename... Args>
 struct deduce_return_type<Ret(Args...)> {
   using type = typename equivalent_jni_type<Ret>::type;
+  using jni_type = jni_return_t<Ret>;
 };
 } // namespace detail
 
@@ -68,8 +73,10 @@ concept is_jni_callable = detail::is_jni_callable_impl<T, Args...>::value;
 
 template <meta::fixed_string ClassName>
 concept is_java_constructor = (ClassName == dpsg::meta::fixed_string{"<init>"});
+#ifndef JNI_CPP20_NO_SELF_CHECKS
 static_assert(is_java_constructor<"<init>">);
 static_assert(!is_java_constructor<"initialize">);
+#endif
 
 template <meta::fixed_string ClassName, bool Local = true>
 class java_class : public java_ref<jclass, Local> {
@@ -85,25 +92,19 @@ public:
 
 private:
   friend class JVM;
-  java_class(jclass cls, JNIEnv *env) noexcept
-      : java_ref<jclass, Local>{cls, env} {}
-  java_class(java_ref<jclass> &&cls, JNIEnv *env) noexcept
+  friend class java_class_loader;
+  friend class proxy_factory;
+  template <meta::fixed_string CN, bool> friend class java_class;
+  template <meta::fixed_string CN, class... Steps> friend class call_plan;
+  template <class... Entries> friend class prefetcher;
+  friend class attached_thread;
+  friend class embedded_classes;
+  java_class(jclass cls, JNIEnv *env,
+             ref_site site = ref_site::current()) noexcept
+      : java_ref<jclass, Local>{cls, env, site} {}
+  java_class(java_ref<jclass, Local> &&cls, JNIEnv *env) noexcept
       : java_ref<jclass, Local>{std::move(cls)} {}
 
-  template <meta::fixed_string S>
-  inline constexpr jobject
-  _extract_jni_value(const java_object<S> &obj) noexcept {
-    return obj.get();
-  }
-  inline constexpr jobject
-  _extract_jni_value(const java_string<> &obj) noexcept {
-    return obj.get();
-  }
-
-  template <typename T>
-  inline constexpr T _extract_jni_value(T value) noexcept {
-    return value;
-  }
 
 public:
   java_class(java_class &&) noexcept = default;
@@ -111,140 +112,134 @@ public:
   java_class(const java_class &) noexcept = delete;
   java_class &operator=(const java_class &) noexcept = delete;
 
+  /// Creates a global reference to the class, usable beyond the current
+  /// local frame (e.g. to keep pre-resolved method tables around).
+  java_class<ClassName, false>
+  promote(ref_site site = ref_site::current()) const noexcept {
+    static_assert(Local, "Cannot promote a global reference");
+    return java_class<ClassName, false>{java_ref<jclass, Local>::promote(site),
+                                        get_env()};
+  }
+
   template <meta::fixed_string name, jni_type_desc T>
     requires(is_java_constructor<name> == false)
-  std::optional<java_method<class_name, T>> get_method_id() {
+  std::optional<java_method<class_name, T>>
+  get_method_id(ref_site site = ref_site::current()) {
     assert(get_env() != nullptr && "in call to get_method_id");
     auto m = env().GetMethodID(get(), name, jni_desc<T>::name);
     if (m == nullptr) {
       return std::nullopt;
     }
-    return java_method<class_name, T>{m};
+    return java_method<class_name, T>{
+        m, detail::method_label<class_name, name, T>(), site};
   }
 
   template <meta::fixed_string name, jni_type_desc T>
-  std::optional<java_static_method<class_name, T>> get_static_method_id() {
+  std::optional<java_static_method<class_name, T>>
+  get_static_method_id(ref_site site = ref_site::current()) {
     assert(get_env() != nullptr && "in call to get_static_method_id");
     auto m = env().GetStaticMethodID(get(), name, jni_desc<T>::name);
     if (m == nullptr) {
       return std::nullopt;
     }
-    return java_static_method<class_name, T>{m};
+    return java_static_method<class_name, T>{
+        m, detail::method_label<class_name, name, T>(), site};
+  }
+
+  template <meta::fixed_string name, jni_type_desc T>
+  std::optional<java_field<class_name, T>> get_field_id() {
+    assert(get_env() != nullptr && "in call to get_field_id");
+    auto f = env().GetFieldID(get(), name, jni_desc<T>::name);
+    if (f == nullptr) {
+      return std::nullopt;
+    }
+    return java_field<class_name, T>{f};
   }
 
   template <typename... Ts>
-  std::optional<java_constructor<class_name, std::decay_t<Ts>...>>
-  get_constructor_id() {
+  std::optional<java_constructor<class_name, std::remove_cvref_t<Ts>...>>
+  get_constructor_id(ref_site site = ref_site::current()) {
     assert(get_env() != nullptr && "in call to get_constructor_id");
     auto m = env().GetMethodID(get(), "<init>",
-                               jni_desc<void(std::decay_t<Ts>...)>::name);
+                               jni_desc<void(std::remove_cvref_t<Ts>...)>::name);
     if (m == nullptr) {
       return std::nullopt;
     }
-    return java_constructor<class_name, Ts...>{m};
+    return java_constructor<class_name, std::remove_cvref_t<Ts>...>{
+        m, detail::method_label<class_name, "<init>",
+                                void(std::remove_cvref_t<Ts>...)>(),
+        site};
   }
 
   template <typename... CtorParams, class... Args>
-    requires(is_jni_callable<void(CtorParams...), std::decay_t<Args>...>)
+    requires(is_jni_callable<void(CtorParams...), Args...>)
   std::optional<java_object<class_name>>
   instantiate(java_constructor<class_name, CtorParams...> ctor,
-              Args &&...args) {
+              const Args &...args) {
     assert(get_env() != nullptr && "in call to instantiate");
-    auto p = env().NewObject(get(), ctor.id(),
-                             _extract_jni_value(std::forward<Args>(args))...);
+    call_span span{ctor.label()};
+    auto p = jni_invoker<void(CtorParams...)>::invoke_a(
+        env(),
+        [&](const jvalue *values) {
+          call_span jni{ctor.label(), "jni"};
+          return env().NewObjectA(get(), ctor.id(), values);
+        },
+        args...);
     if (p == nullptr) {
       return std::nullopt;
     }
-    return java_object<class_name>{p, get_env()};
+    return java_object<class_name>{p, get_env(), ctor.site()};
   }
 
-  template <class Proto, class... Args,
+  /// Arguments are converted as described in jni_convert.hpp
+  template <class Proto, bool L, class... Args,
             class Ret = typename detail::deduce_return_type<Proto>::type>
-    requires(is_jni_callable<Proto, std::decay_t<Args>...>)
+    requires(is_jni_callable<Proto, Args...>)
   auto call(const java_method<class_name, Proto> &method,
-            const java_object<class_name> &obj, Args &&...args) -> Ret {
+            const java_object<class_name, L> &obj, const Args &...args) const
+      -> Ret {
     assert(get_env() != nullptr && "in call to java_method::call");
-    if constexpr (std::is_same_v<void, Ret>) {
-      env().CallVoidMethod(obj.get(), method.id(),
-                           _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jboolean>) {
-      return (bool)env().CallBooleanMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jint>) {
-      return env().CallIntMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jbyte>) {
-      return env().CallByteMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jchar>) {
-      return env().CallCharMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jshort>) {
-      return env().CallShortMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jlong>) {
-      return env().CallLongMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jfloat>) {
-      return env().CallFloatMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jdouble>) {
-      return env().CallDoubleMethod(
-          obj.get(), method.id(),
-          _extract_jni_value(std::forward<Args>(args))...);
-    } else {
-      return Ret{(typename Ret::pointer)env().CallObjectMethod(
-                     obj.get(), method.id(),
-                     _extract_jni_value(std::forward<Args>(args))...),
-                 get_env()};
-    }
+    using result = typename detail::deduce_return_type<Proto>::jni_type;
+    call_span span{method.label()};
+    return jni_invoker<Proto>::invoke_a(
+        env(),
+        [&](const jvalue *values) -> Ret {
+          call_span jni{method.label(), "jni"};
+          if constexpr (std::is_same_v<result, jobject>) {
+            return Ret{(typename Ret::pointer)detail::call_method_a<jobject>(
+                           env(), obj.get(), method.id(), values),
+                       get_env(), method.site()};
+          } else {
+            return detail::call_method_a<result>(env(), obj.get(), method.id(),
+                                                 values);
+          }
+        },
+        args...);
   }
 
   template <class Proto, class... Args,
             class Ret = typename detail::deduce_return_type<Proto>::type>
-    requires(is_jni_callable<Proto, std::decay_t<Args>...>)
-  auto call(const java_static_method<class_name, Proto> &method, Args &&...args)
-      -> Ret {
+    requires(is_jni_callable<Proto, Args...>)
+  auto call(const java_static_method<class_name, Proto> &method,
+            const Args &...args) const -> Ret {
     assert(get_env() != nullptr && "in call to java_method::call");
-    if constexpr (std::is_same_v<void, Ret>) {
-      env().CallStaticVoidMethod(get(), method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, bool> || std::is_same_v<Ret, jboolean>) {
-      return (bool)env().CallStaticBooleanMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jint>) {
-      return env().CallStaticIntMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jbyte>) {
-      return env().CallStaticByteMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jchar>) {
-      return env().CallStaticCharMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jshort>) {
-      return env().CallStaticShortMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jlong>) {
-      return env().CallStaticLongMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jfloat>) {
-      return env().CallStaticFloatMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else if constexpr (std::is_same_v<Ret, jdouble>) {
-      return env().CallStaticDoubleMethod(get(),
-          method.id(), _extract_jni_value(std::forward<Args>(args))...);
-    } else {
-      return Ret{
-          (typename Ret::pointer)env().CallStaticObjectMethod(get(),
-              method.id(), _extract_jni_value(std::forward<Args>(args))...),
-          get_env()};
-    }
+    using result = typename detail::deduce_return_type<Proto>::jni_type;
+    call_span span{method.label()};
+    return jni_invoker<Proto>::invoke_a(
+        env(),
+        [&](const jvalue *values) -> Ret {
+          call_span jni{method.label(), "jni"};
+          if constexpr (std::is_same_v<result, jobject>) {
+            return Ret{
+                (typename Ret::pointer)detail::call_static_method_a<jobject>(
+                    env(), get(), method.id(), values),
+                get_env(), method.site()};
+          } else {
+            return detail::call_static_method_a<result>(env(), get(),
+                                                        method.id(), values);
+          }
+        },
+        args...);
   }
 };
 
@@ -0,0 +1,330 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_CLASS_LOADER_HPP
+#define HEADER_GUARD_DPSG_JAVA_CLASS_LOADER_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_ref.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <cassert>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/** Class lookup scoped to a class loader.
+ *
+ * JNI_CreateJavaVM only allows a single JVM per process, and FindClass
+ * resolves names through the class loader of the calling context. To run
+ * several isolated sets of jars side by side in one JVM, create one
+ * java_class_loader per set: each one is a URLClassLoader whose classes,
+ * and the method IDs resolved from them, are cached separately.
+ *
+ * @code
+ * auto loaders = unwrap(class_loader_factory::create(jvm));
+ * auto tenant_a = unwrap(loaders.create({"engines/a.jar"}));
+ * auto tenant_b = unwrap(loaders.create({"engines/b.jar"}));
+ * // Two distinct classes, even if both jars define the same name
+ * auto runner_a = unwrap(tenant_a.find_class<codingame::GameRunner>());
+ * auto runner_b = unwrap(tenant_b.find_class<codingame::GameRunner>());
+ * @endcode
+ *
+ * Factories and loaders are bound to the JNIEnv of the thread that created
+ * them, and must be used and destroyed on that thread, as the classes they
+ * return. The method IDs they return are usable from any thread.
+ */
+
+namespace java {
+namespace io {
+using File = java_class_desc<"java/io/File">;
+} // namespace io
+namespace net {
+using URI = java_class_desc<"java/net/URI">;
+using URL = java_class_desc<"java/net/URL">;
+using URLClassLoader = java_class_desc<"java/net/URLClassLoader">;
+} // namespace net
+} // namespace java
+
+/// Parent of the created class loaders
+enum class class_loader_parent {
+  /// Only the JDK classes are visible: the classes of the application class
+  /// path can't leak into the loader
+  platform,
+  /// Classes of the application class path are visible
+  system,
+};
+
+class java_class_loader {
+  JNIEnv *_env;
+  java_ref<jobject, false> _loader;
+  jmethodID _load_class;
+  jmethodID _close;
+
+  // Keyed by the static storage of the class names and of method_key, so
+  // that lookups don't build strings
+  std::unordered_map<const char *, java_ref<jclass, false>> _classes;
+  std::unordered_map<const char *, jmethodID> _methods;
+
+  // One per method, its address is the key of the method in _methods
+  template <jni_type_desc T, meta::fixed_string Name, class Proto, bool Static>
+  constexpr static inline char method_key = 0;
+
+  friend class class_loader_factory;
+  java_class_loader(JNIEnv *env, java_ref<jobject, false> loader,
+                    jmethodID load_class, jmethodID close) noexcept
+      : _env(env), _loader(std::move(loader)), _load_class(load_class),
+        _close(close) {}
+
+  static std::string binary_name(std::string_view internal_name) {
+    std::string name{internal_name};
+    for (auto &c : name) {
+      if (c == '/') {
+        c = '.';
+      }
+    }
+    return name;
+  }
+
+  // Returns the cached global reference to the class, loading it on the
+  // first call. internal_name must have static storage (T::name.data).
+  jclass _load(const char *internal_name) {
+    auto it = _classes.find(internal_name);
+    if (it != _classes.end()) {
+      return it->second.get();
+    }
+    auto name = binary_name(internal_name);
+    java_ref<jstring> jname{_env->NewStringUTF(name.c_str()), _env};
+    if (jname == nullptr) {
+      return nullptr;
+    }
+    java_ref<jclass> cls{(jclass)_env->CallObjectMethod(
+                             _loader.get(), _load_class, jname.get()),
+                         _env};
+    if (_env->ExceptionCheck() || cls == nullptr) {
+      return nullptr;
+    }
+    auto global = cls.promote();
+    auto ptr = global.get();
+    _classes.emplace(internal_name, std::move(global));
+    return ptr;
+  }
+
+  template <jni_type_desc T, meta::fixed_string Name, class Proto, bool Static>
+  jmethodID _method_id(jclass cls) {
+    auto key = &method_key<T, Name, Proto, Static>;
+    auto it = _methods.find(key);
+    if (it != _methods.end()) {
+      return it->second;
+    }
+    jmethodID id = Static ? _env->GetStaticMethodID(cls, Name, jni_desc<Proto>::name)
+                          : _env->GetMethodID(cls, Name, jni_desc<Proto>::name);
+    if (id != nullptr) {
+      _methods.emplace(key, id);
+    }
+    return id;
+  }
+
+public:
+  java_class_loader(java_class_loader &&other) noexcept
+      : _env(other._env), _loader(std::move(other._loader)),
+        _load_class(other._load_class), _close(other._close),
+        _classes(std::move(other._classes)),
+        _methods(std::move(other._methods)) {}
+  java_class_loader(const java_class_loader &) = delete;
+  java_class_loader &operator=(const java_class_loader &) = delete;
+  java_class_loader &operator=(java_class_loader &&) = delete;
+
+  /// The underlying java.net.URLClassLoader
+  jobject get() const noexcept { return _loader.get(); }
+
+  /** @brief Loads a class through this loader.
+   *
+   * @details The class is loaded with ClassLoader.loadClass the first time,
+   * later calls are served from the cache of this loader.
+   *
+   * @return A local reference to the class, std::nullopt if the class can't
+   * be loaded (a ClassNotFoundException is then pending).
+   */
+  template <jni_type_desc T>
+  std::optional<java_class<T::name>>
+  find_class(ref_site site = ref_site::current()) {
+    auto cls = _load(T::name.data);
+    if (cls == nullptr) {
+      return std::nullopt;
+    }
+    return java_class<T::name>{(jclass)_env->NewLocalRef(cls), _env, site};
+  }
+
+  /// Same as java_class::get_method_id, cached per loader
+  template <jni_type_desc T, meta::fixed_string Name, jni_type_desc Proto>
+  std::optional<java_method<T::name, Proto>>
+  get_method_id(ref_site site = ref_site::current()) {
+    auto cls = _load(T::name.data);
+    if (cls == nullptr) {
+      return std::nullopt;
+    }
+    auto id = _method_id<T, Name, Proto, false>(cls);
+    if (id == nullptr) {
+      return std::nullopt;
+    }
+    return java_method<T::name, Proto>{
+        id, detail::method_label<T::name, Name, Proto>(), site};
+  }
+
+  /// Same as java_class::get_static_method_id, cached per loader
+  template <jni_type_desc T, meta::fixed_string Name, jni_type_desc Proto>
+  std::optional<java_static_method<T::name, Proto>>
+  get_static_method_id(ref_site site = ref_site::current()) {
+    auto cls = _load(T::name.data);
+    if (cls == nullptr) {
+      return std::nullopt;
+    }
+    auto id = _method_id<T, Name, Proto, true>(cls);
+    if (id == nullptr) {
+      return std::nullopt;
+    }
+    return java_static_method<T::name, Proto>{
+        id, detail::method_label<T::name, Name, Proto>(), site};
+  }
+
+  /// Closes the loader (URLClassLoader.close), releasing its open jars.
+  /// Classes already loaded stay usable.
+  bool close() {
+    _env->CallVoidMethod(_loader.get(), _close);
+    return !_env->ExceptionCheck();
+  }
+};
+
+/// Creates java_class_loader objects. Resolves the classes and method IDs
+/// needed to build URLClassLoaders once.
+class class_loader_factory {
+  struct classes {
+    java_class<java::io::File::name, false> file;
+    java_class<java::net::URL::name, false> url;
+    java_class<java::net::URLClassLoader::name, false> url_class_loader;
+    java_class<java::lang::ClassLoader::name, false> class_loader;
+  };
+  struct methods {
+    jmethodID file_ctor;
+    jmethodID to_uri;
+    jmethodID to_url;
+    jmethodID loader_ctor;
+    jmethodID platform_loader;
+    jmethodID system_loader;
+    jmethodID load_class;
+    jmethodID close;
+  };
+
+  JNIEnv *_env;
+  classes _classes;
+  methods _methods;
+
+  class_loader_factory(JNIEnv *env, classes &&cls, methods ids) noexcept
+      : _env(env), _classes(std::move(cls)), _methods(ids) {}
+
+public:
+  /// Resolves everything needed to create loaders. Returns std::nullopt if
+  /// something is missing (requires Java 9 or newer).
+  static std::optional<class_loader_factory> create(JVM &jvm) {
+    auto file = jvm.find_class<java::io::File>();
+    auto uri = jvm.find_class<java::net::URI>();
+    auto url = jvm.find_class<java::net::URL>();
+    auto url_class_loader = jvm.find_class<java::net::URLClassLoader>();
+    auto class_loader = jvm.find_class<java::lang::ClassLoader>();
+    if (!file || !uri || !url || !url_class_loader || !class_loader) {
+      return std::nullopt;
+    }
+    auto file_ctor = file->get_constructor_id<java::lang::String>();
+    auto to_uri = file->get_method_id<"toURI", java::net::URI()>();
+    auto to_url = uri->get_method_id<"toURL", java::net::URL()>();
+    auto loader_ctor = url_class_loader->get_constructor_id<
+        java_array_desc<java::net::URL>, java::lang::ClassLoader>();
+    auto platform_loader =
+        class_loader->get_static_method_id<"getPlatformClassLoader",
+                                           java::lang::ClassLoader()>();
+    auto system_loader =
+        class_loader->get_static_method_id<"getSystemClassLoader",
+                                           java::lang::ClassLoader()>();
+    auto load_class =
+        class_loader->get_method_id<"loadClass",
+                                    java::lang::Class(java::lang::String)>();
+    auto close = url_class_loader->get_method_id<"close", void()>();
+    if (!file_ctor || !to_uri || !to_url || !loader_ctor || !platform_loader ||
+        !system_loader || !load_class || !close) {
+      return std::nullopt;
+    }
+    return class_loader_factory{
+        &*jvm,
+        classes{file->promote(), url->promote(), url_class_loader->promote(),
+                class_loader->promote()},
+        methods{file_ctor->id(), to_uri->id(), to_url->id(), loader_ctor->id(),
+                platform_loader->id(), system_loader->id(), load_class->id(),
+                close->id()}};
+  }
+
+  /** @brief Creates a URLClassLoader over a list of jars or class directories.
+   *
+   * @param[in] paths Filesystem paths of jars or directories
+   * @param[in] parent Which classes besides the ones in @p paths are visible
+   *
+   * @return The loader, std::nullopt if it couldn't be created (a Java
+   * exception is then pending).
+   */
+  std::optional<java_class_loader>
+  create(const std::vector<std::string> &paths,
+         class_loader_parent parent = class_loader_parent::platform) {
+    auto urls = java_ref<jobjectArray>{
+        _env->NewObjectArray((jsize)paths.size(), _classes.url.get(), nullptr),
+        _env};
+    if (urls == nullptr) {
+      return std::nullopt;
+    }
+    for (jsize i = 0; i < (jsize)paths.size(); ++i) {
+      auto path = java_ref<jstring>{_env->NewStringUTF(paths[i].c_str()), _env};
+      if (path == nullptr) {
+        return std::nullopt;
+      }
+      auto file = java_ref<jobject>{
+          _env->NewObject(_classes.file.get(), _methods.file_ctor, path.get()),
+          _env};
+      if (file == nullptr) {
+        return std::nullopt;
+      }
+      auto uri = java_ref<jobject>{
+          _env->CallObjectMethod(file.get(), _methods.to_uri), _env};
+      if (_env->ExceptionCheck()) {
+        return std::nullopt;
+      }
+      auto url = java_ref<jobject>{
+          _env->CallObjectMethod(uri.get(), _methods.to_url), _env};
+      if (_env->ExceptionCheck()) {
+        return std::nullopt;
+      }
+      _env->SetObjectArrayElement(urls.get(), i, url.get());
+    }
+
+    auto parent_getter = parent == class_loader_parent::platform
+                             ? _methods.platform_loader
+                             : _methods.system_loader;
+    auto parent_loader = java_ref<jobject>{
+        _env->CallStaticObjectMethod(_classes.class_loader.get(), parent_getter),
+        _env};
+    if (_env->ExceptionCheck()) {
+      return std::nullopt;
+    }
+    auto loader = java_ref<jobject>{
+        _env->NewObject(_classes.url_class_loader.get(), _methods.loader_ctor,
+                        urls.get(), parent_loader.get()),
+        _env};
+    if (loader == nullptr) {
+      return std::nullopt;
+    }
+    return java_class_loader{_env, loader.promote(), _methods.load_class,
+                             _methods.close};
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_CLASS_LOADER_HPP
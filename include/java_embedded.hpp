@@ -0,0 +1,155 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_EMBEDDED_HPP
+#define HEADER_GUARD_DPSG_JAVA_EMBEDDED_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_ref.hpp"
+#include "jvm.hpp"
+#include "result.hpp"
+
+#include <jni.h>
+
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Java classes embedded in the executable.
+ *
+ * The jni_cpp20_embed_classes CMake function (cmake/JniEmbedClasses.cmake)
+ * generates a header holding the bytecode of compiled classes (and of the
+ * classes of jars, extracted at build time) as an array of embedded_class.
+ * embedded_classes::define passes them to DefineClass, so that nothing is
+ * read from the class path at startup.
+ *
+ * A class can only be defined once its superclass and interfaces can be
+ * resolved: classes failing to be defined are retried once every other class
+ * has been tried, until no more progress is made.
+ *
+ * @code
+ * // CMake: jni_cpp20_embed_classes(app OUTPUT engine_classes.hpp
+ * //                                JARS engine.jar)
+ * #include "engine_classes.hpp"
+ * auto engine = unwrap(embedded_classes::define(jvm, engine_classes));
+ * auto runner = unwrap(engine.find_class<GameRunner>());
+ * @endcode
+ *
+ * By default the classes are defined in the system class loader: they see,
+ * and are seen by, the classes of the class path, and JVM::find_class finds
+ * them too. Resources of the jars other than classes are not embedded.
+ *
+ * The cached class references are bound to the JNIEnv of the thread that
+ * defined them.
+ */
+
+/// Bytecode of a class, as generated by jni_cpp20_embed_classes
+struct embedded_class {
+  /// Internal name (e.g. com/example/Engine)
+  const char *name;
+  std::span<const unsigned char> bytecode;
+};
+
+/// Classes that couldn't be defined, the last exception thrown is cleared
+struct embedded_define_error {
+  std::vector<std::string> classes;
+};
+
+class embedded_classes {
+  JNIEnv *_env;
+  std::unordered_map<std::string, java_ref<jclass, false>> _classes;
+
+  explicit embedded_classes(JNIEnv *env) noexcept : _env(env) {}
+
+  friend typename dpsg::result<embedded_classes, embedded_define_error>;
+
+  static jobject _system_loader(JVM &jvm) {
+    auto loader_cls = jvm.find_class<java::lang::ClassLoader>();
+    if (!loader_cls) {
+      return nullptr;
+    }
+    auto get_system = loader_cls->get_static_method_id<
+        "getSystemClassLoader", java::lang::ClassLoader()>();
+    if (!get_system) {
+      return nullptr;
+    }
+    return loader_cls->call(*get_system).release();
+  }
+
+public:
+  using result_type = dpsg::result<embedded_classes, embedded_define_error>;
+
+  /** @brief Defines classes in loader.
+   *
+   * @param[in] loader The defining class loader, the system class loader if
+   * nullptr
+   */
+  static result_type define(JVM &jvm, std::span<const embedded_class> classes,
+                            jobject loader = nullptr) {
+    embedded_classes defined{&*jvm};
+    java_ref<jobject> system_loader;
+    if (loader == nullptr) {
+      system_loader = java_ref<jobject>{_system_loader(jvm), &*jvm};
+      if (system_loader == nullptr) {
+        jvm->ExceptionClear();
+        return result_type{dpsg::in_place_error,
+                           embedded_define_error{{"java/lang/ClassLoader"}}};
+      }
+      loader = system_loader.get();
+    }
+
+    std::vector<const embedded_class *> pending;
+    pending.reserve(classes.size());
+    for (auto &c : classes) {
+      pending.push_back(&c);
+    }
+    // Each pass defines the classes whose dependencies are defined
+    while (!pending.empty()) {
+      std::vector<const embedded_class *> failed;
+      for (auto *c : pending) {
+        java_ref<jclass> cls{
+            jvm->DefineClass(c->name, loader, (const jbyte *)c->bytecode.data(),
+                             (jsize)c->bytecode.size()),
+            &*jvm};
+        if (cls == nullptr) {
+          jvm->ExceptionClear();
+          failed.push_back(c);
+          continue;
+        }
+        defined._classes.emplace(c->name, cls.promote());
+      }
+      if (failed.size() == pending.size()) {
+        embedded_define_error error;
+        for (auto *c : failed) {
+          error.classes.emplace_back(c->name);
+        }
+        return result_type{dpsg::in_place_error, std::move(error)};
+      }
+      pending = std::move(failed);
+    }
+    return result_type{dpsg::in_place_value, std::move(defined)};
+  }
+
+  embedded_classes(embedded_classes &&) noexcept = default;
+  embedded_classes &operator=(embedded_classes &&) noexcept = default;
+  embedded_classes(const embedded_classes &) = delete;
+  embedded_classes &operator=(const embedded_classes &) = delete;
+
+  std::size_t size() const noexcept { return _classes.size(); }
+
+  /// Local reference to a class defined by define(), std::nullopt if it
+  /// wasn't embedded. No class loader is involved.
+  template <jni_type_desc T>
+  std::optional<java_class<T::name>>
+  find_class(ref_site site = ref_site::current()) const {
+    auto it = _classes.find(T::name.data);
+    if (it == _classes.end()) {
+      return std::nullopt;
+    }
+    return java_class<T::name>{(jclass)_env->NewLocalRef(it->second.get()),
+                               _env, site};
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_EMBEDDED_HPP
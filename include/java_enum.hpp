@@ -0,0 +1,149 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_ENUM_HPP
+#define HEADER_GUARD_DPSG_JAVA_ENUM_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_object.hpp"
+#include "java_ref.hpp"
+#include "jni_call.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <cassert>
+#include <cstddef>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+/** Binding of a Java enum to a C++ enum.
+ *
+ * The names of the Java constants are listed in the order of the values of
+ * the C++ enumerators, which must be 0, 1, 2... Constants of the Java enum
+ * that aren't listed have no C++ counterpart.
+ *
+ * create() resolves every constant once and keeps a global reference to it:
+ *  + to_java is an array index, the constant can be passed to a call as is;
+ *  + from_java compares the object with every constant (IsSameObject) for
+ *    enums of up to scan_limit constants, and otherwise calls `ordinal()`
+ *    and looks the result up in a table built by create().
+ *
+ * @code
+ * enum class direction { north, east, south, west };
+ * using Direction = java_class_desc<"game/Direction">;
+ * using directions =
+ *     java_enum<direction, Direction, "NORTH", "EAST", "SOUTH", "WEST">;
+ * auto dirs = unwrap(directions::create(jvm));
+ * auto heading = robot_cls.call(turn, robot, dirs.to_java(direction::east));
+ * switch (unwrap(dirs.from_java(heading))) { ... }
+ * @endcode
+ *
+ * The references are bound to the JNIEnv of the thread that created the
+ * binding, the ordinal method ID is usable from any thread.
+ */
+
+template <class E, jni_type_desc Desc, meta::fixed_string... Names>
+class java_enum {
+  static_assert(std::is_enum_v<E>, "java_enum binds C++ enums");
+
+public:
+  using constant_type = java_object<Desc::name, false>;
+
+  constexpr static inline std::size_t size = sizeof...(Names);
+  /// Number of constants up to which from_java uses IsSameObject
+  constexpr static inline std::size_t scan_limit = 8;
+
+private:
+  java_ref<jclass, false> _cls;
+  jmethodID _ordinal = nullptr;
+  std::vector<constant_type> _constants;
+  // C++ value of every Java ordinal
+  std::vector<std::optional<E>> _by_ordinal;
+
+  java_enum() noexcept = default;
+
+public:
+  /// Resolves every constant, std::nullopt if the class or one of the
+  /// constants couldn't be found
+  static std::optional<java_enum> create(JVM &jvm) {
+    auto cls = jvm.find_class<Desc>();
+    if (!cls) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    auto ordinal = cls->template get_method_id<"ordinal", int()>();
+    if (!ordinal) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    java_enum result;
+    result._cls = java_ref<jclass, false>{
+        (jclass)jvm->NewGlobalRef(cls->get()), &*jvm};
+    result._ordinal = ordinal->id();
+    result._constants.reserve(size);
+    for (const char *name : {(const char *)Names.data...}) {
+      auto id = jvm->GetStaticFieldID(cls->get(), name, jni_desc<Desc>::name);
+      if (id == nullptr) {
+        jvm->ExceptionClear();
+        return std::nullopt;
+      }
+      java_ref<jobject> constant{jvm->GetStaticObjectField(cls->get(), id),
+                                 &*jvm};
+      if (constant == nullptr) {
+        return std::nullopt;
+      }
+      auto index = (std::size_t)detail::call_method_a<int>(
+          *jvm, constant.get(), result._ordinal, nullptr);
+      if (index >= result._by_ordinal.size()) {
+        result._by_ordinal.resize(index + 1);
+      }
+      result._by_ordinal[index] = (E)result._constants.size();
+      result._constants.push_back(constant_type{constant.promote()});
+    }
+    return result;
+  }
+
+  java_enum(java_enum &&) noexcept = default;
+  java_enum &operator=(java_enum &&) noexcept = default;
+  java_enum(const java_enum &) = delete;
+  java_enum &operator=(const java_enum &) = delete;
+
+  /// Java constant of value, valid as long as the binding is
+  const constant_type &to_java(E value) const noexcept {
+    assert((std::size_t)value < size && "in call to java_enum::to_java");
+    return _constants[(std::size_t)value];
+  }
+
+  /// C++ value of obj, std::nullopt if obj is null, isn't a constant of the
+  /// enum or has no C++ counterpart
+  std::optional<E> from_java(JNIEnv &env, jobject obj) const noexcept {
+    if (obj == nullptr) {
+      return std::nullopt;
+    }
+    if constexpr (size <= scan_limit) {
+      for (std::size_t i = 0; i < size; ++i) {
+        if (env.IsSameObject(obj, _constants[i].get())) {
+          return (E)i;
+        }
+      }
+      return std::nullopt;
+    } else {
+      if (!env.IsInstanceOf(obj, _cls.get())) {
+        return std::nullopt;
+      }
+      auto index = (std::size_t)detail::call_method_a<int>(env, obj, _ordinal,
+                                                           nullptr);
+      if (index >= _by_ordinal.size()) {
+        return std::nullopt;
+      }
+      return _by_ordinal[index];
+    }
+  }
+
+  template <bool L>
+  std::optional<E> from_java(const java_ref<jobject, L> &obj) const noexcept {
+    return from_java(obj.env(), obj.get());
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_ENUM_HPP
@@ -0,0 +1,304 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_EXCEPTION_HPP
+#define HEADER_GUARD_DPSG_JAVA_EXCEPTION_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_ref.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <concepts>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** Java exceptions as C++ exceptions.
+ *
+ * An exception_translator caches, once, the method IDs needed to describe a
+ * Throwable and global references to the Java exception classes mapped to
+ * C++ exception types. Translating a pending Java exception then costs one
+ * IsInstanceOf per mapping, and nothing is queried from the Throwable until
+ * the class name, the message or the stack trace are first accessed.
+ *
+ * Mappings are checked in registration order: register subclasses before
+ * their base classes. Unmapped exceptions are thrown as java_exception.
+ *
+ * @code
+ * struct io_error : java_exception {
+ *   explicit io_error(java_exception e) : java_exception(std::move(e)) {}
+ * };
+ * auto translator = unwrap(exception_translator::create(jvm));
+ * translator.map<java::io::IOException, io_error>();
+ * // ...
+ * cls.call(read, obj);
+ * translator.check(*jvm); // throws io_error if read threw an IOException
+ * @endcode
+ *
+ * A java_exception holds a global reference created with the JNIEnv of the
+ * thread it was created on, and must be used (and destroyed) on that thread.
+ */
+
+namespace java {
+namespace lang {
+using Throwable = java_class_desc<"java/lang/Throwable">;
+using StackTraceElement = java_class_desc<"java/lang/StackTraceElement">;
+} // namespace lang
+} // namespace java
+
+/// A frame of the stack trace of a Java exception
+struct stack_frame {
+  std::string class_name;
+  std::string method_name;
+  /// Empty if unknown
+  std::string file_name;
+  /// Negative if unknown, -2 for native methods
+  int line_number;
+};
+
+namespace detail {
+struct throwable_methods {
+  jmethodID get_class;
+  jmethodID get_name;
+  jmethodID get_message;
+  jmethodID get_stack_trace;
+  jmethodID frame_class_name;
+  jmethodID frame_method_name;
+  jmethodID frame_file_name;
+  jmethodID frame_line_number;
+};
+
+// Copies a Java string in modified UTF-8, without pinning it
+inline std::string utf_string(JNIEnv &env, jstring str) {
+  if (str == nullptr) {
+    return {};
+  }
+  std::string result((std::size_t)env.GetStringUTFLength(str), '\0');
+  env.GetStringUTFRegion(str, 0, env.GetStringLength(str), result.data());
+  return result;
+}
+
+// Calls a method returning a String, "" if it throws or returns null
+inline std::string call_string_method(JNIEnv &env, jobject obj,
+                                      jmethodID id) {
+  java_ref<jstring> str{(jstring)env.CallObjectMethod(obj, id), &env};
+  if (env.ExceptionCheck()) {
+    env.ExceptionClear();
+    return {};
+  }
+  return utf_string(env, str.get());
+}
+} // namespace detail
+
+class java_exception : public std::exception {
+  // Shared by copies: C++ exceptions must be copyable
+  struct state {
+    java_ref<jthrowable, false> throwable;
+    detail::throwable_methods methods;
+    std::optional<std::string> class_name;
+    std::optional<std::string> message;
+    std::optional<std::vector<stack_frame>> stack_trace;
+    std::string what;
+  };
+  std::shared_ptr<state> _state;
+
+public:
+  java_exception(java_ref<jthrowable, false> throwable,
+                 const detail::throwable_methods &methods)
+      : _state(std::make_shared<state>(
+            state{std::move(throwable), methods, {}, {}, {}, {}})) {}
+
+  /// The Java exception
+  jthrowable get() const noexcept { return _state->throwable.get(); }
+  JNIEnv &env() const noexcept { return _state->throwable.env(); }
+
+  /// Binary name of the class of the exception (e.g.
+  /// java.lang.IllegalStateException)
+  const std::string &class_name() const {
+    if (!_state->class_name) {
+      auto &jni = env();
+      java_ref<jobject> cls{
+          jni.CallObjectMethod(get(), _state->methods.get_class), &jni};
+      _state->class_name =
+          cls ? detail::call_string_method(jni, cls.get(),
+                                           _state->methods.get_name)
+              : std::string{};
+    }
+    return *_state->class_name;
+  }
+
+  /// Result of getMessage(), empty if there is none
+  const std::string &message() const {
+    if (!_state->message) {
+      _state->message = detail::call_string_method(env(), get(),
+                                                   _state->methods.get_message);
+    }
+    return *_state->message;
+  }
+
+  /// Frames of the stack trace, innermost first
+  const std::vector<stack_frame> &stack_trace() const {
+    if (!_state->stack_trace) {
+      _state->stack_trace = _load_stack_trace();
+    }
+    return *_state->stack_trace;
+  }
+
+  /// "<class name>: <message>"
+  const char *what() const noexcept override {
+    if (_state->what.empty()) {
+      try {
+        _state->what = class_name();
+        if (!message().empty()) {
+          _state->what += ": " + message();
+        }
+      } catch (...) {
+        return "java exception";
+      }
+    }
+    return _state->what.c_str();
+  }
+
+private:
+  std::vector<stack_frame> _load_stack_trace() const {
+    auto &jni = env();
+    auto &m = _state->methods;
+    std::vector<stack_frame> frames;
+    java_ref<jobjectArray> elements{
+        (jobjectArray)jni.CallObjectMethod(get(), m.get_stack_trace), &jni};
+    if (jni.ExceptionCheck()) {
+      jni.ExceptionClear();
+      return frames;
+    }
+    if (!elements) {
+      return frames;
+    }
+    auto size = jni.GetArrayLength(elements.get());
+    frames.reserve((std::size_t)size);
+    for (jsize i = 0; i < size; ++i) {
+      java_ref<jobject> element{
+          jni.GetObjectArrayElement(elements.get(), i), &jni};
+      auto line = jni.CallIntMethod(element.get(), m.frame_line_number);
+      if (jni.ExceptionCheck()) {
+        jni.ExceptionClear();
+        line = -1;
+      }
+      frames.push_back(stack_frame{
+          detail::call_string_method(jni, element.get(), m.frame_class_name),
+          detail::call_string_method(jni, element.get(), m.frame_method_name),
+          detail::call_string_method(jni, element.get(), m.frame_file_name),
+          (int)line});
+    }
+    return frames;
+  }
+};
+
+class exception_translator {
+  struct mapping {
+    java_ref<jclass, false> cls;
+    std::function<void(java_exception &&)> raise;
+  };
+
+  JNIEnv *_env;
+  detail::throwable_methods _methods;
+  std::vector<mapping> _mappings;
+
+  exception_translator(JNIEnv *env, const detail::throwable_methods &methods)
+      : _env(env), _methods(methods) {}
+
+public:
+  /// Resolves the methods used to describe exceptions. Returns std::nullopt
+  /// if one of them couldn't be found.
+  static std::optional<exception_translator> create(JVM &jvm) {
+    auto object = jvm.find_class<java::lang::Object>();
+    auto cls = jvm.find_class<java::lang::Class>();
+    auto throwable = jvm.find_class<java::lang::Throwable>();
+    auto element = jvm.find_class<java::lang::StackTraceElement>();
+    if (!object || !cls || !throwable || !element) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    auto get_class = object->get_method_id<"getClass", java::lang::Class()>();
+    auto get_name = cls->get_method_id<"getName", java::lang::String()>();
+    auto get_message =
+        throwable->get_method_id<"getMessage", java::lang::String()>();
+    auto get_stack_trace = throwable->get_method_id<
+        "getStackTrace", java_array_desc<java::lang::StackTraceElement>()>();
+    auto class_name =
+        element->get_method_id<"getClassName", java::lang::String()>();
+    auto method_name =
+        element->get_method_id<"getMethodName", java::lang::String()>();
+    auto file_name =
+        element->get_method_id<"getFileName", java::lang::String()>();
+    auto line_number = element->get_method_id<"getLineNumber", int()>();
+    if (!get_class || !get_name || !get_message || !get_stack_trace ||
+        !class_name || !method_name || !file_name || !line_number) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    return exception_translator{
+        &*jvm,
+        {get_class->id(), get_name->id(), get_message->id(),
+         get_stack_trace->id(), class_name->id(), method_name->id(),
+         file_name->id(), line_number->id()}};
+  }
+
+  /** @brief Translates instances of JavaException to CppException.
+   *
+   * @details CppException must be constructible from a java_exception.
+   * Returns false if JavaException couldn't be found.
+   */
+  template <jni_type_desc JavaException, class CppException>
+    requires std::constructible_from<CppException, java_exception &&>
+  bool map() {
+    auto local = _env->FindClass(JavaException::name);
+    if (local == nullptr) {
+      _env->ExceptionClear();
+      return false;
+    }
+    java_ref<jclass, false> global{(jclass)_env->NewGlobalRef(local), _env};
+    _env->DeleteLocalRef(local);
+    _mappings.push_back(mapping{std::move(global), [](java_exception &&e) {
+                                  throw CppException{std::move(e)};
+                                }});
+    return true;
+  }
+
+  /// Clears the pending Java exception and returns it, std::nullopt if
+  /// there is none
+  std::optional<java_exception> take(JNIEnv &env) const {
+    if (!env.ExceptionCheck()) {
+      return std::nullopt;
+    }
+    jthrowable local = env.ExceptionOccurred();
+    env.ExceptionClear();
+    java_ref<jthrowable, false> global{(jthrowable)env.NewGlobalRef(local),
+                                       &env};
+    env.DeleteLocalRef(local);
+    return java_exception{std::move(global), _methods};
+  }
+
+  /// Throws the C++ exception mapped to e
+  [[noreturn]] void raise(java_exception &&e) const {
+    for (auto &m : _mappings) {
+      if (e.env().IsInstanceOf(e.get(), m.cls.get())) {
+        m.raise(std::move(e));
+      }
+    }
+    throw std::move(e);
+  }
+
+  /// Clears the pending Java exception, if any, and throws the C++
+  /// exception mapped to it
+  void check(JNIEnv &env) const {
+    if (auto e = take(env)) {
+      raise(std::move(*e));
+    }
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_EXCEPTION_HPP
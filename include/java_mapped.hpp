@@ -0,0 +1,259 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_MAPPED_HPP
+#define HEADER_GUARD_DPSG_JAVA_MAPPED_HPP
+
+#include "dsl.hpp"
+#include "java_object.hpp"
+#include "jvm.hpp"
+#include "result.hpp"
+
+#include <jni.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <span>
+#include <system_error>
+#include <utility>
+
+/** Memory shared between C++ and Java without copies.
+ *
+ * A shared_mapping maps a file (or an anonymous region) with mmap and hands
+ * views of it to Java as direct ByteBuffers (NewDirectByteBuffer): both sides
+ * read and write the same pages.
+ *
+ * Java never frees the memory behind a direct buffer created from native
+ * code, and may keep the buffer alive for as long as it wants. The mapping is
+ * therefore retained by the JVM object: it is unmapped once the JVM has been
+ * destroyed and every C++ handle is gone, or earlier if release() is called
+ * (after which Java must not touch the buffers anymore).
+ *
+ * A ByteBuffer holds at most INT_MAX bytes: larger regions are handed to
+ * Java as several views. Direct buffers are big endian by default, Java code
+ * reading native data should call `order(ByteOrder.nativeOrder())`.
+ *
+ * @code
+ * auto replay = shared_mapping::map_file(jvm, "game.replay",
+ *                                        map_mode::read_only);
+ * if (replay) {
+ *   auto buffer = replay.value().buffer(*jvm);
+ *   engine.call(load_replay, *buffer);
+ * }
+ * @endcode
+ *
+ * POSIX only.
+ */
+
+namespace java {
+namespace nio {
+using ByteBuffer = java_class_desc<"java/nio/ByteBuffer">;
+} // namespace nio
+} // namespace java
+
+enum class map_mode {
+  /// Pages are read only on both sides, Java gets read-only buffers
+  read_only,
+  /// Writes from either side are visible to the other and reach the file
+  read_write,
+  /// Writes are visible to both sides but never reach the file (MAP_PRIVATE)
+  copy_on_write,
+};
+
+/// RAII mmap of a file or of anonymous memory
+class mapped_region {
+  std::byte *_data = nullptr;
+  std::size_t _size = 0;
+  map_mode _mode = map_mode::read_only;
+
+  mapped_region(std::byte *data, std::size_t size, map_mode mode) noexcept
+      : _data(data), _size(size), _mode(mode) {}
+
+  friend typename dpsg::result<mapped_region, std::error_code>;
+
+  static std::error_code _last_error() noexcept {
+    return {errno, std::system_category()};
+  }
+
+public:
+  using result_type = dpsg::result<mapped_region, std::error_code>;
+
+  /// Maps the whole file at path. Empty files can't be mapped.
+  static result_type open_file(const char *path, map_mode mode) noexcept {
+    int fd = ::open(path, mode == map_mode::read_write ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+      return result_type{dpsg::in_place_error, _last_error()};
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+      auto error = _last_error();
+      ::close(fd);
+      return result_type{dpsg::in_place_error, error};
+    }
+    auto size = (std::size_t)info.st_size;
+    if (size == 0) {
+      ::close(fd);
+      return result_type{dpsg::in_place_error,
+                         std::make_error_code(std::errc::invalid_argument)};
+    }
+    int prot = mode == map_mode::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+    int flags = mode == map_mode::copy_on_write ? MAP_PRIVATE : MAP_SHARED;
+    void *data = ::mmap(nullptr, size, prot, flags, fd, 0);
+    auto error = _last_error();
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      return result_type{dpsg::in_place_error, error};
+    }
+    return result_type{dpsg::in_place_value, (std::byte *)data, size, mode};
+  }
+
+  /// Zero-filled read-write memory, not backed by a file
+  static result_type anonymous(std::size_t size) noexcept {
+    void *data = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      return result_type{dpsg::in_place_error, _last_error()};
+    }
+    return result_type{dpsg::in_place_value, (std::byte *)data, size,
+                       map_mode::read_write};
+  }
+
+  mapped_region(mapped_region &&other) noexcept
+      : _data(std::exchange(other._data, nullptr)),
+        _size(std::exchange(other._size, 0)), _mode(other._mode) {}
+  mapped_region &operator=(mapped_region &&other) noexcept {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+    std::swap(_mode, other._mode);
+    return *this;
+  }
+  mapped_region(const mapped_region &) = delete;
+  mapped_region &operator=(const mapped_region &) = delete;
+
+  ~mapped_region() {
+    if (_data != nullptr) {
+      ::munmap(_data, _size);
+    }
+  }
+
+  std::byte *data() const noexcept { return _data; }
+  std::size_t size() const noexcept { return _size; }
+  map_mode mode() const noexcept { return _mode; }
+
+  /// Writes modified pages back to the file (read_write mode only)
+  bool flush() const noexcept {
+    return _mode == map_mode::read_write &&
+           ::msync(_data, _size, MS_SYNC) == 0;
+  }
+};
+
+/// A mapped_region shared with the JVM, see the file documentation
+class shared_mapping {
+  std::shared_ptr<mapped_region> _region;
+  // ByteBuffer.asReadOnlyBuffer(), resolved for read_only mappings
+  jmethodID _as_read_only = nullptr;
+
+  shared_mapping(std::shared_ptr<mapped_region> region,
+                 jmethodID as_read_only) noexcept
+      : _region(std::move(region)), _as_read_only(as_read_only) {}
+
+  friend typename dpsg::result<shared_mapping, std::error_code>;
+
+public:
+  using result_type = dpsg::result<shared_mapping, std::error_code>;
+
+  /// Shares region with Java, the JVM keeps it mapped until it is destroyed
+  static result_type share(JVM &jvm, mapped_region &&region) {
+    jmethodID as_read_only = nullptr;
+    if (region.mode() == map_mode::read_only) {
+      auto cls = jvm.find_class<java::nio::ByteBuffer>();
+      auto method =
+          cls ? cls->get_method_id<"asReadOnlyBuffer", java::nio::ByteBuffer()>()
+              : std::nullopt;
+      if (!method) {
+        jvm->ExceptionClear();
+        return result_type{dpsg::in_place_error,
+                           std::make_error_code(std::errc::not_supported)};
+      }
+      as_read_only = method->id();
+    }
+    auto shared = std::make_shared<mapped_region>(std::move(region));
+    jvm.retain(shared);
+    return result_type{dpsg::in_place_value, std::move(shared), as_read_only};
+  }
+
+  static result_type map_file(JVM &jvm, const char *path, map_mode mode) {
+    auto region = mapped_region::open_file(path, mode);
+    if (!region) {
+      return result_type{dpsg::in_place_error, region.error()};
+    }
+    return share(jvm, std::move(region.value()));
+  }
+
+  static result_type anonymous(JVM &jvm, std::size_t size) {
+    auto region = mapped_region::anonymous(size);
+    if (!region) {
+      return result_type{dpsg::in_place_error, region.error()};
+    }
+    return share(jvm, std::move(region.value()));
+  }
+
+  /// The whole mapping on the C++ side
+  std::span<std::byte> bytes() const noexcept {
+    return {_region->data(), _region->size()};
+  }
+  map_mode mode() const noexcept { return _region->mode(); }
+  bool flush() const noexcept { return _region->flush(); }
+
+  /** @brief Direct ByteBuffer over length bytes starting at offset.
+   *
+   * @details The buffer is read only for read_only mappings. Returns
+   * std::nullopt if the view is out of bounds, longer than INT_MAX bytes, or
+   * if the JVM doesn't support direct buffers.
+   */
+  std::optional<java_object<java::nio::ByteBuffer::name>>
+  buffer(JNIEnv &env, std::size_t offset = 0,
+         std::size_t length = (std::size_t)-1,
+         ref_site site = ref_site::current()) const {
+    auto size = _region->size();
+    if (offset > size) {
+      return std::nullopt;
+    }
+    length = std::min(length, size - offset);
+    if (length > (std::size_t)INT_MAX) {
+      return std::nullopt;
+    }
+    jobject buffer =
+        env.NewDirectByteBuffer(_region->data() + offset, (jlong)length);
+    if (buffer == nullptr) {
+      env.ExceptionClear();
+      return std::nullopt;
+    }
+    if (_as_read_only != nullptr) {
+      jobject read_only = env.CallObjectMethod(buffer, _as_read_only);
+      env.DeleteLocalRef(buffer);
+      if (read_only == nullptr) {
+        env.ExceptionClear();
+        return std::nullopt;
+      }
+      buffer = read_only;
+    }
+    return java_object<java::nio::ByteBuffer::name>{buffer, &env, site};
+  }
+
+  /** @brief Stops the JVM from retaining the mapping.
+   *
+   * @details It is unmapped once every copy of this handle is destroyed. Java
+   * code must not access the buffers created from it anymore.
+   */
+  void release(JVM &jvm) noexcept { jvm.release(_region.get()); }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_MAPPED_HPP
@@ -1,7 +1,10 @@
 #ifndef HEADER_GUARD_DPSG_JAVA_METHOD_HPP
 #define HEADER_GUARD_DPSG_JAVA_METHOD_HPP
 
+#include "call_profiler.hpp"
+#include "dsl.hpp"
 #include "fixed_string.hpp"
+#include "ref_tracker.hpp"
 
 #include <jni.h>
 
@@ -11,10 +14,20 @@ namespace meta = dpsg::meta;
 
 template <meta::fixed_string ClassName, typename Prototype> requires(std::is_function_v<Prototype>) class java_method {
   jmethodID _id = nullptr;
+  // Name of the spans of the calls, see call_profiler.hpp
+  [[no_unique_address]] call_label _label;
+  // Where the method was resolved, recorded by ref_tracker.hpp for the
+  // references returned by its calls
+  [[no_unique_address]] ref_site _site;
   template <meta::fixed_string CN, bool> friend class java_class;
+  friend class java_class_loader;
+  template <class... Entries> friend class prefetcher;
+  template <jni_type_desc C, class... M> friend class prefetched_class;
 
 protected:
-  constexpr java_method(jmethodID id) noexcept : _id(id) {}
+  constexpr java_method(jmethodID id, call_label label = call_label{},
+                        ref_site site = ref_site{}) noexcept
+      : _id(id), _label(label), _site(site) {}
 
 public:
   constexpr java_method(java_method &&) noexcept = default;
@@ -24,14 +37,26 @@ public:
   constexpr static inline auto class_name = ClassName;
 
   jmethodID id() const noexcept { return _id; }
+  constexpr call_label label() const noexcept { return _label; }
+  constexpr ref_site site() const noexcept { return _site; }
 };
 
 template <meta::fixed_string ClassName, typename Prototype> requires(std::is_function_v<Prototype>) class java_static_method {
   jmethodID _id = nullptr;
+  // Name of the spans of the calls, see call_profiler.hpp
+  [[no_unique_address]] call_label _label;
+  // Where the method was resolved, recorded by ref_tracker.hpp for the
+  // references returned by its calls
+  [[no_unique_address]] ref_site _site;
   template <meta::fixed_string CN, bool> friend class java_class;
+  friend class java_class_loader;
+  template <class... Entries> friend class prefetcher;
+  template <jni_type_desc C, class... M> friend class prefetched_class;
 
 protected:
-  constexpr java_static_method(jmethodID id) noexcept : _id(id) {}
+  constexpr java_static_method(jmethodID id, call_label label = call_label{},
+                        ref_site site = ref_site{}) noexcept
+      : _id(id), _label(label), _site(site) {}
 
 public:
   constexpr java_static_method(java_static_method &&) noexcept = default;
@@ -41,6 +66,8 @@ public:
   constexpr static inline auto class_name = ClassName;
 
   jmethodID id() const noexcept { return _id; }
+  constexpr call_label label() const noexcept { return _label; }
+  constexpr ref_site site() const noexcept { return _site; }
 };
 
 template <meta::fixed_string ClassName, typename... Parameters>
@@ -48,8 +75,9 @@ class java_constructor : public java_method<ClassName, void(Parameters...)> {
   template <meta::fixed_string CN, bool> friend class java_class;
 
 protected:
-  java_constructor(jmethodID id) noexcept
-      : java_method<ClassName, void(Parameters...)>(id) {}
+  java_constructor(jmethodID id, call_label label = call_label{},
+                   ref_site site = ref_site{}) noexcept
+      : java_method<ClassName, void(Parameters...)>(id, label, site) {}
 
 public:
   constexpr java_constructor(java_constructor &&) noexcept = default;
@@ -58,4 +86,23 @@ public:
   constexpr java_constructor &operator=(const java_constructor &) noexcept = default;
 };
 
+/// Field of type T of the class ClassName
+template <meta::fixed_string ClassName, typename T> class java_field {
+  jfieldID _id = nullptr;
+  template <meta::fixed_string CN, bool> friend class java_class;
+
+protected:
+  constexpr java_field(jfieldID id) noexcept : _id(id) {}
+
+public:
+  constexpr java_field(java_field &&) noexcept = default;
+  constexpr java_field &operator=(java_field &&) noexcept = default;
+  constexpr java_field(const java_field &) noexcept = default;
+  constexpr java_field &operator=(const java_field &) noexcept = default;
+  constexpr static inline auto class_name = ClassName;
+  using type = T;
+
+  jfieldID id() const noexcept { return _id; }
+};
+
 #endif // HEADER_GUARD_DPSG_JAVA_METHOD_HPP
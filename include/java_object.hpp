@@ -10,10 +10,18 @@
 template <meta::fixed_string ClassName, bool Local = true>
 class java_object : public java_ref<jobject, Local> {
   template <meta::fixed_string CN, bool> friend class java_class;
+  template <meta::fixed_string CN, class... Steps> friend class call_plan;
+  template <jni_type_desc Interface> friend class java_proxy;
+  friend class shared_mapping;
+  friend class ring_channel;
+  friend class boxing;
+  template <class E, jni_type_desc D, meta::fixed_string... N>
+  friend class java_enum;
 
 protected:
-  java_object(jobject obj, JNIEnv *env) noexcept
-      : java_ref<jobject, Local>{obj, env} {}
+  java_object(jobject obj, JNIEnv *env,
+              ref_site site = ref_site::current()) noexcept
+      : java_ref<jobject, Local>{obj, env, site} {}
   java_object(java_ref<jobject, Local> &&obj) noexcept
       : java_ref<jobject, Local>{std::move(obj)} {}
 
@@ -25,13 +33,33 @@ public:
   constexpr java_object &operator=(const java_object &) noexcept = delete;
 };
 
+/// Array whose elements are instances of ClassName (or of its subclasses),
+/// accepted where a prototype expects `java_array_desc<java_class_desc<N>>`
+template <meta::fixed_string ClassName, bool Local = true>
+class java_object_array : public java_ref<jobjectArray, Local> {
+public:
+  using pointer = jobjectArray;
+  constexpr static inline auto class_name = ClassName;
+
+  constexpr java_object_array() noexcept = default;
+  constexpr java_object_array(jobjectArray arr, JNIEnv *env,
+                              ref_site site = ref_site::current()) noexcept
+      : java_ref<jobjectArray, Local>{arr, env, site} {}
+  constexpr java_object_array(java_object_array &&) noexcept = default;
+  constexpr java_object_array &
+  operator=(java_object_array &&) noexcept = default;
+  constexpr java_object_array(const java_object_array &) noexcept = delete;
+  constexpr java_object_array &
+  operator=(const java_object_array &) noexcept = delete;
+};
+
 struct char_type {
   jchar value;
 };
 static_assert(sizeof(char_type) == sizeof(jchar));
 
-template <> struct ::std::char_traits<char_type> {
-  using char_type = char_type;
+template <> struct std::char_traits<char_type> {
+  using char_type = ::char_type;
   using int_type = jchar;
   using off_type = std::streamoff;
   using pos_type = std::streampos;
@@ -160,11 +188,13 @@ public:
 
 private:
   template <meta::fixed_string CN, bool> friend class java_class;
+  template <meta::fixed_string CN, class... Steps> friend class call_plan;
   friend class JVM;
 
 protected:
-  java_object(jstring obj, JNIEnv *env) noexcept
-      : java_ref<jstring, Local>{obj, env} {}
+  java_object(jstring obj, JNIEnv *env,
+              ref_site site = ref_site::current()) noexcept
+      : java_ref<jstring, Local>{obj, env, site} {}
 
 public:
   using pointer = jstring;
@@ -183,7 +213,7 @@ public:
 };
 
 template <class T>
-requires requires { T::name->meta::fixed_string; }
+requires requires { T::name; }
 using java_object_t = java_object<T::name>;
 
 template <bool L = true>
@@ -0,0 +1,303 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_PREFETCH_HPP
+#define HEADER_GUARD_DPSG_JAVA_PREFETCH_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_method.hpp"
+#include "jvm.hpp"
+#include "jvm_thread.hpp"
+#include "result.hpp"
+
+#include <jni.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <stop_token>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/** Background loading of classes and method IDs.
+ *
+ * A prefetcher resolves a list of classes, and the methods listed for each
+ * of them, on a background thread attached to the JVM, so that class loading
+ * (and optionally JIT warm-up) happens at startup instead of on the first
+ * request needing them. Entries are resolved in order; get<Class>() only
+ * blocks if the entry of Class isn't resolved yet.
+ *
+ * The resolved classes are global references bound to the JNIEnv of the
+ * thread that created the prefetcher, and must be used from that thread. The
+ * prefetcher must be destroyed before the JVM, it stops and joins the
+ * background thread.
+ *
+ * Classes are found with FindClass from a native thread, i.e. through the
+ * system class loader.
+ *
+ * @code
+ * prefetcher startup{
+ *     jvm, prefetch<GameRunner, prefetch_method<"run", void()>>(
+ *              [](java_class<GameRunner::name> &cls, const auto &entry) {
+ *                // Warm-up calls, run on the background thread
+ *              }),
+ *     prefetch<java::util::Properties>()};
+ * // ...
+ * auto &runner = startup.get<GameRunner>().value();
+ * runner.get_class().call(runner.method<"run", void()>(), obj);
+ * @endcode
+ */
+
+enum class prefetch_error {
+  /// The background thread couldn't be attached to the JVM
+  attach_failed,
+  class_not_found,
+  method_not_found,
+  /// The prefetcher was destroyed before the entry was resolved
+  stopped,
+};
+
+/// Instance method resolved along with its class
+template <meta::fixed_string Name, jni_type_desc Proto> struct prefetch_method {
+  using prototype = Proto;
+  constexpr static inline auto name = Name;
+  constexpr static inline bool is_static = false;
+  template <meta::fixed_string ClassName>
+  using handle_type = java_method<ClassName, Proto>;
+};
+
+/// Static method resolved along with its class
+template <meta::fixed_string Name, jni_type_desc Proto>
+struct prefetch_static_method {
+  using prototype = Proto;
+  constexpr static inline auto name = Name;
+  constexpr static inline bool is_static = true;
+  template <meta::fixed_string ClassName>
+  using handle_type = java_static_method<ClassName, Proto>;
+};
+
+/// A resolved entry: the class and its listed methods
+template <jni_type_desc Class, class... Methods> class prefetched_class {
+  java_class<Class::name, false> _class;
+  std::tuple<typename Methods::template handle_type<Class::name>...> _methods;
+
+  template <class... Entries> friend class prefetcher;
+  prefetched_class(
+      java_class<Class::name, false> &&cls,
+      typename Methods::template handle_type<Class::name>... methods) noexcept
+      : _class(std::move(cls)), _methods(methods...) {}
+
+  template <class M> constexpr static std::size_t index_of() noexcept {
+    std::size_t i = 0;
+    ((std::is_same_v<M, Methods> || (++i, false)) || ...);
+    return i;
+  }
+
+public:
+  using class_desc = Class;
+
+  /// Global reference to the class, bound to the JNIEnv of the thread that
+  /// created the prefetcher
+  const java_class<Class::name, false> &get_class() const noexcept {
+    return _class;
+  }
+
+  template <meta::fixed_string Name, jni_type_desc Proto>
+  java_method<Class::name, Proto>
+  method(ref_site site = ref_site::current()) const noexcept {
+    constexpr auto i = index_of<prefetch_method<Name, Proto>>();
+    static_assert(i < sizeof...(Methods),
+                  "the method isn't listed in the prefetch entry");
+    auto &m = std::get<i>(_methods);
+    return {m.id(), m.label(), site};
+  }
+
+  template <meta::fixed_string Name, jni_type_desc Proto>
+  java_static_method<Class::name, Proto>
+  static_method(ref_site site = ref_site::current()) const noexcept {
+    constexpr auto i = index_of<prefetch_static_method<Name, Proto>>();
+    static_assert(i < sizeof...(Methods),
+                  "the method isn't listed in the prefetch entry");
+    auto &m = std::get<i>(_methods);
+    return {m.id(), m.label(), site};
+  }
+};
+
+/// Class to prefetch, see prefetch()
+template <jni_type_desc Class, class... Methods> struct prefetch_entry {
+  using class_desc = Class;
+  using value_type = prefetched_class<Class, Methods...>;
+  using warm_up_type =
+      std::function<void(java_class<Class::name> &, const value_type &)>;
+
+  /// Called on the background thread once every entry is resolved, with a
+  /// local reference to the class usable on that thread. Java exceptions are
+  /// cleared afterwards, C++ exceptions must not escape.
+  warm_up_type warm_up;
+};
+
+/// Entry loading Class and resolving Methods (prefetch_method and
+/// prefetch_static_method), with an optional warm-up callback
+template <jni_type_desc Class, class... Methods>
+prefetch_entry<Class, Methods...>
+prefetch(typename prefetch_entry<Class, Methods...>::warm_up_type warm_up = {}) {
+  return {std::move(warm_up)};
+}
+
+template <class... Entries> class prefetcher {
+  template <class E>
+  using result_of = dpsg::result<typename E::value_type, prefetch_error>;
+
+  std::tuple<std::shared_future<result_of<Entries>>...> _ready;
+  // Last member: stopped and joined before the results are destroyed
+  std::jthread _thread;
+
+  template <jni_type_desc Class> constexpr static std::size_t index_of() {
+    std::size_t i = 0;
+    ((std::is_same_v<Class, typename Entries::class_desc> || (++i, false)) ||
+     ...);
+    return i;
+  }
+
+  template <jni_type_desc Class>
+  using entry_for =
+      std::tuple_element_t<index_of<Class>(), std::tuple<Entries...>>;
+
+  template <class Method>
+  static jmethodID _method_id(JNIEnv &env, jclass cls) noexcept {
+    constexpr auto &proto = jni_desc<typename Method::prototype>::name;
+    return Method::is_static ? env.GetStaticMethodID(cls, Method::name, proto)
+                             : env.GetMethodID(cls, Method::name, proto);
+  }
+
+  template <jni_type_desc Class, class... Methods>
+  static result_of<prefetch_entry<Class, Methods...>>
+  _resolve(JNIEnv &env, JNIEnv *owner,
+           const prefetch_entry<Class, Methods...> &entry) {
+    return _resolve(env, owner, entry, std::index_sequence_for<Methods...>{});
+  }
+
+  template <jni_type_desc Class, class... Methods, std::size_t... Is>
+  static result_of<prefetch_entry<Class, Methods...>>
+  _resolve(JNIEnv &env, JNIEnv *owner, const prefetch_entry<Class, Methods...> &,
+           std::index_sequence<Is...>) {
+    using result_type = result_of<prefetch_entry<Class, Methods...>>;
+    jclass local = env.FindClass(Class::name);
+    if (local == nullptr) {
+      env.ExceptionClear();
+      return result_type{dpsg::in_place_error, prefetch_error::class_not_found};
+    }
+    // Stops at the first missing method, its exception is pending
+    std::array<jmethodID, sizeof...(Methods)> ids{};
+    if (!(((ids[Is] = _method_id<Methods>(env, local)) != nullptr) && ...)) {
+      env.ExceptionClear();
+      env.DeleteLocalRef(local);
+      return result_type{dpsg::in_place_error,
+                         prefetch_error::method_not_found};
+    }
+    auto global = (jclass)env.NewGlobalRef(local);
+    env.DeleteLocalRef(local);
+    return result_type{
+        dpsg::in_place_value,
+        prefetched_class<Class, Methods...>{
+            java_class<Class::name, false>{global, owner},
+            typename Methods::template handle_type<Class::name>{
+                ids[Is], detail::method_label<Class::name, Methods::name,
+                                              typename Methods::prototype>()}...}};
+  }
+
+  template <jni_type_desc Class, class... Methods>
+  static void _warm_up(JNIEnv &env, const prefetch_entry<Class, Methods...> &entry,
+                       const result_of<prefetch_entry<Class, Methods...>> &resolved) {
+    if (!entry.warm_up || !resolved || env.PushLocalFrame(16) != JNI_OK) {
+      return;
+    }
+    {
+      java_class<Class::name> cls{
+          (jclass)env.NewLocalRef(resolved.value().get_class().get()), &env};
+      entry.warm_up(cls, resolved.value());
+    }
+    env.ExceptionClear();
+    env.PopLocalFrame(nullptr);
+  }
+
+  template <std::size_t... Is>
+  static void _run(std::stop_token stop, JavaVM *vm, JNIEnv *owner,
+                   std::tuple<std::promise<result_of<Entries>>...> &promises,
+                   const std::tuple<Entries...> &entries,
+                   const std::tuple<std::shared_future<result_of<Entries>>...> &ready,
+                   std::index_sequence<Is...>) {
+    auto thread = attached_thread::attach(*vm, "jni-cpp20-prefetch", true);
+    if (!thread) {
+      (std::get<Is>(promises).set_value(result_of<Entries>{
+           dpsg::in_place_error, prefetch_error::attach_failed}),
+       ...);
+      return;
+    }
+    auto &env = thread.value().get_env();
+    auto resolve = [&]<std::size_t I>(std::integral_constant<std::size_t, I>) {
+      using entry = std::tuple_element_t<I, std::tuple<Entries...>>;
+      if (stop.stop_requested()) {
+        std::get<I>(promises).set_value(
+            result_of<entry>{dpsg::in_place_error, prefetch_error::stopped});
+      } else {
+        std::get<I>(promises).set_value(
+            _resolve(env, owner, std::get<I>(entries)));
+      }
+    };
+    (resolve(std::integral_constant<std::size_t, Is>{}), ...);
+    ((stop.stop_requested() ||
+      (_warm_up(env, std::get<Is>(entries), std::get<Is>(ready).get()), true)),
+     ...);
+  }
+
+public:
+  /// Starts resolving entries on a background thread
+  explicit prefetcher(JVM &jvm, Entries... entries) {
+    std::tuple<std::promise<result_of<Entries>>...> promises;
+    _ready = std::apply(
+        [](auto &...p) {
+          return std::tuple{p.get_future().share()...};
+        },
+        promises);
+    _thread = std::jthread{
+        [vm = jvm.get_vm(), owner = &jvm.get_env(),
+         promises = std::move(promises),
+         entries = std::tuple<Entries...>{std::move(entries)...},
+         ready = _ready](std::stop_token stop) mutable {
+          _run(stop, vm, owner, promises, entries, ready,
+               std::index_sequence_for<Entries...>{});
+        }};
+  }
+
+  prefetcher(prefetcher &&) noexcept = default;
+  prefetcher &operator=(prefetcher &&) noexcept = default;
+  prefetcher(const prefetcher &) = delete;
+  prefetcher &operator=(const prefetcher &) = delete;
+
+  /// The entry of Class, blocks until it is resolved
+  template <jni_type_desc Class>
+  const result_of<entry_for<Class>> &get() const {
+    static_assert(index_of<Class>() < sizeof...(Entries),
+                  "the class isn't listed in the prefetcher");
+    return std::get<index_of<Class>()>(_ready).get();
+  }
+
+  /// True if get<Class>() wouldn't block
+  template <jni_type_desc Class> bool ready() const {
+    return std::get<index_of<Class>()>(_ready).wait_for(
+               std::chrono::seconds{0}) == std::future_status::ready;
+  }
+
+  /// Blocks until every entry is resolved
+  void wait() const {
+    std::apply([](const auto &...f) { (f.wait(), ...); }, _ready);
+  }
+};
+
+template <class... Entries>
+prefetcher(JVM &, Entries...) -> prefetcher<Entries...>;
+
+#endif // HEADER_GUARD_DPSG_JAVA_PREFETCH_HPP
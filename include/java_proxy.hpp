@@ -0,0 +1,402 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_PROXY_HPP
+#define HEADER_GUARD_DPSG_JAVA_PROXY_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "java_object.hpp"
+#include "java_ref.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Java objects implementing an interface with C++ callables.
+ *
+ * The object is a java.lang.reflect.Proxy whose invocation handler,
+ * dpsg.jni.NativeInvocationHandler (java/ directory, built into
+ * ${JNI_CPP20_JAR}), maps every method of the interface to an index once,
+ * when the proxy is created. A call is then a hash lookup on the Java side
+ * and a single native call, `invoke0(handle, index, args)`, registered once
+ * with RegisterNatives. The handle selects the dispatch table of the proxy,
+ * the index the callable in it. No reflection happens per call.
+ *
+ * Callables receive the arguments as java.lang.reflect.Proxy passes them
+ * (primitives are boxed) and return void, a jobject or a java_ref. Primitive
+ * return values must be returned boxed. C++ exceptions are rethrown in Java
+ * as RuntimeException.
+ *
+ * @code
+ * auto proxies = unwrap(proxy_factory::create(jvm));
+ * int turns = 0;
+ * auto listener = unwrap(proxies.create<java::lang::Runnable>(
+ *     proxy_method<"run", void()>([&](proxy_args) { ++turns; })));
+ * engine_cls.call(set_listener, engine, listener.local());
+ * @endcode
+ *
+ * Destroying the java_proxy releases its dispatch table: calls made
+ * afterwards through Java references still alive throw an
+ * IllegalStateException.
+ */
+
+namespace java {
+namespace lang {
+using Runnable = java_class_desc<"java/lang/Runnable">;
+namespace reflect {
+using Proxy = java_class_desc<"java/lang/reflect/Proxy">;
+using InvocationHandler = java_class_desc<"java/lang/reflect/InvocationHandler">;
+} // namespace reflect
+} // namespace lang
+} // namespace java
+
+namespace dpsg::jni {
+using NativeInvocationHandler =
+    java_class_desc<"dpsg/jni/NativeInvocationHandler">;
+} // namespace dpsg::jni
+
+/// Arguments of a proxied call
+class proxy_args {
+  JNIEnv *_env;
+  jobjectArray _args;
+
+public:
+  proxy_args(JNIEnv *env, jobjectArray args) noexcept
+      : _env(env), _args(args) {}
+
+  JNIEnv &env() const noexcept { return *_env; }
+
+  /// Methods without parameters receive a null array
+  jsize size() const noexcept {
+    return _args == nullptr ? 0 : _env->GetArrayLength(_args);
+  }
+
+  java_ref<jobject> operator[](jsize i) const noexcept {
+    return java_ref<jobject>{_env->GetObjectArrayElement(_args, i), _env};
+  }
+};
+
+using proxy_callback = std::function<jobject(proxy_args)>;
+
+namespace detail {
+using proxy_table = std::vector<proxy_callback>;
+
+// Dispatch tables of the live proxies. Handles are a slot index in the low
+// half and the generation of the slot in the high half, so that a handle
+// outliving its proxy can't reach the table of a newer one.
+class proxy_registry {
+  struct slot {
+    std::uint32_t generation = 0;
+    std::shared_ptr<const proxy_table> table;
+  };
+
+  std::shared_mutex _mutex;
+  std::vector<slot> _slots;
+  std::vector<std::uint32_t> _free;
+
+  static std::uint32_t index_of(jlong handle) noexcept {
+    return (std::uint32_t)((std::uint64_t)handle & 0xFFFFFFFF);
+  }
+  static std::uint32_t generation_of(jlong handle) noexcept {
+    return (std::uint32_t)((std::uint64_t)handle >> 32);
+  }
+
+public:
+  static proxy_registry &instance() {
+    static proxy_registry registry;
+    return registry;
+  }
+
+  jlong add(std::shared_ptr<const proxy_table> table) {
+    std::unique_lock lock{_mutex};
+    std::uint32_t index;
+    if (_free.empty()) {
+      index = (std::uint32_t)_slots.size();
+      _slots.emplace_back();
+    } else {
+      index = _free.back();
+      _free.pop_back();
+    }
+    auto &s = _slots[index];
+    s.table = std::move(table);
+    return (jlong)(((std::uint64_t)s.generation << 32) | index);
+  }
+
+  void remove(jlong handle) {
+    std::unique_lock lock{_mutex};
+    auto index = index_of(handle);
+    if (index >= _slots.size() ||
+        _slots[index].generation != generation_of(handle)) {
+      return;
+    }
+    _slots[index].table.reset();
+    ++_slots[index].generation;
+    _free.push_back(index);
+  }
+
+  std::shared_ptr<const proxy_table> find(jlong handle) {
+    std::shared_lock lock{_mutex};
+    auto index = index_of(handle);
+    if (index >= _slots.size() ||
+        _slots[index].generation != generation_of(handle)) {
+      return nullptr;
+    }
+    return _slots[index].table;
+  }
+};
+
+inline jobject JNICALL proxy_trampoline(JNIEnv *env, jclass, jlong handle,
+                                        jint index, jobjectArray args) {
+  auto table = proxy_registry::instance().find(handle);
+  if (table == nullptr || index < 0 || (std::size_t)index >= table->size()) {
+    env->ThrowNew(env->FindClass("java/lang/IllegalStateException"),
+                  "the native side of this proxy has been destroyed");
+    return nullptr;
+  }
+  try {
+    return (*table)[index](proxy_args{env, args});
+  } catch (const std::exception &e) {
+    env->ThrowNew(env->FindClass("java/lang/RuntimeException"), e.what());
+  } catch (...) {
+    env->ThrowNew(env->FindClass("java/lang/RuntimeException"),
+                  "unknown C++ exception");
+  }
+  return nullptr;
+}
+
+template <class F> proxy_callback make_proxy_callback(F &&f) {
+  return [f = std::forward<F>(f)](proxy_args args) mutable -> jobject {
+    using R = std::invoke_result_t<F &, proxy_args>;
+    if constexpr (std::is_void_v<R>) {
+      std::invoke(f, args);
+      return nullptr;
+    } else if constexpr (std::is_convertible_v<R, jobject>) {
+      return std::invoke(f, args);
+    } else {
+      auto ret = std::invoke(f, args);
+      if constexpr (R::is_local) {
+        return (jobject)ret.release();
+      } else {
+        return args.env().NewLocalRef(ret.get());
+      }
+    }
+  };
+}
+
+template <meta::fixed_string Name, jni_type_desc Proto, class F>
+struct proxy_entry {
+  constexpr static inline auto key = Name + jni_desc<Proto>::name;
+  F callable;
+};
+} // namespace detail
+
+/// Binds the method Name with prototype Proto of the interface to f
+template <meta::fixed_string Name, jni_type_desc Proto, class F>
+  requires std::is_invocable_v<F &, proxy_args>
+detail::proxy_entry<Name, Proto, std::decay_t<F>> proxy_method(F &&f) {
+  return {std::forward<F>(f)};
+}
+
+/// Owner of a proxy object and of its dispatch table
+template <jni_type_desc Interface> class java_proxy {
+  java_ref<jobject, false> _object;
+  jlong _handle = 0;
+
+  friend class proxy_factory;
+  java_proxy(java_ref<jobject, false> &&object, jlong handle) noexcept
+      : _object(std::move(object)), _handle(handle) {}
+
+public:
+  java_proxy(java_proxy &&other) noexcept
+      : _object(std::move(other._object)),
+        _handle(std::exchange(other._handle, 0)) {}
+  java_proxy &operator=(java_proxy &&other) noexcept {
+    std::swap(_object, other._object);
+    std::swap(_handle, other._handle);
+    return *this;
+  }
+  java_proxy(const java_proxy &) = delete;
+  java_proxy &operator=(const java_proxy &) = delete;
+
+  ~java_proxy() {
+    if (_object) {
+      detail::proxy_registry::instance().remove(_handle);
+    }
+  }
+
+  jobject get() const noexcept { return _object.get(); }
+
+  /// A local reference to the proxy, to pass it to java_class::call
+  java_object<Interface::name>
+  local(ref_site site = ref_site::current()) const noexcept {
+    return java_object<Interface::name>{_object.env().NewLocalRef(get()),
+                                        _object.get_env(), site};
+  }
+};
+
+/// Creates java_proxy objects. The class dpsg.jni.NativeInvocationHandler
+/// must be on the class path of the JVM.
+class proxy_factory {
+  JNIEnv *_env;
+  java_class<dpsg::jni::NativeInvocationHandler::name, false> _handler;
+  java_class<java::lang::reflect::Proxy::name, false> _proxy;
+  java_class<java::lang::String::name, false> _string;
+  java_class<java::lang::Class::name, false> _class;
+  jmethodID _handler_ctor;
+  jmethodID _new_proxy_instance;
+  jmethodID _get_class_loader;
+
+  proxy_factory(
+      JNIEnv *env,
+      java_class<dpsg::jni::NativeInvocationHandler::name, false> &&handler,
+      java_class<java::lang::reflect::Proxy::name, false> &&proxy,
+      java_class<java::lang::String::name, false> &&string,
+      java_class<java::lang::Class::name, false> &&cls, jmethodID handler_ctor,
+      jmethodID new_proxy_instance, jmethodID get_class_loader) noexcept
+      : _env(env), _handler(std::move(handler)), _proxy(std::move(proxy)),
+        _string(std::move(string)), _class(std::move(cls)),
+        _handler_ctor(handler_ctor), _new_proxy_instance(new_proxy_instance),
+        _get_class_loader(get_class_loader) {}
+
+  template <jni_type_desc Interface, bool L, class... Entries>
+  std::optional<java_proxy<Interface>>
+  _create(const java_class<Interface::name, L> &iface, Entries &&...entries) {
+    auto keys = java_ref<jobjectArray>{
+        _env->NewObjectArray((jsize)sizeof...(Entries), _string.get(),
+                             nullptr),
+        _env};
+    if (keys == nullptr) {
+      return std::nullopt;
+    }
+    jsize i = 0;
+    (_env->SetObjectArrayElement(
+         keys.get(), i++,
+         java_ref<jstring>{_env->NewStringUTF(std::remove_cvref_t<
+                                              Entries>::key),
+                           _env}
+             .get()),
+     ...);
+    if (_env->ExceptionCheck()) {
+      return std::nullopt;
+    }
+
+    auto handle = detail::proxy_registry::instance().add(
+        std::make_shared<const detail::proxy_table>(detail::proxy_table{
+            detail::make_proxy_callback(
+                std::forward<Entries>(entries).callable)...}));
+    auto release_table = [&] {
+      detail::proxy_registry::instance().remove(handle);
+      return std::nullopt;
+    };
+
+    auto handler = java_ref<jobject>{
+        _env->NewObject(_handler.get(), _handler_ctor, handle, iface.get(),
+                        keys.get()),
+        _env};
+    if (handler == nullptr) {
+      return release_table();
+    }
+    auto interfaces = java_ref<jobjectArray>{
+        _env->NewObjectArray(1, _class.get(), iface.get()), _env};
+    if (interfaces == nullptr) {
+      return release_table();
+    }
+    auto loader = java_ref<jobject>{
+        _env->CallObjectMethod(iface.get(), _get_class_loader), _env};
+    if (_env->ExceptionCheck()) {
+      return release_table();
+    }
+    auto proxy = java_ref<jobject>{
+        _env->CallStaticObjectMethod(_proxy.get(), _new_proxy_instance,
+                                     loader.get(), interfaces.get(),
+                                     handler.get()),
+        _env};
+    if (_env->ExceptionCheck() || proxy == nullptr) {
+      return release_table();
+    }
+    return java_proxy<Interface>{proxy.promote(), handle};
+  }
+
+public:
+  /// Resolves the classes and methods used to create proxies, and registers
+  /// the native trampoline. Returns std::nullopt if
+  /// dpsg.jni.NativeInvocationHandler can't be found.
+  static std::optional<proxy_factory> create(JVM &jvm) {
+    auto handler = jvm.find_class<dpsg::jni::NativeInvocationHandler>();
+    auto proxy = jvm.find_class<java::lang::reflect::Proxy>();
+    auto string = jvm.find_class<java::lang::String>();
+    auto cls = jvm.find_class<java::lang::Class>();
+    if (!handler || !proxy || !string || !cls) {
+      return std::nullopt;
+    }
+    auto handler_ctor =
+        handler->get_constructor_id<long, java::lang::Class,
+                                    java_array_desc<java::lang::String>>();
+    auto new_proxy_instance = proxy->get_static_method_id<
+        "newProxyInstance",
+        java::lang::Object(java::lang::ClassLoader,
+                           java_array_desc<java::lang::Class>,
+                           java::lang::reflect::InvocationHandler)>();
+    auto get_class_loader =
+        cls->get_method_id<"getClassLoader", java::lang::ClassLoader()>();
+    if (!handler_ctor || !new_proxy_instance || !get_class_loader) {
+      return std::nullopt;
+    }
+
+    constexpr static auto invoke0_desc =
+        jni_desc<java::lang::Object(
+            long, int, java_array_desc<java::lang::Object>)>::name;
+    JNINativeMethod natives[] = {
+        {const_cast<char *>("invoke0"), const_cast<char *>(invoke0_desc.data),
+         (void *)&detail::proxy_trampoline},
+    };
+    if (jvm->RegisterNatives(handler->get(), natives, 1) != JNI_OK) {
+      return std::nullopt;
+    }
+
+    return proxy_factory{&*jvm,
+                         handler->promote(),
+                         proxy->promote(),
+                         string->promote(),
+                         cls->promote(),
+                         handler_ctor->id(),
+                         new_proxy_instance->id(),
+                         get_class_loader->id()};
+  }
+
+  /** @brief Creates an object implementing Interface.
+   *
+   * @param[in] entries One proxy_method per implemented method. Methods of
+   * the interface without an entry throw UnsupportedOperationException.
+   *
+   * @return The proxy, std::nullopt on failure (a Java exception may be
+   * pending).
+   */
+  template <jni_type_desc Interface, class... Entries>
+  std::optional<java_proxy<Interface>> create(Entries &&...entries) {
+    auto iface =
+        java_class<Interface::name>{_env->FindClass(Interface::name), _env};
+    if (iface == nullptr) {
+      return std::nullopt;
+    }
+    return _create<Interface>(iface, std::forward<Entries>(entries)...);
+  }
+
+  /// Same as above, for interfaces that FindClass can't see (e.g. loaded by
+  /// a java_class_loader)
+  template <jni_type_desc Interface, bool L, class... Entries>
+  std::optional<java_proxy<Interface>>
+  create(const java_class<Interface::name, L> &iface, Entries &&...entries) {
+    return _create<Interface>(iface, std::forward<Entries>(entries)...);
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_PROXY_HPP
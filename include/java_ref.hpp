@@ -1,6 +1,8 @@
 #ifndef HEADER_GUARD_DPSG_JAVA_REF_HPP
 #define HEADER_GUARD_DPSG_JAVA_REF_HPP
 
+#include "ref_tracker.hpp"
+
 #include <jni.h>
 
 #include <memory>
@@ -26,7 +28,20 @@ public:
   constexpr deleter(const deleter &) noexcept = delete;
   constexpr deleter &operator=(const deleter &) noexcept = default;
   constexpr ~deleter() noexcept = default;
-  template <class T> void operator()(T ptr) const noexcept { (env->*f)(ptr); }
+  template <class T> void operator()(T ptr) const noexcept {
+    ref_tracker::untrack(ptr, kind());
+    (env->*f)(ptr);
+  }
+
+  ref_kind kind() const noexcept {
+    if (f == &JNIEnv_::DeleteLocalRef) {
+      return ref_kind::local;
+    }
+    if (f == &JNIEnv_::DeleteWeakGlobalRef) {
+      return ref_kind::weak;
+    }
+    return ref_kind::global;
+  }
 };
 
 template <class T, bool LocalPtr = true> class java_ref {
@@ -43,9 +58,15 @@ template <class T, bool LocalPtr = true> class java_ref {
   }
 
 public:
+  constexpr static inline bool is_local = LocalPtr;
+
   constexpr java_ref() noexcept : _ptr(), _env(nullptr) {}
-  constexpr java_ref(T ptr, JNIEnv *env) noexcept
-      : _ptr(ptr, deleter{env, java_ref::deleter_for()}), _env(env) {}
+  constexpr java_ref(T ptr, JNIEnv *env,
+                     ref_site site = ref_site::current()) noexcept
+      : _ptr(ptr, deleter{env, java_ref::deleter_for()}), _env(env) {
+    ref_tracker::track(ptr, LocalPtr ? ref_kind::local : ref_kind::global,
+                       site);
+  }
   constexpr java_ref(java_ref &&ref) noexcept
       : _ptr(std::exchange(ref._ptr, nullptr)),
         _env(std::exchange(ref._env, nullptr)) {}
@@ -68,9 +89,17 @@ public:
   constexpr JNIEnv &env() const noexcept { return *_env; }
   constexpr JNIEnv *get_env() const noexcept { return _env; }
 
-  constexpr java_ref<T, false> promote() const noexcept {
+  /// Gives up ownership of the reference without deleting it (e.g. to return
+  /// it from a native method)
+  constexpr T release() noexcept {
+    ref_tracker::untrack(get(), _ptr.get_deleter().kind());
+    return _ptr.release();
+  }
+
+  constexpr java_ref<T, false>
+  promote(ref_site site = ref_site::current()) const noexcept {
     static_assert(LocalPtr, "Cannot promote a global reference");
-    return java_ref<T, false>((jclass)_env->NewGlobalRef(get()), _env);
+    return java_ref<T, false>((T)_env->NewGlobalRef(get()), _env, site);
   }
 
   friend bool operator==(const java_ref &lhs, const java_ref &rhs) noexcept {
@@ -96,8 +125,9 @@ public:
 
 template <class T>
 requires JNIObject<T>
-constexpr java_ref<T> make_java_ref(T ptr, JNIEnv *env) noexcept {
-  return java_ref<T>{ptr, env};
+constexpr java_ref<T> make_java_ref(T ptr, JNIEnv *env,
+                                    ref_site site = ref_site::current()) noexcept {
+  return java_ref<T>{ptr, env, site};
 }
 
 #endif // HEADER_GUARD_DPSG_JAVA_REF_HPP
@@ -0,0 +1,450 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_RING_HPP
+#define HEADER_GUARD_DPSG_JAVA_RING_HPP
+
+#include "dsl.hpp"
+#include "java_mapped.hpp"
+#include "java_object.hpp"
+#include "java_ref.hpp"
+#include "jni_call.hpp"
+#include "jvm.hpp"
+
+#include <jni.h>
+
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/** Message channel between C++ and Java over shared memory.
+ *
+ * A ring is a single-producer, single-consumer queue of messages stored in
+ * memory both sides can see (a direct ByteBuffer on the Java side, see
+ * java_mapped.hpp). The producer and the consumer only exchange two
+ * positions, each written by one side alone: sending and receiving a
+ * message never crosses JNI. The only calls across are wakeups, made when
+ * the consumer announced that it is going to sleep.
+ *
+ * Layout of a ring (native byte order, must match
+ * java/dpsg/jni/RingBuffer.java):
+ *
+ *     0    int32 capacity of the data area, a power of two
+ *     4    int32 magic
+ *     64   int64 write position, written by the producer
+ *     128  int64 read position, written by the consumer
+ *     192  int32 waiting flag, set by a consumer about to sleep
+ *     196  int32 wakeup counter, native consumers wait on it
+ *     256  data
+ *
+ * Positions only grow, they are taken modulo the capacity. Messages are
+ * frames of an int32 payload size, an int32 type (non-negative) and the
+ * payload, padded to 8 bytes. A frame never wraps: the producer fills the
+ * end of the data area with a padding frame (type -1) instead.
+ *
+ * Messages written with try_write are only visible to the consumer after
+ * commit(), which publishes every message written since the previous one.
+ * The consumer releases the space of the messages it polled in one store at
+ * the end of poll().
+ *
+ * ring_channel ties two rings (C++ to Java and Java to C++) to the
+ * dpsg.jni.RingBuffer objects of the Java side (java/ directory, built into
+ * ${JNI_CPP20_JAR}).
+ *
+ * @code
+ * auto channel = unwrap(ring_channel::create(jvm, 1 << 16));
+ * engine_cls.call(connect, engine, channel.java_reader(),
+ *                 channel.java_writer());
+ * channel.writer().try_write(msg::move, move{12, 28});
+ * channel.commit(*jvm);
+ * channel.reader().poll([](const ring_message &m) {
+ *   if (auto score = m.as<int>()) { ... }
+ * });
+ * @endcode
+ */
+
+namespace dpsg::jni {
+using RingBuffer = java_class_desc<"dpsg/jni/RingBuffer">;
+} // namespace dpsg::jni
+
+namespace detail::ring {
+constexpr inline std::size_t capacity_offset = 0;
+constexpr inline std::size_t magic_offset = 4;
+constexpr inline std::size_t write_offset = 64;
+constexpr inline std::size_t read_offset = 128;
+constexpr inline std::size_t waiting_offset = 192;
+constexpr inline std::size_t signal_offset = 196;
+constexpr inline std::size_t header_size = 256;
+constexpr inline std::size_t frame_header = 8;
+
+constexpr inline std::int32_t magic = 0x474e4952; // "RING"
+constexpr inline std::int32_t padding = -1;
+
+constexpr std::size_t frame_size(std::size_t payload) noexcept {
+  return (frame_header + payload + 7) & ~std::size_t{7};
+}
+
+template <class T> std::atomic_ref<T> at(std::byte *base, std::size_t offset) {
+  return std::atomic_ref<T>{*reinterpret_cast<T *>(base + offset)};
+}
+
+inline std::int32_t load_int(const std::byte *p) noexcept {
+  std::int32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline void store_int(std::byte *p, std::int32_t value) noexcept {
+  std::memcpy(p, &value, sizeof(value));
+}
+
+inline void signal(std::byte *base) noexcept {
+  auto counter = at<std::int32_t>(base, signal_offset);
+  counter.fetch_add(1, std::memory_order_release);
+  counter.notify_all();
+}
+} // namespace detail::ring
+
+/// Bytes of memory used by a ring with a data area of capacity bytes
+constexpr std::size_t ring_size(std::size_t capacity) noexcept {
+  return detail::ring::header_size + capacity;
+}
+
+/** @brief Formats memory as an empty ring.
+ *
+ * @details The data area is the largest power of two that fits. memory must
+ * be 8-byte aligned. Returns the capacity, 0 if memory is too small.
+ */
+inline std::size_t format_ring(std::span<std::byte> memory) noexcept {
+  using namespace detail::ring;
+  assert((std::uintptr_t)memory.data() % 8 == 0 && "in call to format_ring");
+  if (memory.size() < header_size + 2 * frame_header) {
+    return 0;
+  }
+  auto capacity =
+      std::min(std::bit_floor(memory.size() - header_size), std::size_t{1} << 30);
+  std::memset(memory.data(), 0, header_size);
+  store_int(memory.data() + capacity_offset, (std::int32_t)capacity);
+  store_int(memory.data() + magic_offset, magic);
+  return capacity;
+}
+
+/// A message read from a ring, valid until its handler returns
+struct ring_message {
+  std::int32_t type;
+  std::span<const std::byte> payload;
+
+  /// The payload as a T, std::nullopt if the sizes don't match
+  template <class T>
+    requires std::is_trivially_copyable_v<T>
+  std::optional<T> as() const noexcept {
+    if (payload.size() != sizeof(T)) {
+      return std::nullopt;
+    }
+    T value;
+    std::memcpy(&value, payload.data(), sizeof(T));
+    return value;
+  }
+
+  std::string_view as_string() const noexcept {
+    return {(const char *)payload.data(), payload.size()};
+  }
+};
+
+/// Producer side of a ring formatted by format_ring
+class ring_writer {
+  std::byte *_base = nullptr;
+  std::byte *_data = nullptr;
+  std::size_t _capacity = 0;
+  // Position of the next frame, published by commit()
+  std::int64_t _write = 0;
+  // Last read position seen, the space before it is free
+  std::int64_t _read = 0;
+
+  bool _reserve(std::size_t size) noexcept {
+    if (_capacity - (std::size_t)(_write - _read) >= size) {
+      return true;
+    }
+    _read = detail::ring::at<std::int64_t>(_base, detail::ring::read_offset)
+                .load(std::memory_order_acquire);
+    return _capacity - (std::size_t)(_write - _read) >= size;
+  }
+
+public:
+  ring_writer() noexcept = default;
+  explicit ring_writer(std::span<std::byte> memory) noexcept
+      : _base(memory.data()), _data(memory.data() + detail::ring::header_size),
+        _capacity((std::size_t)detail::ring::load_int(
+            memory.data() + detail::ring::capacity_offset)) {
+    using namespace detail::ring;
+    assert(load_int(_base + magic_offset) == magic &&
+           "in ring_writer constructor, memory isn't a ring");
+    _write = at<std::int64_t>(_base, write_offset).load(std::memory_order_relaxed);
+    _read = at<std::int64_t>(_base, read_offset).load(std::memory_order_acquire);
+  }
+
+  std::size_t capacity() const noexcept { return _capacity; }
+
+  /// Largest payload of a message. Half of the capacity, so that a message
+  /// always fits in an empty ring even when it has to wrap.
+  std::size_t max_payload() const noexcept {
+    return _capacity / 2 - detail::ring::frame_header;
+  }
+
+  /// Writes a message, invisible to the consumer until commit(). Returns
+  /// false if the ring is full or the payload larger than max_payload().
+  bool try_write(std::int32_t type, std::span<const std::byte> payload) noexcept {
+    using namespace detail::ring;
+    assert(type >= 0 && "in call to ring_writer::try_write");
+    if (payload.size() > max_payload()) {
+      return false;
+    }
+    auto frame = frame_size(payload.size());
+    auto pos = (std::size_t)_write & (_capacity - 1);
+    auto to_end = _capacity - pos;
+    if (!_reserve(frame <= to_end ? frame : to_end + frame)) {
+      return false;
+    }
+    if (frame > to_end) {
+      store_int(_data + pos, (std::int32_t)(to_end - frame_header));
+      store_int(_data + pos + 4, padding);
+      _write += (std::int64_t)to_end;
+      pos = 0;
+    }
+    store_int(_data + pos, (std::int32_t)payload.size());
+    store_int(_data + pos + 4, type);
+    if (!payload.empty()) {
+      std::memcpy(_data + pos + frame_header, payload.data(), payload.size());
+    }
+    _write += (std::int64_t)frame;
+    return true;
+  }
+
+  template <class T>
+    requires std::is_trivially_copyable_v<T>
+  bool try_write(std::int32_t type, const T &value) noexcept {
+    return try_write(type, std::as_bytes(std::span{&value, 1}));
+  }
+
+  bool try_write(std::int32_t type, std::string_view text) noexcept {
+    return try_write(type, std::as_bytes(std::span{text}));
+  }
+
+  /** @brief Publishes the messages written since the last commit.
+   *
+   * @details Wakes native consumers waiting in ring_reader::wait. Returns
+   * true if the consumer was waiting, in which case a Java consumer must be
+   * woken as well (ring_channel::commit does it).
+   */
+  bool commit() noexcept {
+    using namespace detail::ring;
+    // seq_cst on both sides: either the consumer sees the new position, or
+    // the producer sees the waiting flag
+    at<std::int64_t>(_base, write_offset).store(_write, std::memory_order_seq_cst);
+    if (at<std::int32_t>(_base, waiting_offset).load(std::memory_order_seq_cst) ==
+        0) {
+      return false;
+    }
+    signal(_base);
+    return true;
+  }
+};
+
+/// Consumer side of a ring formatted by format_ring
+class ring_reader {
+  std::byte *_base = nullptr;
+  std::byte *_data = nullptr;
+  std::size_t _capacity = 0;
+  std::int64_t _read = 0;
+
+  std::int64_t _published(std::memory_order order) const noexcept {
+    return detail::ring::at<std::int64_t>(_base, detail::ring::write_offset)
+        .load(order);
+  }
+
+public:
+  ring_reader() noexcept = default;
+  explicit ring_reader(std::span<std::byte> memory) noexcept
+      : _base(memory.data()), _data(memory.data() + detail::ring::header_size),
+        _capacity((std::size_t)detail::ring::load_int(
+            memory.data() + detail::ring::capacity_offset)) {
+    using namespace detail::ring;
+    assert(load_int(_base + magic_offset) == magic &&
+           "in ring_reader constructor, memory isn't a ring");
+    _read = at<std::int64_t>(_base, read_offset).load(std::memory_order_relaxed);
+  }
+
+  std::size_t capacity() const noexcept { return _capacity; }
+
+  /// Whether no committed message is left to poll
+  bool empty() const noexcept {
+    return _published(std::memory_order_acquire) == _read;
+  }
+
+  /** @brief Calls f(const ring_message&) on at most max committed messages.
+   *
+   * @details Their space is released once f returned for the last of them.
+   * Returns the number of messages handled.
+   */
+  template <class F>
+  std::size_t poll(F &&f, std::size_t max = (std::size_t)-1) {
+    using namespace detail::ring;
+    auto published = _published(std::memory_order_acquire);
+    auto read = _read;
+    std::size_t count = 0;
+    while (read != published && count < max) {
+      auto pos = (std::size_t)read & (_capacity - 1);
+      auto size = (std::size_t)load_int(_data + pos);
+      auto type = load_int(_data + pos + 4);
+      if (type == padding) {
+        read += (std::int64_t)(frame_header + size);
+        continue;
+      }
+      f(ring_message{type, {_data + pos + frame_header, size}});
+      read += (std::int64_t)frame_size(size);
+      ++count;
+    }
+    if (read != _read) {
+      _read = read;
+      at<std::int64_t>(_base, read_offset).store(read, std::memory_order_release);
+    }
+    return count;
+  }
+
+  /** @brief Blocks until a message is committed or notify() is called.
+   *
+   * @details May return spuriously, callers poll in a loop.
+   */
+  void wait() noexcept {
+    using namespace detail::ring;
+    auto counter = at<std::int32_t>(_base, signal_offset);
+    auto seen = counter.load(std::memory_order_acquire);
+    auto waiting = at<std::int32_t>(_base, waiting_offset);
+    waiting.store(1, std::memory_order_seq_cst);
+    if (_published(std::memory_order_seq_cst) == _read) {
+      counter.wait(seen, std::memory_order_acquire);
+    }
+    waiting.store(0, std::memory_order_relaxed);
+  }
+
+  /// Wakes the thread blocked in wait(), e.g. to shut it down
+  void notify() noexcept { detail::ring::signal(_base); }
+};
+
+namespace detail {
+// RingBuffer.wake0, called by Java producers when the native consumer waits
+inline void JNICALL ring_wake(JNIEnv *, jclass, jlong base) {
+  ring::signal(reinterpret_cast<std::byte *>((std::intptr_t)base));
+}
+} // namespace detail
+
+/** @brief Pair of rings between C++ and Java in one anonymous mapping.
+ *
+ * @details The Java side reads java_reader() and writes java_writer(), both
+ * dpsg.jni.RingBuffer objects. Their references are bound to the JNIEnv of
+ * the thread that created the channel, and the channel must be destroyed on
+ * that thread. writer() and reader() may be used from any thread, one
+ * producer and one consumer per ring, and commit() takes the JNIEnv of the
+ * calling thread.
+ */
+class ring_channel {
+  using ring_object = java_object<dpsg::jni::RingBuffer::name, false>;
+
+  shared_mapping _mapping;
+  ring_writer _writer;
+  ring_reader _reader;
+  ring_object _java_reader;
+  ring_object _java_writer;
+  // RingBuffer.wake()
+  jmethodID _wake;
+
+  ring_channel(shared_mapping &&mapping, ring_object &&java_reader,
+               ring_object &&java_writer, jmethodID wake) noexcept
+      : _mapping(std::move(mapping)), _java_reader(std::move(java_reader)),
+        _java_writer(std::move(java_writer)), _wake(wake) {
+    auto half = _mapping.bytes().size() / 2;
+    _writer = ring_writer{_mapping.bytes().first(half)};
+    _reader = ring_reader{_mapping.bytes().subspan(half)};
+  }
+
+public:
+  /// Maps two rings of capacity bytes each (rounded down to a power of two)
+  /// and creates their Java objects. Returns std::nullopt if
+  /// dpsg.jni.RingBuffer can't be found or the memory can't be mapped.
+  static std::optional<ring_channel> create(JVM &jvm, std::size_t capacity) {
+    auto cls = jvm.find_class<dpsg::jni::RingBuffer>();
+    if (!cls) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    auto ctor = cls->get_constructor_id<java::nio::ByteBuffer, long>();
+    auto wake = cls->get_method_id<"wake", void()>();
+    if (!ctor || !wake) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    constexpr static auto wake0_desc = jni_desc<void(long)>::name;
+    JNINativeMethod natives[] = {
+        {const_cast<char *>("wake0"), const_cast<char *>(wake0_desc.data),
+         (void *)&detail::ring_wake},
+    };
+    if (jvm->RegisterNatives(cls->get(), natives, 1) != JNI_OK) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+
+    auto size = ring_size(std::bit_floor(capacity));
+    auto mapping = shared_mapping::anonymous(jvm, 2 * size);
+    if (!mapping || format_ring(mapping.value().bytes().first(size)) == 0 ||
+        format_ring(mapping.value().bytes().subspan(size)) == 0) {
+      return std::nullopt;
+    }
+    auto to_java = mapping.value().buffer(*jvm, 0, size);
+    auto from_java = mapping.value().buffer(*jvm, size, size);
+    if (!to_java || !from_java) {
+      return std::nullopt;
+    }
+    // Java only needs to wake the native consumer of the second ring
+    auto wake_handle = (jlong)(std::intptr_t)mapping.value().bytes().data() +
+                       (jlong)size;
+    auto java_reader = cls->instantiate(*ctor, *to_java, (jlong)0);
+    auto java_writer = cls->instantiate(*ctor, *from_java, wake_handle);
+    if (!java_reader || !java_writer) {
+      jvm->ExceptionClear();
+      return std::nullopt;
+    }
+    return ring_channel{std::move(mapping.value()),
+                        ring_object{java_reader->promote()},
+                        ring_object{java_writer->promote()}, wake->id()};
+  }
+
+  ring_channel(ring_channel &&) noexcept = default;
+  ring_channel &operator=(ring_channel &&) noexcept = default;
+  ring_channel(const ring_channel &) = delete;
+  ring_channel &operator=(const ring_channel &) = delete;
+
+  /// C++ to Java
+  ring_writer &writer() noexcept { return _writer; }
+  /// Java to C++
+  ring_reader &reader() noexcept { return _reader; }
+
+  /// RingBuffer reading what writer() writes
+  const ring_object &java_reader() const noexcept { return _java_reader; }
+  /// RingBuffer writing what reader() reads
+  const ring_object &java_writer() const noexcept { return _java_writer; }
+
+  /// Commits writer(), and wakes the Java consumer if it waits in
+  /// RingBuffer.await (the only JNI call of the channel)
+  void commit(JNIEnv &env) noexcept {
+    if (_writer.commit()) {
+      detail::call_method_a<void>(env, _java_reader.get(), _wake, nullptr);
+    }
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_RING_HPP
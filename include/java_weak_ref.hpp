@@ -0,0 +1,202 @@
+#ifndef HEADER_GUARD_DPSG_JAVA_WEAK_REF_HPP
+#define HEADER_GUARD_DPSG_JAVA_WEAK_REF_HPP
+
+#include "java_ref.hpp"
+#include "ref_tracker.hpp"
+
+#include <jni.h>
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Weak global references and a cache of Java objects built on them.
+ *
+ * A java_weak_ref doesn't prevent the garbage collector from reclaiming the
+ * object it refers to. It is upgraded to a strong (local or global)
+ * reference with lock(), which fails once the object has been collected.
+ *
+ * weak_cache maps C++ keys to weakly held Java objects: the JVM can reclaim
+ * cached objects under memory pressure, and the dead entries are evicted
+ * incrementally, a few buckets per insertion, so that no operation ever
+ * pays for a full scan.
+ */
+
+template <class T = jobject> class java_weak_ref {
+  std::unique_ptr<std::remove_pointer_t<T>, deleter> _ptr = nullptr;
+  JNIEnv *_env = nullptr;
+
+public:
+  constexpr java_weak_ref() noexcept = default;
+
+  /// Creates a weak reference to the object referred to by strong
+  template <bool L>
+  explicit java_weak_ref(const java_ref<T, L> &strong,
+                         ref_site site = ref_site::current()) noexcept
+      : _ptr((T)strong.env().NewWeakGlobalRef(strong.get()),
+             deleter{strong.get_env(), &JNIEnv_::DeleteWeakGlobalRef}),
+        _env(strong.get_env()) {
+    ref_tracker::track(get(), ref_kind::weak, site);
+  }
+
+  constexpr java_weak_ref(java_weak_ref &&ref) noexcept
+      : _ptr(std::exchange(ref._ptr, nullptr)),
+        _env(std::exchange(ref._env, nullptr)) {}
+  constexpr java_weak_ref &operator=(java_weak_ref &&ref) noexcept {
+    std::swap(_ptr, ref._ptr);
+    std::swap(_env, ref._env);
+    return *this;
+  }
+  java_weak_ref(const java_weak_ref &) = delete;
+  java_weak_ref &operator=(const java_weak_ref &) = delete;
+
+  /// The weak reference itself. Only usable with IsSameObject, NewLocalRef
+  /// and NewGlobalRef: the object may be collected at any time.
+  constexpr T get() const noexcept { return _ptr.get(); }
+
+  constexpr JNIEnv &env() const noexcept { return *_env; }
+  constexpr JNIEnv *get_env() const noexcept { return _env; }
+
+  /// True if the object has been collected (or if the reference is empty)
+  bool expired() const noexcept {
+    return _ptr == nullptr || _env->IsSameObject(get(), nullptr);
+  }
+
+  /// Upgrades to a local reference, std::nullopt if the object has been
+  /// collected
+  std::optional<java_ref<T>>
+  lock(ref_site site = ref_site::current()) const noexcept {
+    if (_ptr == nullptr) {
+      return std::nullopt;
+    }
+    auto strong = (T)_env->NewLocalRef(get());
+    if (strong == nullptr) {
+      return std::nullopt;
+    }
+    return java_ref<T>{strong, _env, site};
+  }
+
+  /// Upgrades to a global reference, std::nullopt if the object has been
+  /// collected
+  std::optional<java_ref<T, false>>
+  lock_global(ref_site site = ref_site::current()) const noexcept {
+    if (_ptr == nullptr) {
+      return std::nullopt;
+    }
+    auto strong = (T)_env->NewGlobalRef(get());
+    if (strong == nullptr) {
+      return std::nullopt;
+    }
+    return java_ref<T, false>{strong, _env, site};
+  }
+};
+
+template <class T, bool L>
+java_weak_ref(const java_ref<T, L> &) -> java_weak_ref<T>;
+template <class T, bool L>
+java_weak_ref(const java_ref<T, L> &, ref_site) -> java_weak_ref<T>;
+
+/** @brief Cache of weakly held Java objects.
+ *
+ * @details Every insertion sweeps `sweep_step` buckets of the underlying
+ * hash table, resuming where the previous sweep stopped, and evicts the
+ * entries whose object has been collected. Lookups evict the entry they hit
+ * if it's dead. Not thread safe.
+ */
+template <class Key, class T = jobject, class Hash = std::hash<Key>,
+          class KeyEqual = std::equal_to<Key>>
+class weak_cache {
+  using map_type = std::unordered_map<Key, java_weak_ref<T>, Hash, KeyEqual>;
+
+  map_type _entries;
+  std::size_t _cursor = 0;
+  std::size_t _sweep_step;
+  // Keys of the dead entries found by a sweep, kept to reuse its storage
+  std::vector<Key> _dead;
+
+public:
+  constexpr static inline std::size_t default_sweep_step = 4;
+
+  explicit weak_cache(std::size_t sweep_step = default_sweep_step)
+      : _sweep_step(sweep_step) {}
+
+  /// Number of entries, dead ones not swept yet included
+  std::size_t size() const noexcept { return _entries.size(); }
+  bool empty() const noexcept { return _entries.empty(); }
+
+  template <bool L>
+  void insert(const Key &key, const java_ref<T, L> &object,
+              ref_site site = ref_site::current()) {
+    sweep(_sweep_step);
+    _entries.insert_or_assign(key, java_weak_ref<T>{object, site});
+  }
+
+  /// Local reference to the cached object, std::nullopt if there is none or
+  /// if it has been collected
+  std::optional<java_ref<T>> find(const Key &key,
+                                  ref_site site = ref_site::current()) {
+    auto it = _entries.find(key);
+    if (it == _entries.end()) {
+      return std::nullopt;
+    }
+    auto strong = it->second.lock(site);
+    if (!strong) {
+      _entries.erase(it);
+    }
+    return strong;
+  }
+
+  /// Returns the cached object, or caches and returns the one created by
+  /// make() (which must return a java_ref<T>) if there is none
+  template <class F> java_ref<T> find_or_insert(const Key &key, F &&make) {
+    if (auto cached = find(key)) {
+      return std::move(*cached);
+    }
+    java_ref<T> created = std::forward<F>(make)();
+    if (created) {
+      insert(key, created);
+    }
+    return created;
+  }
+
+  bool erase(const Key &key) { return _entries.erase(key) > 0; }
+  void clear() noexcept {
+    _entries.clear();
+    _dead.clear();
+    _cursor = 0;
+  }
+
+  /// Visits `buckets` buckets from where the last sweep stopped, evicting
+  /// dead entries. Returns the number of evicted entries.
+  std::size_t sweep(std::size_t buckets) {
+    auto bucket_count = _entries.bucket_count();
+    if (_entries.empty() || bucket_count == 0) {
+      return 0;
+    }
+    std::size_t evicted = 0;
+    for (std::size_t i = 0; i < buckets && i < bucket_count; ++i) {
+      auto bucket = (_cursor + i) % bucket_count;
+      for (auto it = _entries.begin(bucket); it != _entries.end(bucket); ++it) {
+        if (it->second.expired()) {
+          _dead.push_back(it->first);
+        }
+      }
+    }
+    _cursor = (_cursor + buckets) % bucket_count;
+    for (auto &key : _dead) {
+      evicted += _entries.erase(key);
+    }
+    _dead.clear();
+    return evicted;
+  }
+
+  /// Evicts every dead entry
+  std::size_t sweep_all() { return sweep(_entries.bucket_count()); }
+};
+
+#endif // HEADER_GUARD_DPSG_JAVA_WEAK_REF_HPP
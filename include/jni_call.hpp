@@ -0,0 +1,162 @@
+#ifndef HEADER_GUARD_DPSG_JNI_CALL_HPP
+#define HEADER_GUARD_DPSG_JNI_CALL_HPP
+
+#include <jni.h>
+
+#include <type_traits>
+
+/** Dispatch of method calls to the `Call<Type>MethodA` JNI functions (and of
+ * field stores to `Set<Type>Field`).
+ *
+ * java_class::call and call_plan convert their arguments to a jvalue array
+ * and call through call_method_a/call_static_method_a, so the cascade
+ * selecting the JNI function is instantiated once per return type instead of
+ * once per (class, prototype, arguments).
+ *
+ * With JNI_CPP20_EXTERN_TEMPLATES defined, the instantiations for the
+ * primitive types and jobject are declared extern: they are compiled once in
+ * the JNI_CPP20 library (src/jni_call.cpp, see the
+ * JNI_CPP20_EXPLICIT_INSTANTIATION CMake option) instead of in every
+ * translation unit.
+ */
+
+namespace detail {
+/// Type returned by the JNI for a method returning Ret
+template <class Ret>
+using jni_return_t =
+    std::conditional_t<std::is_void_v<Ret> ||
+                           std::is_arithmetic_v<std::remove_cvref_t<Ret>>,
+                       Ret, jobject>;
+
+/// arg is the converted value (see jni_convert.hpp)
+template <class Expected, class Arg> jvalue to_jvalue(Arg arg) noexcept {
+  using E = std::remove_cvref_t<Expected>;
+  jvalue v;
+  if constexpr (std::is_same_v<E, bool>) {
+    v.z = arg ? JNI_TRUE : JNI_FALSE;
+  } else if constexpr (std::is_same_v<E, signed char>) {
+    v.b = arg;
+  } else if constexpr (std::is_same_v<E, char>) {
+    v.c = (jchar)arg;
+  } else if constexpr (std::is_same_v<E, short>) {
+    v.s = arg;
+  } else if constexpr (std::is_same_v<E, int>) {
+    v.i = arg;
+  } else if constexpr (std::is_same_v<E, long>) {
+    v.j = arg;
+  } else if constexpr (std::is_same_v<E, float>) {
+    v.f = arg;
+  } else if constexpr (std::is_same_v<E, double>) {
+    v.d = arg;
+  } else {
+    v.l = arg;
+  }
+  return v;
+}
+
+template <class Ret>
+Ret call_method_a(JNIEnv &env, jobject target, jmethodID id,
+                  const jvalue *args) noexcept {
+  if constexpr (std::is_same_v<Ret, void>) {
+    env.CallVoidMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, bool>) {
+    return (bool)env.CallBooleanMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, signed char>) {
+    return env.CallByteMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, char>) {
+    return (char)env.CallCharMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, short>) {
+    return env.CallShortMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, int>) {
+    return env.CallIntMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, long>) {
+    return env.CallLongMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, float>) {
+    return env.CallFloatMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, double>) {
+    return env.CallDoubleMethodA(target, id, args);
+  } else {
+    static_assert(std::is_same_v<Ret, jobject>,
+                  "unsupported return type, see jni_return_t");
+    return env.CallObjectMethodA(target, id, args);
+  }
+}
+
+template <class Ret>
+Ret call_static_method_a(JNIEnv &env, jclass target, jmethodID id,
+                         const jvalue *args) noexcept {
+  if constexpr (std::is_same_v<Ret, void>) {
+    env.CallStaticVoidMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, bool>) {
+    return (bool)env.CallStaticBooleanMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, signed char>) {
+    return env.CallStaticByteMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, char>) {
+    return (char)env.CallStaticCharMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, short>) {
+    return env.CallStaticShortMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, int>) {
+    return env.CallStaticIntMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, long>) {
+    return env.CallStaticLongMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, float>) {
+    return env.CallStaticFloatMethodA(target, id, args);
+  } else if constexpr (std::is_same_v<Ret, double>) {
+    return env.CallStaticDoubleMethodA(target, id, args);
+  } else {
+    static_assert(std::is_same_v<Ret, jobject>,
+                  "unsupported return type, see jni_return_t");
+    return env.CallStaticObjectMethodA(target, id, args);
+  }
+}
+
+/// Stores value (see to_jvalue) in a field of type T
+template <class T, class Arg>
+void set_field(JNIEnv &env, jobject target, jfieldID id, Arg value) noexcept {
+  using E = std::remove_cvref_t<T>;
+  if constexpr (std::is_same_v<E, bool>) {
+    env.SetBooleanField(target, id, value ? JNI_TRUE : JNI_FALSE);
+  } else if constexpr (std::is_same_v<E, signed char>) {
+    env.SetByteField(target, id, value);
+  } else if constexpr (std::is_same_v<E, char>) {
+    env.SetCharField(target, id, (jchar)value);
+  } else if constexpr (std::is_same_v<E, short>) {
+    env.SetShortField(target, id, value);
+  } else if constexpr (std::is_same_v<E, int>) {
+    env.SetIntField(target, id, value);
+  } else if constexpr (std::is_same_v<E, long>) {
+    env.SetLongField(target, id, value);
+  } else if constexpr (std::is_same_v<E, float>) {
+    env.SetFloatField(target, id, value);
+  } else if constexpr (std::is_same_v<E, double>) {
+    env.SetDoubleField(target, id, value);
+  } else {
+    env.SetObjectField(target, id, value);
+  }
+}
+} // namespace detail
+
+/// Applies X to every return type instantiated in the compiled library
+#define JNI_CPP20_FOR_EACH_CALL_RETURN_TYPE(X)                                 \
+  X(void)                                                                      \
+  X(bool)                                                                      \
+  X(signed char)                                                               \
+  X(char)                                                                      \
+  X(short)                                                                     \
+  X(int)                                                                       \
+  X(long)                                                                      \
+  X(float)                                                                     \
+  X(double)                                                                    \
+  X(jobject)
+
+#ifdef JNI_CPP20_EXTERN_TEMPLATES
+#define JNI_CPP20_EXTERN_CALL(type)                                            \
+  extern template type detail::call_method_a<type>(JNIEnv &, jobject,          \
+                                                   jmethodID, const jvalue *); \
+  extern template type detail::call_static_method_a<type>(                     \
+      JNIEnv &, jclass, jmethodID, const jvalue *);
+JNI_CPP20_FOR_EACH_CALL_RETURN_TYPE(JNI_CPP20_EXTERN_CALL)
+#undef JNI_CPP20_EXTERN_CALL
+#endif
+
+#endif // HEADER_GUARD_DPSG_JNI_CALL_HPP
@@ -0,0 +1,342 @@
+#ifndef HEADER_GUARD_DPSG_JNI_CONVERT_HPP
+#define HEADER_GUARD_DPSG_JNI_CONVERT_HPP
+
+#include "dsl.hpp"
+#include "java_array.hpp"
+#include "java_object.hpp"
+#include "java_ref.hpp"
+#include "jni_call.hpp"
+#include "meta/is_one_of.hpp"
+
+#include <jni.h>
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+/** Conversion of C++ arguments to the parameters of a Java method.
+ *
+ * jni_arg_converter<Expected, Arg> is specialized for every accepted pair of
+ * a prototype parameter (e.g. `java::lang::String`, `long`,
+ * `java_array_desc<int>`) and an argument type. Each specialization declares
+ * its cost and a `convert(JNIEnv&, const Arg&)` returning a holder whose
+ * `get()` is the value passed to JNI. The holder lives until the end of the
+ * call, so converted references are released right after it.
+ *
+ *  + wrappers (java_object, java_string, java_array, java_ref to object
+ *    arrays), local or global, and nullptr pass through: zero_copy. Any
+ *    object converts to java::lang::Object, java_class and java_ref<jclass>
+ *    to java::lang::Class;
+ *  + arithmetic values convert when the conversion is lossless (int to
+ *    long, int64_t to long, float to double...): zero_copy;
+ *  + std::string, const char* and string literals become a jstring through
+ *    NewStringUTF: one_copy. std::string_view isn't NUL terminated and is
+ *    staged in a stack buffer (heap past 256 bytes) first: staged_copy;
+ *  + contiguous ranges (std::span, std::vector, std::array...) of the element
+ *    type become primitive arrays through Set<Type>ArrayRegion: one_copy.
+ *
+ * Strings go through NewStringUTF, which expects modified UTF-8: text
+ * containing NUL characters or characters outside of the BMP must be passed
+ * as a java_string.
+ *
+ * The cost of a whole call can be checked at compile time:
+ * @code
+ * static_assert(jni_call_cost_v<void(java::lang::String, long), java_string<false>, int>
+ *               == conversion_cost::zero_copy);
+ * @endcode
+ */
+
+enum class conversion_cost {
+  /// The value or reference is passed as is
+  zero_copy,
+  /// The JVM copies the C++ data once
+  one_copy,
+  /// The C++ data is copied to a temporary buffer first, then by the JVM
+  staged_copy,
+};
+
+template <typename T>
+concept native_jni_type =
+    dpsg::meta::is_one_of_v<T, bool, int, long, float, double, void, char,
+                            short, unsigned short>;
+
+/// Types usable as primitive parameters in a prototype
+template <typename T>
+concept jni_primitive_param =
+    dpsg::meta::is_one_of_v<T, bool, signed char, char, short, int, long,
+                            float, double>;
+
+template <class Expected, class Arg> struct jni_arg_converter;
+
+template <meta::fixed_string ClassName, bool Local> class java_class;
+
+namespace detail {
+template <class T> struct pass_through {
+  T value;
+  constexpr T get() const noexcept { return value; }
+};
+
+template <class Ref> struct owned_ref {
+  Ref ref;
+  auto get() const noexcept { return ref.get(); }
+};
+
+// Lossless conversion between arithmetic types. bool and char (Java char)
+// only match themselves, Java has no unsigned type.
+template <class From, class To>
+constexpr bool is_lossless_v = [] {
+  if constexpr (std::is_same_v<From, To>) {
+    return true;
+  } else if constexpr (dpsg::meta::is_one_of_v<From, bool, char> ||
+                       dpsg::meta::is_one_of_v<To, bool, char> ||
+                       !std::is_arithmetic_v<From>) {
+    return false;
+  } else if constexpr (std::is_floating_point_v<From> &&
+                       std::is_integral_v<To>) {
+    return false;
+  } else {
+    return std::numeric_limits<From>::digits <=
+           std::numeric_limits<To>::digits;
+  }
+}();
+
+#ifndef JNI_CPP20_NO_SELF_CHECKS
+static_assert(is_lossless_v<int, long>);
+static_assert(is_lossless_v<long long, long>);
+static_assert(is_lossless_v<unsigned int, long>);
+static_assert(is_lossless_v<short, float>);
+static_assert(!is_lossless_v<int, float>);
+static_assert(!is_lossless_v<long, int>);
+static_assert(!is_lossless_v<unsigned int, int>);
+static_assert(!is_lossless_v<double, float>);
+#endif
+
+inline owned_ref<java_ref<jstring>> new_string_utf(JNIEnv &env,
+                                                   const char *str) noexcept {
+  return {java_ref<jstring>{env.NewStringUTF(str), &env}};
+}
+
+template <class T>
+concept c_string = std::is_same_v<std::decay_t<T>, const char *> ||
+                   std::is_same_v<std::decay_t<T>, char *>;
+
+template <class R, class Element>
+concept primitive_range =
+    std::ranges::contiguous_range<const R &> &&
+    std::ranges::sized_range<const R &> &&
+    std::is_same_v<std::remove_cv_t<std::ranges::range_value_t<const R &>>,
+                   Element> &&
+    jni_primitive_element<Element>;
+} // namespace detail
+
+// Wrappers, local or global
+template <meta::fixed_string N, bool L>
+struct jni_arg_converter<java_class_desc<N>, java_object<N, L>> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject>
+  convert(JNIEnv &, const java_object<N, L> &obj) noexcept {
+    return {obj.get()};
+  }
+};
+
+template <meta::fixed_string N, bool L>
+  requires(!(N == java::lang::Object::name))
+struct jni_arg_converter<java::lang::Object, java_object<N, L>> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject>
+  convert(JNIEnv &, const java_object<N, L> &obj) noexcept {
+    return {obj.get()};
+  }
+};
+
+template <class E, class T, bool L>
+  requires std::is_same_v<T, jni_array_element_t<E>>
+struct jni_arg_converter<java_array_desc<E>, java_array<T, L>> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject>
+  convert(JNIEnv &, const java_array<T, L> &arr) noexcept {
+    return {arr.get()};
+  }
+};
+
+// Arrays of objects of the class, e.g. built by construct_all (java_batch.hpp)
+template <meta::fixed_string N, bool L>
+struct jni_arg_converter<java_array_desc<java_class_desc<N>>,
+                         java_object_array<N, L>> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject>
+  convert(JNIEnv &, const java_object_array<N, L> &arr) noexcept {
+    return {arr.get()};
+  }
+};
+
+// Class objects, e.g. for reflection or APIs taking a Class<?>
+template <meta::fixed_string N, bool L>
+struct jni_arg_converter<java::lang::Class, java_class<N, L>> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject>
+  convert(JNIEnv &, const java_class<N, L> &cls) noexcept {
+    return {cls.get()};
+  }
+};
+
+template <bool L>
+struct jni_arg_converter<java::lang::Class, java_ref<jclass, L>> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject>
+  convert(JNIEnv &, const java_ref<jclass, L> &cls) noexcept {
+    return {cls.get()};
+  }
+};
+
+template <meta::fixed_string N>
+struct jni_arg_converter<java_class_desc<N>, std::nullptr_t> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject> convert(JNIEnv &,
+                                               std::nullptr_t) noexcept {
+    return {nullptr};
+  }
+};
+
+template <class E> struct jni_arg_converter<java_array_desc<E>, std::nullptr_t> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static detail::pass_through<jobject> convert(JNIEnv &,
+                                               std::nullptr_t) noexcept {
+    return {nullptr};
+  }
+};
+
+// Arithmetic values
+template <jni_primitive_param E, class A>
+  requires detail::is_lossless_v<A, E>
+struct jni_arg_converter<E, A> {
+  constexpr static inline auto cost = conversion_cost::zero_copy;
+  static constexpr detail::pass_through<E> convert(JNIEnv &,
+                                                   A value) noexcept {
+    return {(E)value};
+  }
+};
+
+// Strings
+template <class A>
+  requires detail::c_string<A>
+struct jni_arg_converter<java::lang::String, A> {
+  constexpr static inline auto cost = conversion_cost::one_copy;
+  static auto convert(JNIEnv &env, const char *str) noexcept {
+    return detail::new_string_utf(env, str);
+  }
+};
+
+template <std::size_t N> struct jni_arg_converter<java::lang::String, char[N]> {
+  constexpr static inline auto cost = conversion_cost::one_copy;
+  static auto convert(JNIEnv &env, const char (&str)[N]) noexcept {
+    return detail::new_string_utf(env, str);
+  }
+};
+
+template <> struct jni_arg_converter<java::lang::String, std::string> {
+  constexpr static inline auto cost = conversion_cost::one_copy;
+  static auto convert(JNIEnv &env, const std::string &str) noexcept {
+    return detail::new_string_utf(env, str.c_str());
+  }
+};
+
+template <> struct jni_arg_converter<java::lang::String, std::string_view> {
+  constexpr static inline auto cost = conversion_cost::staged_copy;
+  constexpr static inline std::size_t stack_buffer_size = 256;
+  static auto convert(JNIEnv &env, std::string_view str) {
+    if (str.size() < stack_buffer_size) {
+      char buffer[stack_buffer_size];
+      std::memcpy(buffer, str.data(), str.size());
+      buffer[str.size()] = '\0';
+      return detail::new_string_utf(env, buffer);
+    }
+    return detail::new_string_utf(env, std::string{str}.c_str());
+  }
+};
+
+// Contiguous ranges to primitive arrays
+template <class E, class R>
+  requires detail::primitive_range<R, jni_array_element_t<E>>
+struct jni_arg_converter<java_array_desc<E>, R> {
+  using element_type = jni_array_element_t<E>;
+  constexpr static inline auto cost = conversion_cost::one_copy;
+  static auto convert(JNIEnv &env, const R &range) noexcept {
+    auto size = (jsize)std::ranges::size(range);
+    auto arr = make_java_array<element_type>(env, size);
+    if (arr) {
+      arr.set_region(0, {std::ranges::data(range), (std::size_t)size});
+    }
+    return detail::owned_ref<java_array<element_type>>{std::move(arr)};
+  }
+};
+
+/// Arg can be passed where the prototype expects Expected
+template <class Arg, class Expected>
+concept jni_convertible_to = requires(JNIEnv &env,
+                                      const std::remove_cvref_t<Arg> &arg) {
+  {
+    jni_arg_converter<std::remove_cvref_t<Expected>,
+                      std::remove_cvref_t<Arg>>::cost
+  } -> std::convertible_to<conversion_cost>;
+  jni_arg_converter<std::remove_cvref_t<Expected>,
+                    std::remove_cvref_t<Arg>>::convert(env, arg)
+      .get();
+};
+
+template <class Expected, class Arg>
+constexpr inline conversion_cost jni_conversion_cost_v =
+    jni_arg_converter<std::remove_cvref_t<Expected>,
+                      std::remove_cvref_t<Arg>>::cost;
+
+namespace detail {
+template <class Proto, class... Args> struct jni_call_cost;
+template <class Ret, class... Expected, class... Args>
+struct jni_call_cost<Ret(Expected...), Args...> {
+  constexpr static inline conversion_cost value = std::max(
+      {conversion_cost::zero_copy, jni_conversion_cost_v<Expected, Args>...});
+};
+} // namespace detail
+
+/// Most expensive conversion of a call of a method of prototype Proto
+template <class Proto, class... Args>
+constexpr inline conversion_cost jni_call_cost_v =
+    detail::jni_call_cost<Proto, Args...>::value;
+
+/// Converts args and calls f with the JNI values, which stay valid until f
+/// returns
+template <class Proto> struct jni_invoker;
+template <class Ret, class... Expected> struct jni_invoker<Ret(Expected...)> {
+  template <class F, class... Args>
+    requires(sizeof...(Args) == sizeof...(Expected))
+  static decltype(auto) invoke(JNIEnv &env, F &&f, const Args &...args) {
+    return std::forward<F>(f)(
+        jni_arg_converter<std::remove_cvref_t<Expected>,
+                          std::remove_cvref_t<Args>>::convert(env, args)
+            .get()...);
+  }
+
+  /// Same as invoke, f is called with the values packed in a jvalue array
+  /// (for the `<Function>A` variants of the JNI functions)
+  template <class F, class... Args>
+    requires(sizeof...(Args) == sizeof...(Expected))
+  static decltype(auto) invoke_a(JNIEnv &env, F &&f, const Args &...args) {
+    return invoke(
+        env,
+        [&](auto... values) -> decltype(auto) {
+          const jvalue packed[sizeof...(Expected) + 1] = {
+              detail::to_jvalue<Expected>(values)...};
+          return std::forward<F>(f)((const jvalue *)packed);
+        },
+        args...);
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JNI_CONVERT_HPP
@@ -0,0 +1,1497 @@
+#ifndef HEADER_GUARD_DPSG_JNI_FAKE_HPP
+#define HEADER_GUARD_DPSG_JNI_FAKE_HPP
+
+#include "jvm.hpp"
+#include "result.hpp"
+
+#include <jni.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** In-process fake of the JNI function tables, without any JVM.
+ *
+ * A fake_jvm provides a JNIEnv and a JavaVM whose functions run against a
+ * small object model scripted from C++: classes are declared with
+ * define_class, along with their fields and methods, whose bodies are C++
+ * functions. The wrappers of the library work on it unchanged, which makes
+ * it possible to unit-test them and to measure their own overhead without
+ * starting a JVM.
+ *
+ * Every entry point of both tables is counted: crossings() is the total
+ * number of JNI calls, count(fake_fn::X) the number of calls to X.
+ *
+ * @code
+ * fake_jvm fake;
+ * fake.define_class("java/lang/Math")
+ *     .static_method("max", "(II)I", [](fake_call &c) {
+ *       return jvalue{.i = std::max(c.args[0].i, c.args[1].i)};
+ *     });
+ * JVM jvm = fake.make_jvm();
+ * auto math = unwrap(jvm.find_class<java_class_desc<"java/lang/Math">>());
+ * auto max = unwrap(math.get_static_method_id<"max", int(int, int)>());
+ * auto before = fake.crossings();
+ * assert(math.call(max, 1, 2) == 2 && fake.crossings() - before == 1);
+ * @endcode
+ *
+ * The object model:
+ *  + references are checked: using a deleted or unknown reference is
+ *    counted by invalid_refs() instead of crashing, the live references are
+ *    counted by local_refs(), global_refs() and weak_refs();
+ *  + objects are only freed by collect(), which also clears the weak
+ *    references to unreachable objects;
+ *  + failed lookups throw NoClassDefFoundError, NoSuchMethodError or
+ *    NoSuchFieldError, out of bounds accesses to arrays and strings throw
+ *    ArrayIndexOutOfBoundsException and StringIndexOutOfBoundsException;
+ *  + java/lang/Object, java/lang/Class, java/lang/String and
+ *    java/lang/Throwable (with getMessage) are predefined, array classes and
+ *    the classes of the exceptions above are defined when first needed;
+ *  + DefineClass succeeds for classes declared by define_class and ignores
+ *    the bytecode, registered natives can be read back with
+ *    fake_class::native;
+ *  + the entry points without a fake implementation (reflection, modules)
+ *    return 0 or nullptr and are counted by unscripted().
+ *
+ * Method bodies can use the helpers of fake_jvm (new_string, throw_new...),
+ * which don't go through the function table and aren't counted.
+ *
+ * A fake_jvm has a single JNIEnv and isn't thread-safe: GetEnv and
+ * AttachCurrentThread return the same JNIEnv on every thread.
+ */
+
+// X(name) for every function of the JNI function table, in table order, or
+// V(name) for the C variadic ones
+#define JNI_CPP20_FAKE_ENV_FUNCTIONS_1_8(X, V)                                 \
+  X(GetVersion) X(DefineClass) X(FindClass) X(FromReflectedMethod)            \
+  X(FromReflectedField) X(ToReflectedMethod) X(GetSuperclass)                 \
+  X(IsAssignableFrom) X(ToReflectedField) X(Throw) X(ThrowNew)                \
+  X(ExceptionOccurred) X(ExceptionDescribe) X(ExceptionClear) X(FatalError)   \
+  X(PushLocalFrame) X(PopLocalFrame) X(NewGlobalRef) X(DeleteGlobalRef)       \
+  X(DeleteLocalRef) X(IsSameObject) X(NewLocalRef) X(EnsureLocalCapacity)     \
+  X(AllocObject) V(NewObject) X(NewObjectV) X(NewObjectA) X(GetObjectClass)   \
+  X(IsInstanceOf) X(GetMethodID) V(CallObjectMethod) X(CallObjectMethodV)     \
+  X(CallObjectMethodA) V(CallBooleanMethod) X(CallBooleanMethodV)             \
+  X(CallBooleanMethodA) V(CallByteMethod) X(CallByteMethodV)                  \
+  X(CallByteMethodA) V(CallCharMethod) X(CallCharMethodV)                     \
+  X(CallCharMethodA) V(CallShortMethod) X(CallShortMethodV)                   \
+  X(CallShortMethodA) V(CallIntMethod) X(CallIntMethodV) X(CallIntMethodA)    \
+  V(CallLongMethod) X(CallLongMethodV) X(CallLongMethodA)                     \
+  V(CallFloatMethod) X(CallFloatMethodV) X(CallFloatMethodA)                  \
+  V(CallDoubleMethod) X(CallDoubleMethodV) X(CallDoubleMethodA)               \
+  V(CallVoidMethod) X(CallVoidMethodV) X(CallVoidMethodA)                     \
+  V(CallNonvirtualObjectMethod) X(CallNonvirtualObjectMethodV)                \
+  X(CallNonvirtualObjectMethodA) V(CallNonvirtualBooleanMethod)               \
+  X(CallNonvirtualBooleanMethodV) X(CallNonvirtualBooleanMethodA)             \
+  V(CallNonvirtualByteMethod) X(CallNonvirtualByteMethodV)                    \
+  X(CallNonvirtualByteMethodA) V(CallNonvirtualCharMethod)                    \
+  X(CallNonvirtualCharMethodV) X(CallNonvirtualCharMethodA)                   \
+  V(CallNonvirtualShortMethod) X(CallNonvirtualShortMethodV)                  \
+  X(CallNonvirtualShortMethodA) V(CallNonvirtualIntMethod)                    \
+  X(CallNonvirtualIntMethodV) X(CallNonvirtualIntMethodA)                     \
+  V(CallNonvirtualLongMethod) X(CallNonvirtualLongMethodV)                    \
+  X(CallNonvirtualLongMethodA) V(CallNonvirtualFloatMethod)                   \
+  X(CallNonvirtualFloatMethodV) X(CallNonvirtualFloatMethodA)                 \
+  V(CallNonvirtualDoubleMethod) X(CallNonvirtualDoubleMethodV)                \
+  X(CallNonvirtualDoubleMethodA) V(CallNonvirtualVoidMethod)                  \
+  X(CallNonvirtualVoidMethodV) X(CallNonvirtualVoidMethodA) X(GetFieldID)     \
+  X(GetObjectField) X(GetBooleanField) X(GetByteField) X(GetCharField)        \
+  X(GetShortField) X(GetIntField) X(GetLongField) X(GetFloatField)            \
+  X(GetDoubleField) X(SetObjectField) X(SetBooleanField) X(SetByteField)      \
+  X(SetCharField) X(SetShortField) X(SetIntField) X(SetLongField)             \
+  X(SetFloatField) X(SetDoubleField) X(GetStaticMethodID)                     \
+  V(CallStaticObjectMethod) X(CallStaticObjectMethodV)                        \
+  X(CallStaticObjectMethodA) V(CallStaticBooleanMethod)                       \
+  X(CallStaticBooleanMethodV) X(CallStaticBooleanMethodA)                     \
+  V(CallStaticByteMethod) X(CallStaticByteMethodV) X(CallStaticByteMethodA)   \
+  V(CallStaticCharMethod) X(CallStaticCharMethodV) X(CallStaticCharMethodA)   \
+  V(CallStaticShortMethod) X(CallStaticShortMethodV)                          \
+  X(CallStaticShortMethodA) V(CallStaticIntMethod) X(CallStaticIntMethodV)    \
+  X(CallStaticIntMethodA) V(CallStaticLongMethod) X(CallStaticLongMethodV)    \
+  X(CallStaticLongMethodA) V(CallStaticFloatMethod)                           \
+  X(CallStaticFloatMethodV) X(CallStaticFloatMethodA)                         \
+  V(CallStaticDoubleMethod) X(CallStaticDoubleMethodV)                        \
+  X(CallStaticDoubleMethodA) V(CallStaticVoidMethod)                          \
+  X(CallStaticVoidMethodV) X(CallStaticVoidMethodA) X(GetStaticFieldID)       \
+  X(GetStaticObjectField) X(GetStaticBooleanField) X(GetStaticByteField)      \
+  X(GetStaticCharField) X(GetStaticShortField) X(GetStaticIntField)           \
+  X(GetStaticLongField) X(GetStaticFloatField) X(GetStaticDoubleField)        \
+  X(SetStaticObjectField) X(SetStaticBooleanField) X(SetStaticByteField)      \
+  X(SetStaticCharField) X(SetStaticShortField) X(SetStaticIntField)           \
+  X(SetStaticLongField) X(SetStaticFloatField) X(SetStaticDoubleField)        \
+  X(NewString) X(GetStringLength) X(GetStringChars) X(ReleaseStringChars)     \
+  X(NewStringUTF) X(GetStringUTFLength) X(GetStringUTFChars)                  \
+  X(ReleaseStringUTFChars) X(GetArrayLength) X(NewObjectArray)                \
+  X(GetObjectArrayElement) X(SetObjectArrayElement) X(NewBooleanArray)        \
+  X(NewByteArray) X(NewCharArray) X(NewShortArray) X(NewIntArray)             \
+  X(NewLongArray) X(NewFloatArray) X(NewDoubleArray)                          \
+  X(GetBooleanArrayElements) X(GetByteArrayElements)                          \
+  X(GetCharArrayElements) X(GetShortArrayElements) X(GetIntArrayElements)     \
+  X(GetLongArrayElements) X(GetFloatArrayElements)                            \
+  X(GetDoubleArrayElements) X(ReleaseBooleanArrayElements)                    \
+  X(ReleaseByteArrayElements) X(ReleaseCharArrayElements)                     \
+  X(ReleaseShortArrayElements) X(ReleaseIntArrayElements)                     \
+  X(ReleaseLongArrayElements) X(ReleaseFloatArrayElements)                    \
+  X(ReleaseDoubleArrayElements) X(GetBooleanArrayRegion)                      \
+  X(GetByteArrayRegion) X(GetCharArrayRegion) X(GetShortArrayRegion)          \
+  X(GetIntArrayRegion) X(GetLongArrayRegion) X(GetFloatArrayRegion)           \
+  X(GetDoubleArrayRegion) X(SetBooleanArrayRegion) X(SetByteArrayRegion)      \
+  X(SetCharArrayRegion) X(SetShortArrayRegion) X(SetIntArrayRegion)           \
+  X(SetLongArrayRegion) X(SetFloatArrayRegion) X(SetDoubleArrayRegion)        \
+  X(RegisterNatives) X(UnregisterNatives) X(MonitorEnter) X(MonitorExit)      \
+  X(GetJavaVM) X(GetStringRegion) X(GetStringUTFRegion)                       \
+  X(GetPrimitiveArrayCritical) X(ReleasePrimitiveArrayCritical)               \
+  X(GetStringCritical) X(ReleaseStringCritical) X(NewWeakGlobalRef)           \
+  X(DeleteWeakGlobalRef) X(ExceptionCheck) X(NewDirectByteBuffer)             \
+  X(GetDirectBufferAddress) X(GetDirectBufferCapacity) X(GetObjectRefType)
+#ifdef JNI_VERSION_9
+#define JNI_CPP20_FAKE_ENV_FUNCTIONS_9(X, V) X(GetModule)
+#else
+#define JNI_CPP20_FAKE_ENV_FUNCTIONS_9(X, V)
+#endif
+#ifdef JNI_VERSION_21
+#define JNI_CPP20_FAKE_ENV_FUNCTIONS_21(X, V) X(IsVirtualThread)
+#else
+#define JNI_CPP20_FAKE_ENV_FUNCTIONS_21(X, V)
+#endif
+#define JNI_CPP20_FAKE_ENV_FUNCTIONS(X, V)                                     \
+  JNI_CPP20_FAKE_ENV_FUNCTIONS_1_8(X, V)                                       \
+  JNI_CPP20_FAKE_ENV_FUNCTIONS_9(X, V)                                         \
+  JNI_CPP20_FAKE_ENV_FUNCTIONS_21(X, V)
+
+// X(name) for every function of the invocation table
+#define JNI_CPP20_FAKE_VM_FUNCTIONS(X)                                         \
+  X(DestroyJavaVM) X(AttachCurrentThread) X(DetachCurrentThread) X(GetEnv)     \
+  X(AttachCurrentThreadAsDaemon)
+
+// X(Type, type, jvalue member) for every primitive type
+#define JNI_CPP20_FAKE_PRIMITIVES(X)                                           \
+  X(Boolean, jboolean, z) X(Byte, jbyte, b) X(Char, jchar, c)                  \
+  X(Short, jshort, s) X(Int, jint, i) X(Long, jlong, j) X(Float, jfloat, f)    \
+  X(Double, jdouble, d)
+
+/// Entry points of the JNI function tables
+enum class fake_fn : std::size_t {
+#define JNI_CPP20_FAKE_ENUM(name) name,
+  JNI_CPP20_FAKE_ENV_FUNCTIONS(JNI_CPP20_FAKE_ENUM, JNI_CPP20_FAKE_ENUM)
+  JNI_CPP20_FAKE_VM_FUNCTIONS(JNI_CPP20_FAKE_ENUM)
+#undef JNI_CPP20_FAKE_ENUM
+};
+
+constexpr inline std::size_t fake_fn_count =
+    (std::size_t)fake_fn::AttachCurrentThreadAsDaemon + 1;
+
+constexpr const char *fake_fn_name(fake_fn f) noexcept {
+  constexpr const char *names[] = {
+#define JNI_CPP20_FAKE_NAME(name) #name,
+      JNI_CPP20_FAKE_ENV_FUNCTIONS(JNI_CPP20_FAKE_NAME, JNI_CPP20_FAKE_NAME)
+      JNI_CPP20_FAKE_VM_FUNCTIONS(JNI_CPP20_FAKE_NAME)
+#undef JNI_CPP20_FAKE_NAME
+  };
+  return names[(std::size_t)f];
+}
+
+class fake_jvm;
+class fake_class;
+
+/// Arguments of a call to a scripted method or constructor
+struct fake_call {
+  fake_jvm &jvm;
+  /// The instance, or the class of a static method
+  jobject self;
+  const jvalue *args;
+};
+
+/// Body of a scripted method, returns the result of the call (ignored for
+/// void methods and constructors). Objects are returned as local references.
+using fake_body = std::function<jvalue(fake_call &)>;
+
+namespace detail {
+template <class F> struct fake_result;
+template <class R, class... Args> struct fake_result<R(JNICALL *)(Args...)> {
+  using type = R;
+};
+template <class F> using fake_result_t = typename fake_result<F>::type;
+
+// T, as a type dependent on Args
+template <class T, class... Args> struct fake_dependent {
+  using type = T;
+};
+
+struct fake_object;
+
+// Value of a field: primitives in value, objects in object
+struct fake_slot {
+  jvalue value{};
+  fake_object *object = nullptr;
+};
+
+struct fake_object {
+  fake_class *cls = nullptr;
+  // Instance fields, by field ID
+  std::map<const void *, fake_slot> fields;
+  // java/lang/String
+  std::u16string chars;
+  // Arrays and direct buffers
+  std::vector<unsigned char> elements;
+  std::vector<fake_object *> objects;
+  jsize length = 0;
+  void *address = nullptr;
+  jlong capacity = 0;
+  // Class objects
+  fake_class *as_class = nullptr;
+  // Throwables created by ThrowNew or throw_new
+  std::string message;
+  bool marked = false;
+};
+
+struct fake_method {
+  std::string name;
+  std::string signature;
+  bool is_static;
+  fake_body body;
+};
+
+struct fake_field {
+  std::string name;
+  std::string signature;
+  bool is_static;
+  fake_slot value;
+};
+
+// Modified UTF-8 (as used by JNI) to UTF-16. Standard 4-byte sequences are
+// accepted as well.
+inline std::u16string fake_decode_mutf8(std::string_view utf) {
+  std::u16string chars;
+  chars.reserve(utf.size());
+  for (std::size_t i = 0; i < utf.size();) {
+    auto c = (unsigned char)utf[i];
+    char32_t cp;
+    if (c < 0x80) {
+      cp = c;
+      i += 1;
+    } else if ((c & 0xe0) == 0xc0 && i + 1 < utf.size()) {
+      cp = ((c & 0x1fu) << 6) | (utf[i + 1] & 0x3fu);
+      i += 2;
+    } else if ((c & 0xf0) == 0xe0 && i + 2 < utf.size()) {
+      cp = ((c & 0x0fu) << 12) | ((utf[i + 1] & 0x3fu) << 6) |
+           (utf[i + 2] & 0x3fu);
+      i += 3;
+    } else if ((c & 0xf8) == 0xf0 && i + 3 < utf.size()) {
+      cp = ((c & 0x07u) << 18) | ((utf[i + 1] & 0x3fu) << 12) |
+           ((utf[i + 2] & 0x3fu) << 6) | (utf[i + 3] & 0x3fu);
+      i += 4;
+      chars.push_back((char16_t)(0xd800 + ((cp - 0x10000) >> 10)));
+      cp = 0xdc00 + ((cp - 0x10000) & 0x3ff);
+    } else {
+      cp = 0xfffd;
+      i += 1;
+    }
+    chars.push_back((char16_t)cp);
+  }
+  return chars;
+}
+
+inline std::string fake_encode_mutf8(std::u16string_view chars) {
+  std::string utf;
+  utf.reserve(chars.size());
+  for (char16_t c : chars) {
+    if (c != 0 && c < 0x80) {
+      utf.push_back((char)c);
+    } else if (c < 0x800) {
+      utf.push_back((char)(0xc0 | (c >> 6)));
+      utf.push_back((char)(0x80 | (c & 0x3f)));
+    } else {
+      utf.push_back((char)(0xe0 | (c >> 12)));
+      utf.push_back((char)(0x80 | ((c >> 6) & 0x3f)));
+      utf.push_back((char)(0x80 | (c & 0x3f)));
+    }
+  }
+  return utf;
+}
+
+// Descriptors of the parameters of a method signature
+inline std::vector<std::string_view> fake_parameters(std::string_view sig) {
+  std::vector<std::string_view> params;
+  std::size_t i = 1;
+  while (i < sig.size() && sig[i] != ')') {
+    auto start = i;
+    while (sig[i] == '[') {
+      ++i;
+    }
+    i = sig[i] == 'L' ? sig.find(';', i) + 1 : i + 1;
+    params.push_back(sig.substr(start, i - start));
+  }
+  return params;
+}
+
+inline bool fake_is_reference(std::string_view desc) noexcept {
+  return !desc.empty() && (desc[0] == 'L' || desc[0] == '[');
+}
+} // namespace detail
+
+/// Class scripted in a fake_jvm
+class fake_class {
+  friend class fake_jvm;
+
+  fake_jvm &_jvm;
+  std::string _name;
+  fake_class *_super;
+  detail::fake_object *_object = nullptr;
+  std::deque<detail::fake_method> _methods;
+  std::deque<detail::fake_field> _fields;
+  std::map<std::pair<std::string, std::string>, void *, std::less<>> _natives;
+
+  fake_class(fake_jvm &jvm, std::string name, fake_class *super)
+      : _jvm(jvm), _name(std::move(name)), _super(super) {}
+
+  detail::fake_method *_find_method(std::string_view name,
+                                    std::string_view signature,
+                                    bool is_static) noexcept {
+    for (auto *c = this; c != nullptr; c = c->_super) {
+      for (auto &m : c->_methods) {
+        if (m.is_static == is_static && m.name == name &&
+            m.signature == signature) {
+          return &m;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  detail::fake_field *_find_field(std::string_view name,
+                                  std::string_view signature,
+                                  bool is_static) noexcept {
+    for (auto *c = this; c != nullptr; c = c->_super) {
+      for (auto &f : c->_fields) {
+        if (f.is_static == is_static && f.name == name &&
+            f.signature == signature) {
+          return &f;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  bool _is_subclass_of(const fake_class *other) const noexcept {
+    for (auto *c = this; c != nullptr; c = c->_super) {
+      if (c == other) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+public:
+  fake_class(const fake_class &) = delete;
+  fake_class &operator=(const fake_class &) = delete;
+
+  const std::string &name() const noexcept { return _name; }
+
+  /// Declares an instance method, or a constructor if name is "<init>".
+  /// Without body, calls return 0 or nullptr.
+  fake_class &method(std::string name, std::string signature,
+                     fake_body body = {}) {
+    _methods.push_back(
+        {std::move(name), std::move(signature), false, std::move(body)});
+    return *this;
+  }
+
+  fake_class &static_method(std::string name, std::string signature,
+                            fake_body body = {}) {
+    _methods.push_back(
+        {std::move(name), std::move(signature), true, std::move(body)});
+    return *this;
+  }
+
+  fake_class &field(std::string name, std::string signature) {
+    _fields.push_back({std::move(name), std::move(signature), false, {}});
+    return *this;
+  }
+
+  /// Declares a static field, value.l being a reference for object fields
+  fake_class &static_field(std::string name, std::string signature,
+                           jvalue value = {});
+
+  /// Function registered for a native method, nullptr if none
+  void *native(std::string_view name, std::string_view signature) const {
+    auto it = _natives.find(std::pair{std::string{name}, std::string{signature}});
+    return it == _natives.end() ? nullptr : it->second;
+  }
+};
+
+class fake_jvm {
+  struct env_type : JNIEnv {
+    fake_jvm *owner;
+  };
+  struct vm_type : JavaVM {
+    fake_jvm *owner;
+  };
+  struct ref {
+    detail::fake_object *object;
+    jobjectRefType type;
+  };
+
+  JNINativeInterface_ _functions{};
+  JNIInvokeInterface_ _vm_functions{};
+  env_type _env;
+  vm_type _vm;
+  jint _version;
+
+  std::array<std::size_t, fake_fn_count> _counts{};
+  std::size_t _unscripted = 0;
+  std::size_t _invalid_refs = 0;
+  std::size_t _pinned = 0;
+
+  std::vector<std::unique_ptr<detail::fake_object>> _heap;
+  std::map<std::string, std::unique_ptr<fake_class>, std::less<>> _classes;
+  std::unordered_map<const void *, std::unique_ptr<ref>> _refs;
+  std::vector<std::vector<ref *>> _frames{1};
+  std::unordered_map<const void *, std::unique_ptr<char[]>> _utf_chars;
+  detail::fake_object *_exception = nullptr;
+
+  fake_class *_object_class;
+  fake_class *_class_class;
+  fake_class *_string_class;
+  fake_class *_throwable_class;
+
+  friend class fake_class;
+
+  static fake_jvm &_self(JNIEnv *env) noexcept {
+    return *static_cast<env_type *>(env)->owner;
+  }
+  static fake_jvm &_self(JavaVM *vm) noexcept {
+    return *static_cast<vm_type *>(vm)->owner;
+  }
+
+  void _count(fake_fn f) noexcept { ++_counts[(std::size_t)f]; }
+
+  // Object model
+
+  detail::fake_object *_alloc(fake_class *cls) {
+    auto &obj = _heap.emplace_back(std::make_unique<detail::fake_object>());
+    obj->cls = cls;
+    return obj.get();
+  }
+
+  fake_class &_define(std::string_view name, fake_class *super) {
+    if (auto *existing = _find(name)) {
+      return *existing;
+    }
+    auto &result = *_classes
+                        .emplace(std::string{name},
+                                 std::unique_ptr<fake_class>{new fake_class{
+                                     *this, std::string{name}, super}})
+                        .first->second;
+    if (_class_class != nullptr) {
+      result._object = _alloc(_class_class);
+      result._object->as_class = &result;
+    }
+    return result;
+  }
+
+  fake_class *_find(std::string_view name) const noexcept {
+    auto it = _classes.find(name);
+    return it == _classes.end() ? nullptr : it->second.get();
+  }
+
+  // Classes defined on first use (arrays, exceptions thrown by the fake)
+  fake_class &_builtin(std::string_view name, fake_class *super = nullptr) {
+    return _define(name, super != nullptr ? super : _object_class);
+  }
+
+  fake_class &_array_class(std::string_view element) {
+    return _builtin("[" + std::string{element});
+  }
+
+  detail::fake_object *_throwable(std::string_view cls, std::string message) {
+    auto *obj = _alloc(&_builtin(cls, _throwable_class));
+    obj->message = std::move(message);
+    return obj;
+  }
+
+  void _throw(std::string_view cls, std::string message) {
+    _exception = _throwable(cls, std::move(message));
+  }
+
+  jobject _new_ref(detail::fake_object *obj, jobjectRefType type) {
+    if (obj == nullptr) {
+      return nullptr;
+    }
+    auto r = std::make_unique<ref>(ref{obj, type});
+    auto *handle = r.get();
+    _refs.emplace(handle, std::move(r));
+    if (type == JNILocalRefType) {
+      _frames.back().push_back(handle);
+    }
+    return (jobject)handle;
+  }
+
+  jobject _local(detail::fake_object *obj) {
+    return _new_ref(obj, JNILocalRefType);
+  }
+
+  ref *_ref(jobject handle) noexcept {
+    if (handle == nullptr) {
+      return nullptr;
+    }
+    auto it = _refs.find(handle);
+    if (it == _refs.end()) {
+      ++_invalid_refs;
+      return nullptr;
+    }
+    return it->second.get();
+  }
+
+  detail::fake_object *_deref(jobject handle) noexcept {
+    auto *r = _ref(handle);
+    return r == nullptr ? nullptr : r->object;
+  }
+
+  fake_class *_class_of(jobject cls) noexcept {
+    auto *obj = _deref(cls);
+    return obj == nullptr ? nullptr : obj->as_class;
+  }
+
+  void _delete_ref(jobject handle, jobjectRefType type) {
+    auto it = handle == nullptr ? _refs.end() : _refs.find(handle);
+    if (it == _refs.end() || it->second->type != type) {
+      if (handle != nullptr) {
+        ++_invalid_refs;
+      }
+      return;
+    }
+    if (type == JNILocalRefType) {
+      for (auto frame = _frames.rbegin(); frame != _frames.rend(); ++frame) {
+        auto pos = std::find(frame->rbegin(), frame->rend(), it->second.get());
+        if (pos != frame->rend()) {
+          frame->erase(std::next(pos).base());
+          break;
+        }
+      }
+    }
+    _refs.erase(it);
+  }
+
+  template <class T> T *_elements(jarray array) noexcept {
+    auto *obj = _deref(array);
+    return obj == nullptr ? nullptr : (T *)obj->elements.data();
+  }
+
+  bool _check_bounds(jsize length, jsize start, jsize len,
+                     std::string_view exception) {
+    if (start < 0 || len < 0 || start > length - len) {
+      _throw(exception, "out of bounds");
+      return false;
+    }
+    return true;
+  }
+
+  jvalue _invoke(jobject self, jmethodID id, const jvalue *args,
+                 bool is_virtual) {
+    auto *m = (detail::fake_method *)id;
+    if (m == nullptr) {
+      return {};
+    }
+    if (is_virtual) {
+      if (auto *obj = _deref(self); obj != nullptr && obj->cls != nullptr) {
+        if (auto *override_ =
+                obj->cls->_find_method(m->name, m->signature, false)) {
+          m = override_;
+        }
+      }
+    }
+    if (!m->body) {
+      return {};
+    }
+    fake_call call{*this, self, args};
+    return m->body(call);
+  }
+
+  // Arguments of a call through the V and variadic functions
+  static std::vector<jvalue> _unpack(jmethodID id, va_list args) {
+    std::vector<jvalue> values;
+    auto *m = (detail::fake_method *)id;
+    if (m == nullptr) {
+      return values;
+    }
+    for (auto param : detail::fake_parameters(m->signature)) {
+      jvalue v{};
+      switch (param[0]) {
+      case 'Z':
+        v.z = (jboolean)va_arg(args, int);
+        break;
+      case 'B':
+        v.b = (jbyte)va_arg(args, int);
+        break;
+      case 'C':
+        v.c = (jchar)va_arg(args, int);
+        break;
+      case 'S':
+        v.s = (jshort)va_arg(args, int);
+        break;
+      case 'I':
+        v.i = va_arg(args, jint);
+        break;
+      case 'J':
+        v.j = va_arg(args, jlong);
+        break;
+      case 'F':
+        v.f = (jfloat)va_arg(args, double);
+        break;
+      case 'D':
+        v.d = va_arg(args, double);
+        break;
+      default:
+        v.l = va_arg(args, jobject);
+      }
+      values.push_back(v);
+    }
+    return values;
+  }
+
+  void _mark(detail::fake_object *obj) {
+    std::vector<detail::fake_object *> stack{obj};
+    while (!stack.empty()) {
+      auto *o = stack.back();
+      stack.pop_back();
+      if (o == nullptr || o->marked) {
+        continue;
+      }
+      o->marked = true;
+      if (o->cls != nullptr) {
+        stack.push_back(o->cls->_object);
+      }
+      for (auto &[id, slot] : o->fields) {
+        stack.push_back(slot.object);
+      }
+      stack.insert(stack.end(), o->objects.begin(), o->objects.end());
+    }
+  }
+
+  // Implementations of the entry points, selected by name by the thunks
+  // installed in the constructor
+
+  jint GetVersion() const noexcept { return _version; }
+
+  jclass DefineClass(const char *name, jobject, const jbyte *, jsize) {
+    return FindClass(name);
+  }
+
+  jclass FindClass(const char *name) {
+    auto *cls = _find(name);
+    if (cls == nullptr && name[0] == '[') {
+      cls = &_builtin(name);
+    }
+    if (cls == nullptr) {
+      _throw("java/lang/NoClassDefFoundError", name);
+      return nullptr;
+    }
+    return (jclass)_local(cls->_object);
+  }
+
+  jclass GetSuperclass(jclass cls) {
+    auto *c = _class_of(cls);
+    return c == nullptr || c->_super == nullptr
+               ? nullptr
+               : (jclass)_local(c->_super->_object);
+  }
+
+  jboolean IsAssignableFrom(jclass sub, jclass sup) noexcept {
+    auto *c = _class_of(sub);
+    return c != nullptr && c->_is_subclass_of(_class_of(sup));
+  }
+
+  jint Throw(jthrowable obj) noexcept {
+    _exception = _deref(obj);
+    return _exception != nullptr ? JNI_OK : JNI_ERR;
+  }
+
+  jint ThrowNew(jclass cls, const char *message) {
+    auto *c = _class_of(cls);
+    if (c == nullptr) {
+      return JNI_ERR;
+    }
+    _throw(c->_name, message != nullptr ? message : "");
+    return JNI_OK;
+  }
+
+  jthrowable ExceptionOccurred() { return (jthrowable)_local(_exception); }
+
+  void ExceptionDescribe() noexcept { _exception = nullptr; }
+
+  void ExceptionClear() noexcept { _exception = nullptr; }
+
+  jboolean ExceptionCheck() const noexcept { return _exception != nullptr; }
+
+  [[noreturn]] void FatalError(const char *) noexcept { std::abort(); }
+
+  jint PushLocalFrame(jint) {
+    _frames.emplace_back();
+    return JNI_OK;
+  }
+
+  jobject PopLocalFrame(jobject result) {
+    auto *obj = _deref(result);
+    if (_frames.size() > 1) {
+      for (auto *r : _frames.back()) {
+        _refs.erase(r);
+      }
+      _frames.pop_back();
+    } else {
+      ++_invalid_refs;
+    }
+    return _local(obj);
+  }
+
+  jobject NewGlobalRef(jobject obj) {
+    return _new_ref(_deref(obj), JNIGlobalRefType);
+  }
+
+  void DeleteGlobalRef(jobject obj) { _delete_ref(obj, JNIGlobalRefType); }
+
+  void DeleteLocalRef(jobject obj) { _delete_ref(obj, JNILocalRefType); }
+
+  jboolean IsSameObject(jobject a, jobject b) noexcept {
+    return _deref(a) == _deref(b);
+  }
+
+  jobject NewLocalRef(jobject obj) { return _local(_deref(obj)); }
+
+  jint EnsureLocalCapacity(jint) const noexcept { return JNI_OK; }
+
+  jobject AllocObject(jclass cls) {
+    auto *c = _class_of(cls);
+    return c == nullptr ? nullptr : _local(_alloc(c));
+  }
+
+  jobject NewObjectA(jclass cls, jmethodID id, const jvalue *args) {
+    jobject obj = AllocObject(cls);
+    if (obj == nullptr) {
+      return nullptr;
+    }
+    _invoke(obj, id, args, false);
+    if (_exception != nullptr) {
+      DeleteLocalRef(obj);
+      return nullptr;
+    }
+    return obj;
+  }
+
+  jobject NewObjectV(jclass cls, jmethodID id, va_list args) {
+    return NewObjectA(cls, id, _unpack(id, args).data());
+  }
+
+  jclass GetObjectClass(jobject obj) {
+    auto *o = _deref(obj);
+    return o == nullptr ? nullptr : (jclass)_local(o->cls->_object);
+  }
+
+  jboolean IsInstanceOf(jobject obj, jclass cls) noexcept {
+    auto *o = _deref(obj);
+    return o == nullptr || o->cls->_is_subclass_of(_class_of(cls));
+  }
+
+  jmethodID _method_id(jclass cls, const char *name, const char *sig,
+                       bool is_static) {
+    auto *c = _class_of(cls);
+    auto *m = c == nullptr ? nullptr : c->_find_method(name, sig, is_static);
+    if (m == nullptr) {
+      _throw("java/lang/NoSuchMethodError", name);
+    }
+    return (jmethodID)m;
+  }
+
+  jmethodID GetMethodID(jclass cls, const char *name, const char *sig) {
+    return _method_id(cls, name, sig, false);
+  }
+
+  jmethodID GetStaticMethodID(jclass cls, const char *name, const char *sig) {
+    return _method_id(cls, name, sig, true);
+  }
+
+  jfieldID _field_id(jclass cls, const char *name, const char *sig,
+                     bool is_static) {
+    auto *c = _class_of(cls);
+    auto *f = c == nullptr ? nullptr : c->_find_field(name, sig, is_static);
+    if (f == nullptr) {
+      _throw("java/lang/NoSuchFieldError", name);
+    }
+    return (jfieldID)f;
+  }
+
+  jfieldID GetFieldID(jclass cls, const char *name, const char *sig) {
+    return _field_id(cls, name, sig, false);
+  }
+
+  jfieldID GetStaticFieldID(jclass cls, const char *name, const char *sig) {
+    return _field_id(cls, name, sig, true);
+  }
+
+  detail::fake_slot *_field(jobject obj, jfieldID id) {
+    auto *o = _deref(obj);
+    return o == nullptr ? nullptr : &o->fields[id];
+  }
+
+  static detail::fake_slot *_static_field(jfieldID id) noexcept {
+    return id == nullptr ? nullptr : &((detail::fake_field *)id)->value;
+  }
+
+  void CallVoidMethodA(jobject obj, jmethodID id, const jvalue *args) {
+    _invoke(obj, id, args, true);
+  }
+  void CallVoidMethodV(jobject obj, jmethodID id, va_list args) {
+    CallVoidMethodA(obj, id, _unpack(id, args).data());
+  }
+  void CallNonvirtualVoidMethodA(jobject obj, jclass, jmethodID id,
+                                 const jvalue *args) {
+    _invoke(obj, id, args, false);
+  }
+  void CallNonvirtualVoidMethodV(jobject obj, jclass cls, jmethodID id,
+                                 va_list args) {
+    CallNonvirtualVoidMethodA(obj, cls, id, _unpack(id, args).data());
+  }
+  void CallStaticVoidMethodA(jclass cls, jmethodID id, const jvalue *args) {
+    _invoke(cls, id, args, false);
+  }
+  void CallStaticVoidMethodV(jclass cls, jmethodID id, va_list args) {
+    CallStaticVoidMethodA(cls, id, _unpack(id, args).data());
+  }
+
+#define JNI_CPP20_FAKE_CALLS(Type, type, member)                               \
+  type Call##Type##MethodA(jobject obj, jmethodID id, const jvalue *args) {    \
+    return (type)_invoke(obj, id, args, true).member;                          \
+  }                                                                            \
+  type Call##Type##MethodV(jobject obj, jmethodID id, va_list args) {          \
+    return Call##Type##MethodA(obj, id, _unpack(id, args).data());             \
+  }                                                                            \
+  type CallNonvirtual##Type##MethodA(jobject obj, jclass, jmethodID id,        \
+                                     const jvalue *args) {                     \
+    return (type)_invoke(obj, id, args, false).member;                         \
+  }                                                                            \
+  type CallNonvirtual##Type##MethodV(jobject obj, jclass cls, jmethodID id,    \
+                                     va_list args) {                           \
+    return CallNonvirtual##Type##MethodA(obj, cls, id,                         \
+                                         _unpack(id, args).data());            \
+  }                                                                            \
+  type CallStatic##Type##MethodA(jclass cls, jmethodID id,                     \
+                                 const jvalue *args) {                         \
+    return (type)_invoke(cls, id, args, false).member;                         \
+  }                                                                            \
+  type CallStatic##Type##MethodV(jclass cls, jmethodID id, va_list args) {     \
+    return CallStatic##Type##MethodA(cls, id, _unpack(id, args).data());       \
+  }
+  JNI_CPP20_FAKE_CALLS(Object, jobject, l)
+  JNI_CPP20_FAKE_PRIMITIVES(JNI_CPP20_FAKE_CALLS)
+#undef JNI_CPP20_FAKE_CALLS
+
+  jobject GetObjectField(jobject obj, jfieldID id) {
+    auto *slot = _field(obj, id);
+    return slot == nullptr ? nullptr : _local(slot->object);
+  }
+  void SetObjectField(jobject obj, jfieldID id, jobject value) {
+    if (auto *slot = _field(obj, id)) {
+      slot->object = _deref(value);
+    }
+  }
+  jobject GetStaticObjectField(jclass, jfieldID id) {
+    auto *slot = _static_field(id);
+    return slot == nullptr ? nullptr : _local(slot->object);
+  }
+  void SetStaticObjectField(jclass, jfieldID id, jobject value) {
+    if (auto *slot = _static_field(id)) {
+      slot->object = _deref(value);
+    }
+  }
+
+#define JNI_CPP20_FAKE_FIELDS(Type, type, member)                              \
+  type Get##Type##Field(jobject obj, jfieldID id) {                            \
+    auto *slot = _field(obj, id);                                              \
+    return slot == nullptr ? type{} : slot->value.member;                      \
+  }                                                                            \
+  void Set##Type##Field(jobject obj, jfieldID id, type value) {                \
+    if (auto *slot = _field(obj, id)) {                                        \
+      slot->value.member = value;                                              \
+    }                                                                          \
+  }                                                                            \
+  type GetStatic##Type##Field(jclass, jfieldID id) noexcept {                  \
+    auto *slot = _static_field(id);                                            \
+    return slot == nullptr ? type{} : slot->value.member;                      \
+  }                                                                            \
+  void SetStatic##Type##Field(jclass, jfieldID id, type value) noexcept {      \
+    if (auto *slot = _static_field(id)) {                                      \
+      slot->value.member = value;                                              \
+    }                                                                          \
+  }
+  JNI_CPP20_FAKE_PRIMITIVES(JNI_CPP20_FAKE_FIELDS)
+#undef JNI_CPP20_FAKE_FIELDS
+
+  jstring NewString(const jchar *chars, jsize len) {
+    return new_string(std::u16string_view{(const char16_t *)chars,
+                                          (std::size_t)len});
+  }
+
+  jsize GetStringLength(jstring str) noexcept {
+    auto *o = _deref(str);
+    return o == nullptr ? 0 : (jsize)o->chars.size();
+  }
+
+  const jchar *GetStringChars(jstring str, jboolean *is_copy) noexcept {
+    auto *o = _deref(str);
+    if (o == nullptr) {
+      return nullptr;
+    }
+    if (is_copy != nullptr) {
+      *is_copy = JNI_FALSE;
+    }
+    ++_pinned;
+    return (const jchar *)o->chars.c_str();
+  }
+
+  void ReleaseStringChars(jstring, const jchar *) noexcept { --_pinned; }
+
+  jstring NewStringUTF(const char *utf) {
+    return (jstring)_local(_string(detail::fake_decode_mutf8(utf)));
+  }
+
+  jsize GetStringUTFLength(jstring str) {
+    auto *o = _deref(str);
+    return o == nullptr ? 0 : (jsize)detail::fake_encode_mutf8(o->chars).size();
+  }
+
+  const char *GetStringUTFChars(jstring str, jboolean *is_copy) {
+    auto *o = _deref(str);
+    if (o == nullptr) {
+      return nullptr;
+    }
+    auto utf = detail::fake_encode_mutf8(o->chars);
+    auto copy = std::make_unique<char[]>(utf.size() + 1);
+    std::memcpy(copy.get(), utf.c_str(), utf.size() + 1);
+    if (is_copy != nullptr) {
+      *is_copy = JNI_TRUE;
+    }
+    auto *chars = copy.get();
+    _utf_chars.emplace(chars, std::move(copy));
+    return chars;
+  }
+
+  void ReleaseStringUTFChars(jstring, const char *chars) {
+    if (_utf_chars.erase(chars) == 0) {
+      ++_invalid_refs;
+    }
+  }
+
+  jsize GetArrayLength(jarray array) noexcept {
+    auto *o = _deref(array);
+    return o == nullptr ? 0 : o->length;
+  }
+
+  jobjectArray NewObjectArray(jsize len, jclass element, jobject initial) {
+    auto *c = _class_of(element);
+    if (c == nullptr) {
+      return nullptr;
+    }
+    auto *array = _alloc(&_array_class(
+        c->_name[0] == '[' ? c->_name : "L" + c->_name + ";"));
+    array->length = len;
+    array->objects.assign((std::size_t)len, _deref(initial));
+    return (jobjectArray)_local(array);
+  }
+
+  jobject GetObjectArrayElement(jobjectArray array, jsize index) {
+    auto *o = _deref(array);
+    if (o == nullptr ||
+        !_check_bounds(o->length, index, 1,
+                       "java/lang/ArrayIndexOutOfBoundsException")) {
+      return nullptr;
+    }
+    return _local(o->objects[(std::size_t)index]);
+  }
+
+  void SetObjectArrayElement(jobjectArray array, jsize index, jobject value) {
+    auto *o = _deref(array);
+    if (o != nullptr &&
+        _check_bounds(o->length, index, 1,
+                      "java/lang/ArrayIndexOutOfBoundsException")) {
+      o->objects[(std::size_t)index] = _deref(value);
+    }
+  }
+
+#define JNI_CPP20_FAKE_ARRAYS(Type, type, member)                              \
+  type##Array New##Type##Array(jsize len) {                                    \
+    auto *array = _alloc(&_array_class(_element_desc<type>()));                \
+    array->length = len;                                                       \
+    array->elements.resize((std::size_t)len * sizeof(type));                   \
+    return (type##Array)_local(array);                                         \
+  }                                                                            \
+  type *Get##Type##ArrayElements(type##Array array, jboolean *is_copy) {       \
+    auto *elements = _elements<type>(array);                                   \
+    if (elements != nullptr) {                                                 \
+      if (is_copy != nullptr) {                                                \
+        *is_copy = JNI_FALSE;                                                  \
+      }                                                                        \
+      ++_pinned;                                                               \
+    }                                                                          \
+    return elements;                                                           \
+  }                                                                            \
+  void Release##Type##ArrayElements(type##Array, type *, jint mode) noexcept { \
+    if (mode != JNI_COMMIT) {                                                  \
+      --_pinned;                                                               \
+    }                                                                          \
+  }                                                                            \
+  void Get##Type##ArrayRegion(type##Array array, jsize start, jsize len,       \
+                              type *buf) {                                     \
+    auto *o = _deref(array);                                                   \
+    if (o != nullptr &&                                                        \
+        _check_bounds(o->length, start, len,                                   \
+                      "java/lang/ArrayIndexOutOfBoundsException")) {           \
+      std::memcpy(buf, (type *)o->elements.data() + start,                     \
+                  (std::size_t)len * sizeof(type));                            \
+    }                                                                          \
+  }                                                                            \
+  void Set##Type##ArrayRegion(type##Array array, jsize start, jsize len,       \
+                              const type *buf) {                               \
+    auto *o = _deref(array);                                                   \
+    if (o != nullptr &&                                                        \
+        _check_bounds(o->length, start, len,                                   \
+                      "java/lang/ArrayIndexOutOfBoundsException")) {           \
+      std::memcpy((type *)o->elements.data() + start, buf,                     \
+                  (std::size_t)len * sizeof(type));                            \
+    }                                                                          \
+  }
+  JNI_CPP20_FAKE_PRIMITIVES(JNI_CPP20_FAKE_ARRAYS)
+#undef JNI_CPP20_FAKE_ARRAYS
+
+  jint RegisterNatives(jclass cls, const JNINativeMethod *methods, jint n) {
+    auto *c = _class_of(cls);
+    if (c == nullptr) {
+      return JNI_ERR;
+    }
+    for (jint i = 0; i < n; ++i) {
+      c->_natives.insert_or_assign(
+          std::pair{std::string{methods[i].name},
+                    std::string{methods[i].signature}},
+          methods[i].fnPtr);
+    }
+    return JNI_OK;
+  }
+
+  jint UnregisterNatives(jclass cls) {
+    auto *c = _class_of(cls);
+    if (c == nullptr) {
+      return JNI_ERR;
+    }
+    c->_natives.clear();
+    return JNI_OK;
+  }
+
+  jint MonitorEnter(jobject) const noexcept { return JNI_OK; }
+
+  jint MonitorExit(jobject) const noexcept { return JNI_OK; }
+
+  jint GetJavaVM(JavaVM **vm) noexcept {
+    *vm = &_vm;
+    return JNI_OK;
+  }
+
+  void GetStringRegion(jstring str, jsize start, jsize len, jchar *buf) {
+    auto *o = _deref(str);
+    if (o != nullptr &&
+        _check_bounds((jsize)o->chars.size(), start, len,
+                      "java/lang/StringIndexOutOfBoundsException")) {
+      std::memcpy(buf, o->chars.data() + start, (std::size_t)len * 2);
+    }
+  }
+
+  // NUL terminated, like HotSpot
+  void GetStringUTFRegion(jstring str, jsize start, jsize len, char *buf) {
+    auto *o = _deref(str);
+    if (o != nullptr &&
+        _check_bounds((jsize)o->chars.size(), start, len,
+                      "java/lang/StringIndexOutOfBoundsException")) {
+      auto utf = detail::fake_encode_mutf8(
+          std::u16string_view{o->chars}.substr((std::size_t)start,
+                                               (std::size_t)len));
+      std::memcpy(buf, utf.c_str(), utf.size() + 1);
+    }
+  }
+
+  void *GetPrimitiveArrayCritical(jarray array, jboolean *is_copy) {
+    auto *elements = _elements<unsigned char>(array);
+    if (elements != nullptr) {
+      if (is_copy != nullptr) {
+        *is_copy = JNI_FALSE;
+      }
+      ++_pinned;
+    }
+    return elements;
+  }
+
+  void ReleasePrimitiveArrayCritical(jarray, void *, jint mode) noexcept {
+    if (mode != JNI_COMMIT) {
+      --_pinned;
+    }
+  }
+
+  const jchar *GetStringCritical(jstring str, jboolean *is_copy) noexcept {
+    return GetStringChars(str, is_copy);
+  }
+
+  void ReleaseStringCritical(jstring str, const jchar *chars) noexcept {
+    ReleaseStringChars(str, chars);
+  }
+
+  jweak NewWeakGlobalRef(jobject obj) {
+    return (jweak)_new_ref(_deref(obj), JNIWeakGlobalRefType);
+  }
+
+  void DeleteWeakGlobalRef(jweak obj) {
+    _delete_ref(obj, JNIWeakGlobalRefType);
+  }
+
+  jobject NewDirectByteBuffer(void *address, jlong capacity) {
+    auto *buffer = _alloc(&_builtin(
+        "java/nio/DirectByteBuffer", &_builtin("java/nio/ByteBuffer")));
+    buffer->address = address;
+    buffer->capacity = capacity;
+    return _local(buffer);
+  }
+
+  void *GetDirectBufferAddress(jobject buf) noexcept {
+    auto *o = _deref(buf);
+    return o == nullptr ? nullptr : o->address;
+  }
+
+  jlong GetDirectBufferCapacity(jobject buf) noexcept {
+    auto *o = _deref(buf);
+    return o == nullptr || o->address == nullptr ? -1 : o->capacity;
+  }
+
+  jobjectRefType GetObjectRefType(jobject obj) noexcept {
+    auto it = obj == nullptr ? _refs.end() : _refs.find(obj);
+    return it == _refs.end() ? JNIInvalidRefType : it->second->type;
+  }
+
+#ifdef JNI_VERSION_21
+  jboolean IsVirtualThread(jobject) const noexcept { return JNI_FALSE; }
+#endif
+
+  template <class T> static constexpr const char *_element_desc() noexcept {
+    if constexpr (std::is_same_v<T, jboolean>) {
+      return "Z";
+    } else if constexpr (std::is_same_v<T, jbyte>) {
+      return "B";
+    } else if constexpr (std::is_same_v<T, jchar>) {
+      return "C";
+    } else if constexpr (std::is_same_v<T, jshort>) {
+      return "S";
+    } else if constexpr (std::is_same_v<T, jint>) {
+      return "I";
+    } else if constexpr (std::is_same_v<T, jlong>) {
+      return "J";
+    } else if constexpr (std::is_same_v<T, jfloat>) {
+      return "F";
+    } else {
+      return "D";
+    }
+  }
+
+  detail::fake_object *_string(std::u16string chars) {
+    auto *str = _alloc(_string_class);
+    str->chars = std::move(chars);
+    return str;
+  }
+
+  // C variadic entries, forwarding to the A implementations (lambdas with C
+  // variadic parameters don't convert to function pointers everywhere)
+#define JNI_CPP20_FAKE_VARIADIC(Type, type, member)                            \
+  static type JNICALL _variadic_Call##Type##Method(JNIEnv *env, jobject obj,   \
+                                                   jmethodID id, ...) {        \
+    va_list args;                                                              \
+    va_start(args, id);                                                        \
+    auto &self = _self(env);                                                   \
+    self._count(fake_fn::Call##Type##Method);                                  \
+    auto values = _unpack(id, args);                                           \
+    va_end(args);                                                              \
+    return self.Call##Type##MethodA(obj, id, values.data());                   \
+  }                                                                            \
+  static type JNICALL _variadic_CallNonvirtual##Type##Method(                  \
+      JNIEnv *env, jobject obj, jclass cls, jmethodID id, ...) {               \
+    va_list args;                                                              \
+    va_start(args, id);                                                        \
+    auto &self = _self(env);                                                   \
+    self._count(fake_fn::CallNonvirtual##Type##Method);                        \
+    auto values = _unpack(id, args);                                           \
+    va_end(args);                                                              \
+    return self.CallNonvirtual##Type##MethodA(obj, cls, id, values.data());    \
+  }                                                                            \
+  static type JNICALL _variadic_CallStatic##Type##Method(                      \
+      JNIEnv *env, jclass cls, jmethodID id, ...) {                            \
+    va_list args;                                                              \
+    va_start(args, id);                                                        \
+    auto &self = _self(env);                                                   \
+    self._count(fake_fn::CallStatic##Type##Method);                            \
+    auto values = _unpack(id, args);                                           \
+    va_end(args);                                                              \
+    return self.CallStatic##Type##MethodA(cls, id, values.data());             \
+  }
+  JNI_CPP20_FAKE_VARIADIC(Object, jobject, l)
+  JNI_CPP20_FAKE_VARIADIC(Void, void, v)
+  JNI_CPP20_FAKE_PRIMITIVES(JNI_CPP20_FAKE_VARIADIC)
+#undef JNI_CPP20_FAKE_VARIADIC
+
+  static jobject JNICALL _variadic_NewObject(JNIEnv *env, jclass cls,
+                                             jmethodID id, ...) {
+    va_list args;
+    va_start(args, id);
+    auto &self = _self(env);
+    self._count(fake_fn::NewObject);
+    auto values = _unpack(id, args);
+    va_end(args);
+    return self.NewObjectA(cls, id, values.data());
+  }
+
+public:
+  explicit fake_jvm(jint version = JNI_VERSION_1_8) : _version(version) {
+    _class_class = nullptr;
+    _object_class = &_define("java/lang/Object", nullptr);
+    _class_class = &_define("java/lang/Class", _object_class);
+    for (auto *c : {_object_class, _class_class}) {
+      c->_object = _alloc(_class_class);
+      c->_object->as_class = c;
+    }
+    _string_class = &_define("java/lang/String", _object_class);
+    _throwable_class = &_define("java/lang/Throwable", _object_class);
+    _throwable_class->method(
+        "getMessage", "()Ljava/lang/String;", [](fake_call &c) {
+          auto &self = c.jvm;
+          auto *obj = self._deref(c.self);
+          return jvalue{.l = obj == nullptr
+                                 ? nullptr
+                                 : (jobject)self.new_string(obj->message)};
+        });
+
+    // Generic lambdas convert to the exact function pointer type of each
+    // entry, and forward to the implementation of the same name if any
+#define JNI_CPP20_FAKE_THUNK(name)                                             \
+  _functions.name =                                                            \
+      [](JNIEnv *env, auto... args)                                            \
+      -> detail::fake_result_t<decltype(JNINativeInterface_::name)> {          \
+    typename detail::fake_dependent<fake_jvm, decltype(args)...>::type &self = \
+        _self(env);                                                            \
+    self._count(fake_fn::name);                                                \
+    if constexpr (requires { self.name(args...); }) {                          \
+      return self.name(args...);                                               \
+    } else {                                                                   \
+      ++self._unscripted;                                                      \
+      return detail::fake_result_t<decltype(JNINativeInterface_::name)>();     \
+    }                                                                          \
+  };
+#define JNI_CPP20_FAKE_SKIP(name)
+    JNI_CPP20_FAKE_ENV_FUNCTIONS(JNI_CPP20_FAKE_THUNK, JNI_CPP20_FAKE_SKIP)
+#undef JNI_CPP20_FAKE_SKIP
+#undef JNI_CPP20_FAKE_THUNK
+
+#define JNI_CPP20_FAKE_VARIADIC(Type, type, member)                            \
+  _functions.Call##Type##Method = &_variadic_Call##Type##Method;               \
+  _functions.CallNonvirtual##Type##Method =                                    \
+      &_variadic_CallNonvirtual##Type##Method;                                 \
+  _functions.CallStatic##Type##Method = &_variadic_CallStatic##Type##Method;
+    JNI_CPP20_FAKE_VARIADIC(Object, jobject, l)
+    JNI_CPP20_FAKE_VARIADIC(Void, void, v)
+    JNI_CPP20_FAKE_PRIMITIVES(JNI_CPP20_FAKE_VARIADIC)
+#undef JNI_CPP20_FAKE_VARIADIC
+    _functions.NewObject = &_variadic_NewObject;
+
+    _vm_functions.DestroyJavaVM = [](JavaVM *vm) -> jint {
+      _self(vm)._count(fake_fn::DestroyJavaVM);
+      return JNI_OK;
+    };
+    _vm_functions.AttachCurrentThread = [](JavaVM *vm, void **penv,
+                                           void *) -> jint {
+      auto &self = _self(vm);
+      self._count(fake_fn::AttachCurrentThread);
+      *penv = static_cast<JNIEnv *>(&self._env);
+      return JNI_OK;
+    };
+    _vm_functions.DetachCurrentThread = [](JavaVM *vm) -> jint {
+      _self(vm)._count(fake_fn::DetachCurrentThread);
+      return JNI_OK;
+    };
+    _vm_functions.GetEnv = [](JavaVM *vm, void **penv, jint version) -> jint {
+      auto &self = _self(vm);
+      self._count(fake_fn::GetEnv);
+      if (version > self._version) {
+        *penv = nullptr;
+        return JNI_EVERSION;
+      }
+      *penv = static_cast<JNIEnv *>(&self._env);
+      return JNI_OK;
+    };
+    _vm_functions.AttachCurrentThreadAsDaemon = [](JavaVM *vm, void **penv,
+                                                   void *) -> jint {
+      auto &self = _self(vm);
+      self._count(fake_fn::AttachCurrentThreadAsDaemon);
+      *penv = static_cast<JNIEnv *>(&self._env);
+      return JNI_OK;
+    };
+
+    _env.functions = &_functions;
+    _env.owner = this;
+    _vm.functions = &_vm_functions;
+    _vm.owner = this;
+  }
+
+  fake_jvm(const fake_jvm &) = delete;
+  fake_jvm &operator=(const fake_jvm &) = delete;
+
+  JNIEnv &env() noexcept { return _env; }
+  JavaVM &vm() noexcept { return _vm; }
+
+  /// JVM wrapper of the fake, destroying it only counts a DestroyJavaVM
+  JVM make_jvm() {
+    dpsg::result<JVM, JVM::error> jvm{dpsg::in_place_value, &_vm,
+                                      static_cast<JNIEnv *>(&_env)};
+    return std::move(jvm.value());
+  }
+
+  /// Declares a class, or returns the class of that name if it was already
+  /// declared. The superclass must have been declared before.
+  fake_class &define_class(std::string_view name,
+                           std::string_view super = "java/lang/Object") {
+    auto *s = _find(super);
+    return _define(name, s != nullptr ? s : _object_class);
+  }
+
+  fake_class *find_class(std::string_view name) noexcept {
+    return _find(name);
+  }
+
+  /// @name Counters
+  /// @{
+  std::size_t count(fake_fn f) const noexcept {
+    return _counts[(std::size_t)f];
+  }
+  /// Total number of calls through the function tables
+  std::size_t crossings() const noexcept {
+    std::size_t total = 0;
+    for (auto c : _counts) {
+      total += c;
+    }
+    return total;
+  }
+  /// Calls to entry points without a fake implementation
+  std::size_t unscripted() const noexcept { return _unscripted; }
+  void reset_counts() noexcept {
+    _counts = {};
+    _unscripted = 0;
+  }
+
+  std::size_t local_refs() const noexcept { return _refs_of(JNILocalRefType); }
+  std::size_t global_refs() const noexcept {
+    return _refs_of(JNIGlobalRefType);
+  }
+  std::size_t weak_refs() const noexcept {
+    return _refs_of(JNIWeakGlobalRefType);
+  }
+  /// Uses of deleted or unknown references, and unbalanced frames
+  std::size_t invalid_refs() const noexcept { return _invalid_refs; }
+  /// String and array contents acquired and not released yet
+  std::size_t pinned() const noexcept { return _pinned + _utf_chars.size(); }
+  /// @}
+
+  /// @name Helpers for method bodies, not counted
+  /// @{
+  jstring new_string(std::string_view utf) {
+    return (jstring)_local(_string(detail::fake_decode_mutf8(utf)));
+  }
+  jstring new_string(std::u16string_view chars) {
+    return (jstring)_local(_string(std::u16string{chars}));
+  }
+  /// Modified UTF-8 contents of a string
+  std::string utf8(jobject str) {
+    auto *o = _deref(str);
+    return o == nullptr ? std::string{} : detail::fake_encode_mutf8(o->chars);
+  }
+  /// New instance of a class, without calling any constructor
+  jobject new_object(std::string_view cls) {
+    auto *c = _find(cls);
+    return c == nullptr ? nullptr : _local(_alloc(c));
+  }
+  /// Throws a new instance of cls (a subclass of java/lang/Throwable,
+  /// defined if needed)
+  void throw_new(std::string_view cls, std::string message) {
+    _throw(cls, std::move(message));
+  }
+  /// Class name and message of the pending exception, empty if none
+  std::pair<std::string, std::string> pending_exception() const {
+    if (_exception == nullptr) {
+      return {};
+    }
+    return {_exception->cls->_name, _exception->message};
+  }
+  /// @}
+
+  /// Frees the objects unreachable from references, classes and static
+  /// fields, and clears the weak references to them
+  void collect() {
+    for (auto &obj : _heap) {
+      obj->marked = false;
+    }
+    for (auto &[handle, r] : _refs) {
+      if (r->type != JNIWeakGlobalRefType) {
+        _mark(r->object);
+      }
+    }
+    for (auto &[name, cls] : _classes) {
+      _mark(cls->_object);
+      for (auto &f : cls->_fields) {
+        _mark(f.value.object);
+      }
+    }
+    _mark(_exception);
+    for (auto &[handle, r] : _refs) {
+      if (r->object != nullptr && !r->object->marked) {
+        r->object = nullptr;
+      }
+    }
+    std::erase_if(_heap, [](auto &obj) { return !obj->marked; });
+  }
+
+  std::size_t heap_size() const noexcept { return _heap.size(); }
+
+private:
+  std::size_t _refs_of(jobjectRefType type) const noexcept {
+    std::size_t n = 0;
+    for (auto &[handle, r] : _refs) {
+      n += r->type == type;
+    }
+    return n;
+  }
+};
+
+inline fake_class &fake_class::static_field(std::string name,
+                                            std::string signature,
+                                            jvalue value) {
+  detail::fake_slot slot{value, nullptr};
+  if (detail::fake_is_reference(signature)) {
+    slot = {{}, _jvm._deref(value.l)};
+  }
+  _fields.push_back({std::move(name), std::move(signature), true, slot});
+  return *this;
+}
+
+#endif // HEADER_GUARD_DPSG_JNI_FAKE_HPP
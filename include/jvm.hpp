@@ -11,8 +11,73 @@
 #include <cassert>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+
+/** Options of JNI_CreateJavaVM, owning their strings.
+ *
+ * @code
+ * auto options = jvm_options{}.class_path("game.jar").perf_map();
+ * auto jvm = JVM::create(options);
+ * @endcode
+ */
+class jvm_options {
+  std::vector<std::string> _options;
+  std::vector<JavaVMOption> _raw;
+  JavaVMInitArgs _args{};
+
+public:
+  explicit jvm_options(jint version = JNI_VERSION_1_8) noexcept {
+    _args.version = version;
+  }
+
+  /// Adds a raw option, e.g. "-Xmx512m"
+  jvm_options &add(std::string option) {
+    _options.push_back(std::move(option));
+    return *this;
+  }
+
+  jvm_options &class_path(std::string_view path) {
+    return add("-Djava.class.path=" + std::string{path});
+  }
+
+  /** @brief Makes JIT-compiled Java frames visible to Linux perf.
+   *
+   * @details The JVM writes /tmp/perf-<pid>.map, the symbol file perf reads
+   * for code without an ELF image, when it exits (JDK 17 and later; `jcmd
+   * <pid> Compiler.perfmap` dumps it at any time), and keeps the frame pointer
+   * in compiled code so that perf can walk from C++ frames through Java ones
+   * (`perf record -g`). See also call_profiler.hpp.
+   */
+  jvm_options &perf_map() {
+    return add("-XX:+UnlockDiagnosticVMOptions")
+        .add("-XX:+DumpPerfMapAtExit")
+        .add("-XX:+PreserveFramePointer");
+  }
+
+  /// Options starting with -X or _ unknown to the JVM are ignored instead of
+  /// failing its creation
+  jvm_options &ignore_unrecognized(bool ignore = true) {
+    _args.ignoreUnrecognized = ignore ? JNI_TRUE : JNI_FALSE;
+    return *this;
+  }
+
+  /// Arguments for JNI_CreateJavaVM, valid until the options are modified
+  JavaVMInitArgs *args() {
+    _raw.clear();
+    for (auto &option : _options) {
+      _raw.push_back(JavaVMOption{option.data(), nullptr});
+    }
+    _args.nOptions = (jint)_raw.size();
+    _args.options = _raw.data();
+    return &_args;
+  }
+};
 
 class JVM {
+  // Resources Java may still use (e.g. memory behind direct buffers),
+  // released after the JVM is destroyed
+  std::vector<std::shared_ptr<void>> _retained;
   std::unique_ptr<JavaVM, void (*)(JavaVM *)> _jvm;
   JNIEnv *_env = nullptr;
 
@@ -20,24 +85,31 @@ class JVM {
   JVM(JavaVM *jvm, JNIEnv *env) : _env(env), _jvm(jvm, &destroy_jvm) {}
 
 public:
-  ~JVM() = default;
+  ~JVM() {
+    if (_jvm) {
+      ref_tracker::report_leaks();
+    }
+  }
 
   JVM(const JVM &) = delete;
   JVM &operator=(const JVM &) = delete;
   JVM(JVM &&old)
   noexcept
-      : _env{std::exchange(old._env, nullptr)}, _jvm{std::exchange(old._jvm,
-                                                                   nullptr)} {}
+      : _retained{std::move(old._retained)},
+        _jvm{std::exchange(old._jvm, nullptr)},
+        _env{std::exchange(old._env, nullptr)} {}
   JVM &operator=(JVM &&old) noexcept {
     std::swap(_env, old._env);
     std::swap(_jvm, old._jvm);
+    std::swap(_retained, old._retained);
     return *this;
   }
 
   template <class T>
   requires JNIObject<T>
-  constexpr java_ref<T> _ref(T ptr) noexcept {
-    return java_ref<T>{ptr, _env};
+  constexpr java_ref<T> _ref(T ptr,
+                            ref_site site = ref_site::current()) noexcept {
+    return java_ref<T>{ptr, _env, site};
   }
 
 public:
@@ -66,27 +138,49 @@ public:
     return dpsg::result<JVM, error>{JVM{jvm, env}};
   }
 
+  static dpsg::result<JVM, error> create(jvm_options &options) {
+    return create(options.args());
+  }
+
   JNIEnv &get_env() { return *_env; }
 
+  /// The JavaVM, usable from any thread (e.g. to attach it, see
+  /// jvm_thread.hpp)
+  JavaVM *get_vm() const noexcept { return _jvm.get(); }
+
   JNIEnv &operator*() { return get_env(); }
 
   JNIEnv *operator->() { return &get_env(); }
 
+  /// Keeps resource alive until the JVM is destroyed or release() is called
+  void retain(std::shared_ptr<void> resource) {
+    _retained.push_back(std::move(resource));
+  }
+
+  /// Stops retaining resource, Java must not use it anymore
+  void release(const void *resource) noexcept {
+    std::erase_if(_retained, [resource](const std::shared_ptr<void> &r) {
+      return r.get() == resource;
+    });
+  }
+
   bool has_exception() { return _env->ExceptionCheck(); }
 
-  java_ref<jthrowable> get_exception() {
+  java_ref<jthrowable> get_exception(ref_site site = ref_site::current()) {
     jthrowable exception = _env->ExceptionOccurred();
     _env->ExceptionClear();
-    return _ref(exception);
+    return _ref(exception, site);
   }
 
-  java_ref<jclass> find_class(const char *name) {
-    return _ref(_env->FindClass(name));
+  java_ref<jclass> find_class(const char *name,
+                              ref_site site = ref_site::current()) {
+    return _ref(_env->FindClass(name), site);
   }
 
   template <jni_type_desc T>
-  std::optional<java_class<T::name>> find_class() {
-    auto p = find_class(T::name);
+  std::optional<java_class<T::name>>
+  find_class(ref_site site = ref_site::current()) {
+    auto p = find_class(T::name, site);
     if (p == nullptr) {
       return std::nullopt;
     }
@@ -94,10 +188,11 @@ public:
     return java_class<T::name>{std::move(p), _env};
   }
 
-  java_string<true> new_string(const char *str) {
+  java_string<true> new_string(const char *str,
+                               ref_site site = ref_site::current()) {
     auto r = _env->NewStringUTF(str);
     assert(r != nullptr && "NewStringUTF returned nullptr");
-    return java_string<true>{r, _env};
+    return java_string<true>{r, _env, site};
   }
 };
 
@@ -0,0 +1,102 @@
+#ifndef HEADER_GUARD_DPSG_JVM_THREAD_HPP
+#define HEADER_GUARD_DPSG_JVM_THREAD_HPP
+
+#include "dsl.hpp"
+#include "java_class.hpp"
+#include "jvm.hpp"
+#include "result.hpp"
+
+#include <jni.h>
+
+#include <optional>
+#include <utility>
+
+/** Attachment of native threads to the JVM.
+ *
+ * A JNIEnv is only valid on the thread it was obtained on, and threads
+ * created from C++ have none until they are attached to the JVM. An
+ * attached_thread attaches the current thread for its lifetime, and detaches
+ * it on destruction unless the thread was already attached. It must be
+ * destroyed on the thread that created it.
+ *
+ * @code
+ * std::thread worker{[vm = jvm.get_vm()] {
+ *   auto thread = unwrap(attached_thread::attach(*vm, "worker"));
+ *   auto cls = unwrap(thread.find_class<java_class_desc<"Hello">>());
+ * }};
+ * @endcode
+ */
+class attached_thread {
+  JavaVM *_vm = nullptr;
+  JNIEnv *_env = nullptr;
+  bool _owned = false;
+
+  attached_thread(JavaVM *vm, JNIEnv *env, bool owned) noexcept
+      : _vm(vm), _env(env), _owned(owned) {}
+
+public:
+  constexpr static inline jint version = JNI_VERSION_1_8;
+
+  friend typename dpsg::result<attached_thread, JVM::error>;
+
+  /** @brief Attaches the current thread to vm.
+   *
+   * @param[in] name Name of the java.lang.Thread, may be nullptr
+   * @param[in] daemon Attaches as a daemon thread: the JVM can be destroyed
+   * while it is still attached
+   */
+  static dpsg::result<attached_thread, JVM::error>
+  attach(JavaVM &vm, const char *name = nullptr, bool daemon = false) {
+    JNIEnv *env = nullptr;
+    auto res = vm.GetEnv((void **)&env, version);
+    if (res == JNI_OK) {
+      return dpsg::result<attached_thread, JVM::error>{
+          attached_thread{&vm, env, false}};
+    }
+    if (res != JNI_EDETACHED) {
+      return (JVM::error)res;
+    }
+    JavaVMAttachArgs args{version, const_cast<char *>(name), nullptr};
+    res = daemon ? vm.AttachCurrentThreadAsDaemon((void **)&env, &args)
+                 : vm.AttachCurrentThread((void **)&env, &args);
+    if (res != JNI_OK) {
+      return (JVM::error)res;
+    }
+    return dpsg::result<attached_thread, JVM::error>{
+        attached_thread{&vm, env, true}};
+  }
+
+  attached_thread(attached_thread &&other) noexcept
+      : _vm(std::exchange(other._vm, nullptr)),
+        _env(std::exchange(other._env, nullptr)),
+        _owned(std::exchange(other._owned, false)) {}
+  attached_thread &operator=(attached_thread &&) = delete;
+  attached_thread(const attached_thread &) = delete;
+  attached_thread &operator=(const attached_thread &) = delete;
+
+  ~attached_thread() {
+    if (_owned) {
+      _vm->DetachCurrentThread();
+    }
+  }
+
+  JNIEnv &get_env() const noexcept { return *_env; }
+  JNIEnv &operator*() const noexcept { return *_env; }
+  JNIEnv *operator->() const noexcept { return _env; }
+
+  /// False if the thread was already attached when this object was created
+  bool owns_attachment() const noexcept { return _owned; }
+
+  /// Same as JVM::find_class, for the attached thread
+  template <jni_type_desc T>
+  std::optional<java_class<T::name>>
+  find_class(ref_site site = ref_site::current()) const {
+    jclass cls = _env->FindClass(T::name);
+    if (cls == nullptr) {
+      return std::nullopt;
+    }
+    return java_class<T::name>{cls, _env, site};
+  }
+};
+
+#endif // HEADER_GUARD_DPSG_JVM_THREAD_HPP
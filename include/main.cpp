@@ -1,3 +1,5 @@
+#include "call_plan.hpp"
+#include "java_chunks.hpp"
 #include "jvm.hpp"
 
 #include <jni.h>
@@ -8,6 +10,7 @@
 #include <iostream>
 #include <memory>
 #include <optional>
+#include <tuple>
 namespace meta = dpsg::meta;
 
 template <class T>
@@ -59,41 +62,30 @@ int main() {
   auto properties_ctor = unwrap(properties_cls.get_constructor_id<>());
   auto properties = unwrap(properties_cls.instantiate(properties_ctor));
   auto game_runner = unwrap(game_runner_cls.instantiate(game_runner_ctor));
-  auto game_runner_initialize = unwrap(game_runner_cls.get_class_method_id<"initialize", void(java::util::Properties)>());
-  auto game_runner_add_agent = unwrap(game_runner_cls.get_class_method_id<"addAgent", void(java::lang::String, java::lang::String)>());
+  auto game_runner_initialize = unwrap(game_runner_cls.get_method_id<"initialize", void(java::util::Properties)>());
+  auto game_runner_add_agent = unwrap(game_runner_cls.get_method_id<"addAgent", void(java::lang::String, java::lang::String)>());
+  auto game_runner_run_agents = unwrap(game_runner_cls.get_method_id<"runAgents", void()>());
+  auto game_runner_get_json_result = unwrap(game_runner_cls.get_method_id<"getJSONResult", java::lang::String()>());
   auto player1_cmd = jvm.new_string("/home/depassage/workspace/codingame-fall2023/ais/basic");
   auto player2_cmd = jvm.new_string("/home/depassage/workspace/codingame-fall2023/ais/basic-hunter");
 
-  game_runner_cls.call(game_runner_add_agent, game_runner, player1_cmd, player1_cmd);
-  if (jvm->ExceptionCheck()) {
-    jvm->ExceptionDescribe();
-  }
-  game_runner_cls.call(game_runner_add_agent, game_runner, player2_cmd, player2_cmd);
-  if (jvm->ExceptionCheck()) {
-    jvm->ExceptionDescribe();
-  }
-
-  game_runner_cls.call(game_runner_initialize, game_runner, properties);
-  if (jvm->ExceptionCheck()) {
-    jvm->ExceptionDescribe();
-  }
-
-  auto game_runner_run_agent = unwrap(game_runner_cls.get_class_method_id<"runAgents", void()>());
-  game_runner_cls.call(game_runner_run_agent, game_runner);
-  if (jvm->ExceptionCheck()) {
-    jvm->ExceptionDescribe();
-  }
-
-  auto game_runner_get_json_result = unwrap(game_runner_cls.get_class_method_id<"getJSONResult", java::lang::String()>());
-  auto json_result = game_runner_cls.call(game_runner_get_json_result, game_runner);
-  if (jvm->ExceptionCheck()) {
+  // Resolved once, can be run for every match
+  auto match = make_call_plan(game_runner_cls, game_runner_add_agent,
+                              game_runner_add_agent, game_runner_initialize,
+                              game_runner_run_agents,
+                              game_runner_get_json_result);
+  auto json_result = match.run(game_runner,
+                               std::forward_as_tuple(player1_cmd, player1_cmd),
+                               std::forward_as_tuple(player2_cmd, player2_cmd),
+                               std::forward_as_tuple(properties), std::tuple{},
+                               std::tuple{});
+  if (!dpsg::ok(json_result)) {
+    auto &error = dpsg::get_error(json_result);
+    std::cerr << "step " << error.step << " of the match threw" << std::endl;
+    jvm->Throw(error.exception.get());
     jvm->ExceptionDescribe();
+    return EXIT_FAILURE;
   }
 
-  auto len = jvm->GetStringLength(json_result.get());
-  auto ptr = jvm->GetStringChars(json_result.get(), nullptr);
-  for (size_t i = 0; i < len; ++i) {
-    std::cout << (char)ptr[i];
-  }
-  std::cout << json_result.get_raw_string() << std::endl;
+  write_utf8(std::cout, dpsg::get_result(json_result)) << std::endl;
 }
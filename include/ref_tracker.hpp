@@ -0,0 +1,244 @@
+#ifndef HEADER_GUARD_DPSG_REF_TRACKER_HPP
+#define HEADER_GUARD_DPSG_REF_TRACKER_HPP
+
+/** Diagnostics for JNI references held by java_ref.
+ *
+ * Enabled by defining JNI_CPP20_TRACK_REFS (CMake option of the same name).
+ * When disabled every hook below is an empty inline function and java_ref is
+ * unchanged.
+ *
+ * When enabled:
+ *  + global and weak global references are registered, with the source
+ *    location of their creation, in a registry sharded by reference value,
+ *    so creating or deleting one takes a single uncontended lock in practice;
+ *  + local references are registered in a thread-local table (they can't
+ *    cross threads), without any locking;
+ *  + the number of live local references of the current thread is compared
+ *    to the capacity of the current local frame, and a warning is emitted
+ *    once when it goes over `warning_ratio` of it;
+ *  + references still alive when the JVM object is destroyed are reported
+ *    as leaks.
+ *
+ * Events go to the reporter installed with ref_tracker::set_reporter, by
+ * default a one-line message on std::cerr.
+ *
+ * References returned by java_class::call and instantiate are recorded at the
+ * site where the method was resolved (get_method_id, get_constructor_id...),
+ * which the method handle keeps: a trailing source location can't follow
+ * the arguments of call.
+ */
+
+#include <cstddef>
+
+#ifdef JNI_CPP20_TRACK_REFS
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <source_location>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#endif
+
+enum class ref_kind { local, global, weak };
+
+inline const char *to_string(ref_kind kind) noexcept {
+  switch (kind) {
+  case ref_kind::local:
+    return "local";
+  case ref_kind::global:
+    return "global";
+  case ref_kind::weak:
+    return "weak global";
+  }
+  return "unknown";
+}
+
+#ifdef JNI_CPP20_TRACK_REFS
+
+using ref_site = std::source_location;
+
+class ref_tracker {
+public:
+  struct event {
+    enum class type { leak, local_pressure } what;
+    ref_kind kind;
+    const void *ref;
+    ref_site site;
+    std::thread::id thread;
+    std::size_t live_locals; // only meaningful for local_pressure
+    std::size_t capacity;    // only meaningful for local_pressure
+  };
+  using reporter = std::function<void(const event &)>;
+
+  /// Capacity guaranteed by the JVM for every local frame
+  static constexpr std::size_t default_local_capacity = 16;
+  static constexpr double warning_ratio = 0.8;
+
+private:
+  struct record {
+    ref_kind kind;
+    ref_site site;
+    std::thread::id thread;
+  };
+
+  struct alignas(64) shard {
+    std::mutex mutex;
+    std::unordered_map<const void *, record> refs;
+  };
+  static constexpr std::size_t shard_count = 32;
+
+  struct thread_state {
+    std::unordered_map<const void *, ref_site> locals;
+    std::size_t capacity = default_local_capacity;
+    bool warned = false;
+  };
+
+  std::array<shard, shard_count> _shards;
+  std::mutex _reporter_mutex;
+  reporter _reporter = &default_reporter;
+
+  static ref_tracker &instance() {
+    static ref_tracker tracker;
+    return tracker;
+  }
+
+  static thread_state &this_thread() {
+    thread_local thread_state state;
+    return state;
+  }
+
+  shard &shard_for(const void *ref) noexcept {
+    // JNI references are at least pointer-aligned, skip the low bits
+    return _shards[(reinterpret_cast<std::uintptr_t>(ref) >> 4) % shard_count];
+  }
+
+  void report(const event &e) {
+    std::lock_guard lock{_reporter_mutex};
+    if (_reporter) {
+      _reporter(e);
+    }
+  }
+
+  static void default_reporter(const event &e) {
+    if (e.what == event::type::leak) {
+      std::cerr << "[jni-cpp20] leaked " << to_string(e.kind) << " reference "
+                << e.ref << " created at ";
+    } else {
+      std::cerr << "[jni-cpp20] " << e.live_locals
+                << " live local references (frame capacity " << e.capacity
+                << "), latest created at ";
+    }
+    std::cerr << e.site.file_name() << ":" << e.site.line() << " ("
+              << e.site.function_name() << ")\n";
+  }
+
+public:
+  static void track(const void *ref, ref_kind kind, ref_site site) {
+    if (ref == nullptr) {
+      return;
+    }
+    if (kind == ref_kind::local) {
+      auto &state = this_thread();
+      state.locals.insert_or_assign(ref, site);
+      auto live = state.locals.size();
+      if (!state.warned && live >= state.capacity * warning_ratio) {
+        state.warned = true;
+        instance().report(event{event::type::local_pressure, kind, ref, site,
+                                std::this_thread::get_id(), live,
+                                state.capacity});
+      }
+      return;
+    }
+    auto &s = instance().shard_for(ref);
+    std::lock_guard lock{s.mutex};
+    s.refs.insert_or_assign(ref,
+                            record{kind, site, std::this_thread::get_id()});
+  }
+
+  static void untrack(const void *ref, ref_kind kind) {
+    if (ref == nullptr) {
+      return;
+    }
+    if (kind == ref_kind::local) {
+      auto &state = this_thread();
+      state.locals.erase(ref);
+      if (state.locals.size() < state.capacity * warning_ratio) {
+        state.warned = false;
+      }
+      return;
+    }
+    auto &s = instance().shard_for(ref);
+    std::lock_guard lock{s.mutex};
+    s.refs.erase(ref);
+  }
+
+  /// Declares the capacity of the local frame the current thread runs in
+  /// (e.g. after EnsureLocalCapacity or PushLocalFrame).
+  static void set_local_capacity(std::size_t capacity) noexcept {
+    auto &state = this_thread();
+    state.capacity = capacity;
+    state.warned = false;
+  }
+
+  static std::size_t live_locals() noexcept {
+    return this_thread().locals.size();
+  }
+
+  static std::size_t live_globals() {
+    std::size_t total = 0;
+    for (auto &s : instance()._shards) {
+      std::lock_guard lock{s.mutex};
+      total += s.refs.size();
+    }
+    return total;
+  }
+
+  static void set_reporter(reporter r) {
+    auto &self = instance();
+    std::lock_guard lock{self._reporter_mutex};
+    self._reporter = std::move(r);
+  }
+
+  /// Reports every global reference still registered, and the local
+  /// references still registered on the current thread. Returns the number
+  /// of leaks found.
+  static std::size_t report_leaks() {
+    auto &self = instance();
+    std::vector<event> leaks;
+    for (auto &s : self._shards) {
+      std::lock_guard lock{s.mutex};
+      for (auto &[ref, r] : s.refs) {
+        leaks.push_back(
+            event{event::type::leak, r.kind, ref, r.site, r.thread, 0, 0});
+      }
+    }
+    for (auto &[ref, site] : this_thread().locals) {
+      leaks.push_back(event{event::type::leak, ref_kind::local, ref, site,
+                            std::this_thread::get_id(), 0, 0});
+    }
+    for (auto &e : leaks) {
+      self.report(e);
+    }
+    return leaks.size();
+  }
+};
+
+#else // JNI_CPP20_TRACK_REFS
+
+struct ref_site {
+  static constexpr ref_site current() noexcept { return {}; }
+};
+
+struct ref_tracker {
+  static constexpr void track(const void *, ref_kind, ref_site) noexcept {}
+  static constexpr void untrack(const void *, ref_kind) noexcept {}
+  static constexpr void set_local_capacity(std::size_t) noexcept {}
+  static constexpr std::size_t report_leaks() noexcept { return 0; }
+};
+
+#endif // JNI_CPP20_TRACK_REFS
+
+#endif // HEADER_GUARD_DPSG_REF_TRACKER_HPP
@@ -3,16 +3,21 @@
 
 // See https://gist.github.com/de-passage/cabea442a4cc21fd3f0ce93e3a6ffbf3
 #include "is_template_instance.hpp"
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
 #include <type_traits>
 #include <utility>
-#include <variant>
 
 /** @file
  *
  * C++20 utilities to handle function results. The aim is to provide an easy
  * to use alternative to exceptions. The main tool provided is a sequence function
- * that allows to chain functions returning variants containing either a
+ * that allows to chain functions returning results containing either a
  * success or an error type, interrupting the chain on the first error.
+ * result<T, E> also offers the same chaining as member functions (and_then,
+ * map, or_else). Nothing in this file throws.
  *
  * This file depends on the [is_template_instance](https://gist.github.com/de-passage/cabea442a4cc21fd3f0ce93e3a6ffbf3)
  * utility.
@@ -49,12 +54,320 @@
 
 namespace dpsg {
 
-/// A function can either succeed and return T or fail and return E
-template <class T, class E> using result = std::variant<T, E>;
+template <class T, class E> class result;
 
-/** @brief Check whether a result expresses a success.
+/// @cond INTERNAL
+namespace detail {
+template <class R> struct is_result : std::false_type {};
+template <class T, class E> struct is_result<result<T, E>> : std::true_type {};
+
+template <class T, class E>
+constexpr bool trivially_copyable_payload =
+    std::is_trivially_copy_constructible_v<T> &&
+    std::is_trivially_copy_constructible_v<E> &&
+    std::is_trivially_copy_assignable_v<T> &&
+    std::is_trivially_copy_assignable_v<E> &&
+    std::is_trivially_destructible_v<T> && std::is_trivially_destructible_v<E>;
+
+template <class T, class E>
+constexpr bool trivially_movable_payload =
+    std::is_trivially_move_constructible_v<T> &&
+    std::is_trivially_move_constructible_v<E> &&
+    std::is_trivially_move_assignable_v<T> &&
+    std::is_trivially_move_assignable_v<E> &&
+    std::is_trivially_destructible_v<T> && std::is_trivially_destructible_v<E>;
+
+// Mirrors the choice of std::variant's converting constructor for the two
+// alternatives: an argument converting to both is only accepted if it is
+// exactly one of them.
+template <class U, class T, class E>
+constexpr bool selects_value =
+    !is_result<std::remove_cvref_t<U>>::value &&
+    std::is_convertible_v<U, T> &&
+    (!std::is_convertible_v<U, E> || std::is_same_v<std::remove_cvref_t<U>, T>);
+
+template <class U, class T, class E>
+constexpr bool selects_error =
+    !is_result<std::remove_cvref_t<U>>::value &&
+    std::is_convertible_v<U, E> && !selects_value<U, T, E> &&
+    (!std::is_convertible_v<U, T> || std::is_same_v<std::remove_cvref_t<U>, E>);
+} // namespace detail
+/// @endcond
+
+/// Tags used to build a result from arguments of the success or error value
+struct in_place_value_t {
+  explicit in_place_value_t() = default;
+};
+struct in_place_error_t {
+  explicit in_place_error_t() = default;
+};
+inline constexpr in_place_value_t in_place_value{};
+inline constexpr in_place_error_t in_place_error{};
+
+/** @brief A function can either succeed and return T or fail and return E
+ *
+ * @details A tagged union of T and E. Unlike std::variant it never throws:
+ * accessing the wrong alternative is a precondition violation (checked by an
+ * assertion in debug builds). It is trivially copyable when both T and E are,
+ * and usable in constant expressions.
  *
- *  @details This basically means that the variant contains the 0th alternative
+ * Converting construction follows std::variant's: the alternative @p U
+ * converts to is selected, so `return value;` and `return error;` work in
+ * functions returning a result.
+ */
+template <class T, class E> class result {
+  static_assert(!std::is_reference_v<T> && !std::is_reference_v<E>,
+                "result can't hold references");
+
+  union {
+    T _value;
+    E _error;
+  };
+  bool _ok;
+
+  template <class R> constexpr void _construct_from(R &&other) {
+    if (other._ok) {
+      std::construct_at(std::addressof(_value),
+                        std::forward<R>(other)._value);
+    } else {
+      std::construct_at(std::addressof(_error),
+                        std::forward<R>(other)._error);
+    }
+  }
+
+  constexpr void _destroy() noexcept {
+    if (_ok) {
+      std::destroy_at(std::addressof(_value));
+    } else {
+      std::destroy_at(std::addressof(_error));
+    }
+  }
+
+  template <class R> constexpr void _assign_from(R &&other) {
+    if (_ok && other._ok) {
+      _value = std::forward<R>(other)._value;
+    } else if (!_ok && !other._ok) {
+      _error = std::forward<R>(other)._error;
+    } else {
+      _destroy();
+      _construct_from(std::forward<R>(other));
+      _ok = other._ok;
+    }
+  }
+
+public:
+  using value_type = T;
+  using error_type = E;
+
+  constexpr result() noexcept(std::is_nothrow_default_constructible_v<T>)
+    requires std::is_default_constructible_v<T>
+      : _value(), _ok(true) {}
+
+  template <class U = T>
+    requires detail::selects_value<U, T, E>
+  constexpr result(U &&value) noexcept(std::is_nothrow_constructible_v<T, U>)
+      : _value(std::forward<U>(value)), _ok(true) {}
+
+  template <class U>
+    requires detail::selects_error<U, T, E>
+  constexpr result(U &&error) noexcept(std::is_nothrow_constructible_v<E, U>)
+      : _error(std::forward<U>(error)), _ok(false) {}
+
+  template <class... Args>
+  constexpr explicit result(in_place_value_t, Args &&...args)
+      : _value(std::forward<Args>(args)...), _ok(true) {}
+
+  template <class... Args>
+  constexpr explicit result(in_place_error_t, Args &&...args)
+      : _error(std::forward<Args>(args)...), _ok(false) {}
+
+  constexpr result(const result &)
+    requires detail::trivially_copyable_payload<T, E>
+  = default;
+  constexpr result(const result &other)
+    requires(!detail::trivially_copyable_payload<T, E> &&
+             std::is_copy_constructible_v<T> && std::is_copy_constructible_v<E>)
+      : _ok(other._ok) {
+    _construct_from(other);
+  }
+
+  constexpr result(result &&)
+    requires detail::trivially_movable_payload<T, E>
+  = default;
+  constexpr result(result &&other) noexcept(
+      std::is_nothrow_move_constructible_v<T> &&
+      std::is_nothrow_move_constructible_v<E>)
+    requires(!detail::trivially_movable_payload<T, E> &&
+             std::is_move_constructible_v<T> && std::is_move_constructible_v<E>)
+      : _ok(other._ok) {
+    _construct_from(std::move(other));
+  }
+
+  constexpr result &operator=(const result &)
+    requires detail::trivially_copyable_payload<T, E>
+  = default;
+  constexpr result &operator=(const result &other)
+    requires(!detail::trivially_copyable_payload<T, E> &&
+             std::is_copy_constructible_v<T> && std::is_copy_constructible_v<E> &&
+             std::is_copy_assignable_v<T> && std::is_copy_assignable_v<E>)
+  {
+    _assign_from(other);
+    return *this;
+  }
+
+  constexpr result &operator=(result &&)
+    requires detail::trivially_movable_payload<T, E>
+  = default;
+  constexpr result &operator=(result &&other) noexcept(
+      std::is_nothrow_move_constructible_v<T> &&
+      std::is_nothrow_move_constructible_v<E> &&
+      std::is_nothrow_move_assignable_v<T> &&
+      std::is_nothrow_move_assignable_v<E>)
+    requires(!detail::trivially_movable_payload<T, E> &&
+             std::is_move_constructible_v<T> && std::is_move_constructible_v<E> &&
+             std::is_move_assignable_v<T> && std::is_move_assignable_v<E>)
+  {
+    _assign_from(std::move(other));
+    return *this;
+  }
+
+  constexpr ~result()
+    requires(std::is_trivially_destructible_v<T> &&
+             std::is_trivially_destructible_v<E>)
+  = default;
+  constexpr ~result() { _destroy(); }
+
+  /// true if the object contains the success value
+  constexpr bool has_value() const noexcept { return _ok; }
+  constexpr explicit operator bool() const noexcept { return _ok; }
+
+  /// 0 for a success, 1 for an error, as std::variant<T, E>::index()
+  constexpr std::size_t index() const noexcept { return _ok ? 0 : 1; }
+
+  /// @pre has_value()
+  constexpr T &value() & noexcept {
+    assert(_ok && "value() called on an error result");
+    return _value;
+  }
+  constexpr const T &value() const & noexcept {
+    assert(_ok && "value() called on an error result");
+    return _value;
+  }
+  constexpr T &&value() && noexcept {
+    assert(_ok && "value() called on an error result");
+    return std::move(_value);
+  }
+  constexpr const T &&value() const && noexcept {
+    assert(_ok && "value() called on an error result");
+    return std::move(_value);
+  }
+
+  /// @pre !has_value()
+  constexpr E &error() & noexcept {
+    assert(!_ok && "error() called on a success result");
+    return _error;
+  }
+  constexpr const E &error() const & noexcept {
+    assert(!_ok && "error() called on a success result");
+    return _error;
+  }
+  constexpr E &&error() && noexcept {
+    assert(!_ok && "error() called on a success result");
+    return std::move(_error);
+  }
+  constexpr const E &&error() const && noexcept {
+    assert(!_ok && "error() called on a success result");
+    return std::move(_error);
+  }
+
+  /** @brief Chain an operation that may fail.
+   *
+   * @param[in] f Called with the success value, must return a result<U, E>
+   *
+   * @return The result of @p f, or the error contained in this object
+   */
+  template <class F> constexpr auto and_then(F &&f) & {
+    return _and_then(*this, std::forward<F>(f));
+  }
+  template <class F> constexpr auto and_then(F &&f) const & {
+    return _and_then(*this, std::forward<F>(f));
+  }
+  template <class F> constexpr auto and_then(F &&f) && {
+    return _and_then(std::move(*this), std::forward<F>(f));
+  }
+
+  /** @brief Transform the success value.
+   *
+   * @param[in] f Called with the success value, returns the new success value
+   *
+   * @return A result<U, E> containing the invocation of @p f or the error
+   * contained in this object
+   */
+  template <class F> constexpr auto map(F &&f) & {
+    return _map(*this, std::forward<F>(f));
+  }
+  template <class F> constexpr auto map(F &&f) const & {
+    return _map(*this, std::forward<F>(f));
+  }
+  template <class F> constexpr auto map(F &&f) && {
+    return _map(std::move(*this), std::forward<F>(f));
+  }
+
+  /** @brief Recover from an error.
+   *
+   * @param[in] f Called with the error value, must return a result<T, G>
+   *
+   * @return The result of @p f, or the success value contained in this object
+   */
+  template <class F> constexpr auto or_else(F &&f) & {
+    return _or_else(*this, std::forward<F>(f));
+  }
+  template <class F> constexpr auto or_else(F &&f) const & {
+    return _or_else(*this, std::forward<F>(f));
+  }
+  template <class F> constexpr auto or_else(F &&f) && {
+    return _or_else(std::move(*this), std::forward<F>(f));
+  }
+
+private:
+  template <class Self, class F>
+  static constexpr auto _and_then(Self &&self, F &&f) {
+    using R = std::remove_cvref_t<
+        std::invoke_result_t<F, decltype(std::forward<Self>(self)._value)>>;
+    static_assert(detail::is_result<R>::value,
+                  "and_then expects a function returning a result");
+    if (self._ok) {
+      return std::invoke(std::forward<F>(f), std::forward<Self>(self)._value);
+    }
+    return R{in_place_error, std::forward<Self>(self)._error};
+  }
+
+  template <class Self, class F>
+  static constexpr auto _map(Self &&self, F &&f) {
+    using U = std::remove_cvref_t<
+        std::invoke_result_t<F, decltype(std::forward<Self>(self)._value)>>;
+    using R = result<U, E>;
+    if (self._ok) {
+      return R{in_place_value,
+               std::invoke(std::forward<F>(f), std::forward<Self>(self)._value)};
+    }
+    return R{in_place_error, std::forward<Self>(self)._error};
+  }
+
+  template <class Self, class F>
+  static constexpr auto _or_else(Self &&self, F &&f) {
+    using R = std::remove_cvref_t<
+        std::invoke_result_t<F, decltype(std::forward<Self>(self)._error)>>;
+    static_assert(detail::is_result<R>::value,
+                  "or_else expects a function returning a result");
+    if (!self._ok) {
+      return std::invoke(std::forward<F>(f), std::forward<Self>(self)._error);
+    }
+    return R{in_place_value, std::forward<Self>(self)._value};
+  }
+};
+
+/** @brief Check whether a result expresses a success.
  *
  *  @param[in] r The object to inspect
  *
@@ -62,33 +375,33 @@ template <class T, class E> using result = std::variant<T, E>;
  *  the error value
  */
 template <class T, class U> constexpr bool ok(const result<T, U> &r) noexcept {
-  return r.index() == 0;
+  return r.has_value();
 }
 
 /** @brief Returns the success value contained in a result object.
  *
  * @param[in] r The result object to unpack
  *
- * @throw std::bad_variant_access Throws if the object represents an error
+ * @pre ok(r)
  *
  * @return The success value contained in @p r
  */
 constexpr decltype(auto)
-get_result(dpsg::template_instance_of<std::variant> auto &&r) {
-  return std::get<0>(std::forward<decltype(r)>(r));
+get_result(dpsg::template_instance_of<result> auto &&r) noexcept {
+  return std::forward<decltype(r)>(r).value();
 }
 
 /** @brief Returns the error value contained in a result object.
  *
  * @param[in] r The result object to unpack
  *
- * @throw std::bad_variant_access Throws if the object represents a success
+ * @pre !ok(r)
  *
  * @return The error value contained in @p r
  */
 constexpr decltype(auto)
-get_error(dpsg::template_instance_of<std::variant> auto &&r) {
-  return std::get<1>(std::forward<decltype(r)>(r));
+get_error(dpsg::template_instance_of<result> auto &&r) noexcept {
+  return std::forward<decltype(r)>(r).error();
 }
 
 /** @brief Apply a function to the content of a result object.
@@ -104,11 +417,15 @@ get_error(dpsg::template_instance_of<std::variant> auto &&r) {
  * the success and error values respectively.
  */
 template <class R, class F, class G,
-          class R1 = std::invoke_result_t<F, std::variant_alternative_t<0, R>>,
-          class R2 = std::invoke_result_t<G, std::variant_alternative_t<1, R>>,
+          class R1 = std::invoke_result_t<
+              F, decltype(get_result(std::declval<R>()))>,
+          class R2 = std::invoke_result_t<
+              G, decltype(get_error(std::declval<R>()))>,
           class R0 = std::common_type_t<R1, R2>>
-requires dpsg::template_instance_of<R, std::variant>
-constexpr R0 either(R &&r, F &&f, G &&g) noexcept {
+requires dpsg::template_instance_of<R, result>
+constexpr R0 either(R &&r, F &&f, G &&g) noexcept(
+    std::is_nothrow_invocable_v<F, decltype(get_result(std::declval<R>()))> &&
+    std::is_nothrow_invocable_v<G, decltype(get_error(std::declval<R>()))>) {
   if (ok(r)) {
     return std::forward<F>(f)(get_result(std::forward<decltype(r)>(r)));
   } else {
@@ -141,7 +458,7 @@ template <class F> error_handler(F &&) -> error_handler<std::decay_t<F>>;
 
 /// @cond INTERNAL
 template <class R, class ErrHandler, class F>
-requires dpsg::template_instance_of<R, std::variant> &&
+requires dpsg::template_instance_of<R, result> &&
     dpsg::template_instance_of<ErrHandler, error_handler>
 decltype(auto) sequence(R &&result, ErrHandler &&error_handler, F &&f) {
   return either(std::forward<R>(result), std::forward<F>(f),
@@ -177,7 +494,7 @@ decltype(auto) sequence(R &&result, ErrHandler &&error_handler, F &&f) {
  * in the sequence, otherwise the result of the last function call in the sequence.
  */
 template <class R, class ErrHandler, class F, class... Fs>
-requires dpsg::template_instance_of<R, std::variant> &&
+requires dpsg::template_instance_of<R, result> &&
     dpsg::template_instance_of<ErrHandler, error_handler>
 decltype(auto) sequence(R &&result, ErrHandler &&error_handler, F &&f, Fs &&...fs) {
   if (!ok(result)) {
@@ -0,0 +1,107 @@
+package dpsg.jni;
+
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.PrintStream;
+import java.nio.ByteBuffer;
+
+/**
+ * Agents of the CodinGame game runner implemented in C++, see java_agent.hpp.
+ *
+ * The runner runs the main method of an agent class in its own thread, with
+ * System.in and System.out connected to the referee. The main method of
+ * SlotN forwards every batch of complete lines it receives to the native
+ * agent bound to slot N, in one native call through direct buffers, and
+ * prints its answer.
+ */
+public final class NativeAgent {
+  private static final int INPUT = 1 << 16;
+  private static final int OUTPUT = 1 << 16;
+
+  private NativeAgent() {}
+
+  public static final class Slot0 {
+    public static void main(String[] args) throws IOException { run(0); }
+  }
+
+  public static final class Slot1 {
+    public static void main(String[] args) throws IOException { run(1); }
+  }
+
+  public static final class Slot2 {
+    public static void main(String[] args) throws IOException { run(2); }
+  }
+
+  public static final class Slot3 {
+    public static void main(String[] args) throws IOException { run(3); }
+  }
+
+  public static final class Slot4 {
+    public static void main(String[] args) throws IOException { run(4); }
+  }
+
+  public static final class Slot5 {
+    public static void main(String[] args) throws IOException { run(5); }
+  }
+
+  public static final class Slot6 {
+    public static void main(String[] args) throws IOException { run(6); }
+  }
+
+  public static final class Slot7 {
+    public static void main(String[] args) throws IOException { run(7); }
+  }
+
+  /** Forwards System.in to the native agent of slot until the end of input. */
+  public static void run(int slot) throws IOException {
+    // The agent bound now, later turns fail if it is unbound
+    long agent = acquire0(slot);
+    InputStream in = System.in;
+    PrintStream out = System.out;
+    byte[] chunk = new byte[8192];
+    byte[] answer = new byte[OUTPUT];
+    // input is filled up to its position, output is written by the agent
+    ByteBuffer input = ByteBuffer.allocateDirect(INPUT);
+    ByteBuffer output = ByteBuffer.allocateDirect(OUTPUT);
+    int read;
+    while ((read = in.read(chunk)) >= 0) {
+      input = append(input, chunk, read);
+      // Everything the referee has written so far, usually a whole turn
+      while (in.available() > 0 && (read = in.read(chunk)) > 0) {
+        input = append(input, chunk, read);
+      }
+      int end = input.position();
+      while (end > 0 && input.get(end - 1) != '\n') {
+        --end;
+      }
+      if (end == 0) {
+        continue;
+      }
+      int length = turn0(agent, input, end, output);
+      if (length > 0) {
+        output.clear();
+        output.get(answer, 0, length);
+        out.write(answer, 0, length);
+        out.flush();
+      }
+      // Keeps the incomplete line for the next batch
+      input.flip().position(end);
+      input.compact();
+    }
+  }
+
+  private static ByteBuffer append(ByteBuffer buffer, byte[] bytes, int length) {
+    if (buffer.remaining() < length) {
+      ByteBuffer larger = ByteBuffer.allocateDirect(
+          Math.max(2 * buffer.capacity(), buffer.position() + length));
+      buffer.flip();
+      larger.put(buffer);
+      buffer = larger;
+    }
+    return buffer.put(bytes, 0, length);
+  }
+
+  private static native long acquire0(int slot);
+
+  private static native int turn0(long agent, ByteBuffer input, int length, ByteBuffer output);
+}
@@ -0,0 +1,77 @@
+package dpsg.jni;
+
+import java.lang.reflect.InvocationHandler;
+import java.lang.reflect.Method;
+import java.util.HashMap;
+
+/**
+ * Invocation handler of the proxies created by java_proxy.hpp.
+ *
+ * Methods are mapped once, at construction, to their index in the native
+ * dispatch table, so a call costs a hash lookup and a single native call.
+ */
+public final class NativeInvocationHandler implements InvocationHandler {
+  private final long handle;
+  private final HashMap<Method, Integer> indices = new HashMap<>();
+
+  /**
+   * @param handle Handle of the native dispatch table
+   * @param iface Implemented interface
+   * @param keys Method keys ("name(descriptor)") in the order of the table
+   */
+  public NativeInvocationHandler(long handle, Class<?> iface, String[] keys) {
+    this.handle = handle;
+    HashMap<String, Integer> byKey = new HashMap<>();
+    for (int i = 0; i < keys.length; ++i) {
+      byKey.put(keys[i], i);
+    }
+    for (Method method : iface.getMethods()) {
+      Integer index = byKey.get(key(method));
+      if (index != null) {
+        indices.put(method, index);
+      }
+    }
+  }
+
+  @Override
+  public Object invoke(Object proxy, Method method, Object[] args) {
+    Integer index = indices.get(method);
+    if (index != null) {
+      return invoke0(handle, index, args);
+    }
+    switch (method.getName()) {
+    case "equals":
+      return proxy == args[0];
+    case "hashCode":
+      return System.identityHashCode(proxy);
+    case "toString":
+      return "NativeProxy@" + Long.toHexString(handle);
+    default:
+      throw new UnsupportedOperationException(method.toString());
+    }
+  }
+
+  private static String key(Method method) {
+    StringBuilder builder = new StringBuilder(method.getName()).append('(');
+    for (Class<?> param : method.getParameterTypes()) {
+      builder.append(descriptor(param));
+    }
+    return builder.append(')').append(descriptor(method.getReturnType())).toString();
+  }
+
+  private static String descriptor(Class<?> type) {
+    if (type == void.class) return "V";
+    if (type == boolean.class) return "Z";
+    if (type == byte.class) return "B";
+    if (type == char.class) return "C";
+    if (type == short.class) return "S";
+    if (type == int.class) return "I";
+    if (type == long.class) return "J";
+    if (type == float.class) return "F";
+    if (type == double.class) return "D";
+    if (type.isArray()) return type.getName().replace('.', '/');
+    return "L" + type.getName().replace('.', '/') + ";";
+  }
+
+  private static native Object invoke0(long handle, int index, Object[] args);
+}
@@ -0,0 +1,231 @@
+package dpsg.jni;
+
+import java.lang.invoke.MethodHandles;
+import java.lang.invoke.VarHandle;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.concurrent.locks.LockSupport;
+
+/**
+ * Java side of a ring shared with native code, see java_ring.hpp.
+ *
+ * A single-producer, single-consumer queue of messages in a direct buffer.
+ * Sending and receiving only read and write the buffer; the only native call
+ * is made by commit() when a native consumer is waiting for messages. The
+ * layout must match java_ring.hpp.
+ */
+public final class RingBuffer {
+  private static final int CAPACITY = 0;
+  private static final int MAGIC = 4;
+  private static final int WRITE = 64;
+  private static final int READ = 128;
+  private static final int WAITING = 192;
+  private static final int HEADER = 256;
+  private static final int FRAME = 8;
+  private static final int PADDING = -1;
+  private static final int MAGIC_VALUE = 0x474e4952;
+
+  private static final VarHandle LONGS =
+      MethodHandles.byteBufferViewVarHandle(long[].class, ByteOrder.nativeOrder());
+  private static final VarHandle INTS =
+      MethodHandles.byteBufferViewVarHandle(int[].class, ByteOrder.nativeOrder());
+
+  /** Receives the messages of poll(). */
+  public interface Handler {
+    /**
+     * @param type Type of the message
+     * @param payload Payload of the message, only valid during the call
+     */
+    void onMessage(int type, ByteBuffer payload);
+  }
+
+  private final ByteBuffer header;
+  private final ByteBuffer data;
+  // Views of data reused for payloads, to avoid allocating per message
+  private final ByteBuffer input;
+  private final ByteBuffer output;
+  private final int capacity;
+  private final long wakeHandle;
+  // Producer: next frame and last read position seen
+  private long write;
+  private long readCache;
+  // Consumer: next frame
+  private long read;
+  private volatile Thread consumer;
+
+  /**
+   * @param memory Ring formatted by the native side
+   * @param wakeHandle Passed to the native side to wake its consumer, 0 if
+   *     the consumer is in Java
+   */
+  public RingBuffer(ByteBuffer memory, long wakeHandle) {
+    header = memory.duplicate().order(ByteOrder.nativeOrder());
+    if ((int) INTS.get(header, MAGIC) != MAGIC_VALUE) {
+      throw new IllegalArgumentException("not a ring buffer");
+    }
+    capacity = (int) INTS.get(header, CAPACITY);
+    data = memory.duplicate().position(HEADER).slice().order(ByteOrder.nativeOrder());
+    input = data.duplicate().order(ByteOrder.nativeOrder());
+    output = data.duplicate();
+    write = (long) LONGS.getVolatile(header, WRITE);
+    read = (long) LONGS.getVolatile(header, READ);
+    readCache = read;
+    this.wakeHandle = wakeHandle;
+  }
+
+  /** Largest payload of a message. */
+  public int maxPayload() {
+    return capacity / 2 - FRAME;
+  }
+
+  /**
+   * Writes the remaining bytes of payload, invisible to the consumer until
+   * commit().
+   *
+   * @return false if the ring is full or the payload larger than maxPayload()
+   */
+  public boolean offer(int type, ByteBuffer payload) {
+    int size = payload.remaining();
+    int pos = reserve(type, size);
+    if (pos < 0) {
+      return false;
+    }
+    int position = payload.position();
+    output.limit(capacity).position(pos + FRAME);
+    output.put(payload);
+    payload.position(position);
+    return true;
+  }
+
+  public boolean offer(int type, byte[] payload, int offset, int length) {
+    int pos = reserve(type, length);
+    if (pos < 0) {
+      return false;
+    }
+    output.limit(capacity).position(pos + FRAME);
+    output.put(payload, offset, length);
+    return true;
+  }
+
+  public boolean offerInt(int type, int value) {
+    int pos = reserve(type, Integer.BYTES);
+    if (pos < 0) {
+      return false;
+    }
+    data.putInt(pos + FRAME, value);
+    return true;
+  }
+
+  public boolean offerLong(int type, long value) {
+    int pos = reserve(type, Long.BYTES);
+    if (pos < 0) {
+      return false;
+    }
+    data.putLong(pos + FRAME, value);
+    return true;
+  }
+
+  /** Publishes the messages offered since the last commit. */
+  public void commit() {
+    // Volatile on both sides: either the consumer sees the new position, or
+    // the producer sees the waiting flag
+    LONGS.setVolatile(header, WRITE, write);
+    if (wakeHandle != 0 && (int) INTS.getVolatile(header, WAITING) != 0) {
+      wake0(wakeHandle);
+    }
+  }
+
+  /**
+   * Calls handler on at most max committed messages, and releases their space
+   * once the last one has been handled.
+   *
+   * @return The number of messages handled
+   */
+  public int poll(Handler handler, int max) {
+    long published = (long) LONGS.getAcquire(header, WRITE);
+    long position = read;
+    int count = 0;
+    while (position != published && count < max) {
+      int pos = (int) position & (capacity - 1);
+      int size = data.getInt(pos);
+      int type = data.getInt(pos + 4);
+      if (type == PADDING) {
+        position += FRAME + size;
+        continue;
+      }
+      input.limit(pos + FRAME + size).position(pos + FRAME);
+      handler.onMessage(type, input);
+      position += align(FRAME + size);
+      ++count;
+    }
+    if (position != read) {
+      read = position;
+      LONGS.setRelease(header, READ, position);
+    }
+    return count;
+  }
+
+  /**
+   * Blocks until a message is committed, the timeout elapses or the thread is
+   * interrupted.
+   *
+   * @return Whether a message can be polled
+   */
+  public boolean await(long timeoutNanos) {
+    consumer = Thread.currentThread();
+    INTS.setVolatile(header, WAITING, 1);
+    try {
+      if ((long) LONGS.getVolatile(header, WRITE) == read) {
+        LockSupport.parkNanos(this, timeoutNanos);
+      }
+    } finally {
+      INTS.setVolatile(header, WAITING, 0);
+    }
+    return (long) LONGS.getAcquire(header, WRITE) != read;
+  }
+
+  /** Wakes the consumer blocked in await(), called by native producers. */
+  public void wake() {
+    Thread thread = consumer;
+    if (thread != null) {
+      LockSupport.unpark(thread);
+    }
+  }
+
+  // Offset of the frame of a message of size bytes in data, -1 if it doesn't
+  // fit
+  private int reserve(int type, int size) {
+    if (type < 0) {
+      throw new IllegalArgumentException("negative message type");
+    }
+    if (size > maxPayload()) {
+      return -1;
+    }
+    int frame = align(FRAME + size);
+    int pos = (int) write & (capacity - 1);
+    int toEnd = capacity - pos;
+    int needed = frame <= toEnd ? frame : toEnd + frame;
+    if (capacity - (write - readCache) < needed) {
+      readCache = (long) LONGS.getAcquire(header, READ);
+      if (capacity - (write - readCache) < needed) {
+        return -1;
+      }
+    }
+    if (frame > toEnd) {
+      data.putInt(pos, toEnd - FRAME);
+      data.putInt(pos + 4, PADDING);
+      write += toEnd;
+      pos = 0;
+    }
+    data.putInt(pos, size);
+    data.putInt(pos + 4, type);
+    write += frame;
+    return pos;
+  }
+
+  private static int align(int size) {
+    return (size + 7) & ~7;
+  }
+
+  private static native void wake0(long handle);
+}
@@ -0,0 +1,12 @@
+// Explicit instantiations of the call dispatch, compiled into JNI_CPP20 when
+// JNI_CPP20_EXPLICIT_INSTANTIATION is ON. Every other translation unit sees
+// them as extern templates (see jni_call.hpp).
+#include "jni_call.hpp"
+
+#define JNI_CPP20_INSTANTIATE_CALL(type)                                       \
+  template type detail::call_method_a<type>(JNIEnv &, jobject, jmethodID,      \
+                                            const jvalue *);                   \
+  template type detail::call_static_method_a<type>(JNIEnv &, jclass,           \
+                                                   jmethodID, const jvalue *);
+JNI_CPP20_FOR_EACH_CALL_RETURN_TYPE(JNI_CPP20_INSTANTIATE_CALL)
+#undef JNI_CPP20_INSTANTIATE_CALL
@@ -0,0 +1,257 @@
+#include "call_profiler.hpp"
+#include "java_array.hpp"
+#include "java_batch.hpp"
+#include "java_bulk.hpp"
+#include "java_class_loader.hpp"
+#include "java_enum.hpp"
+#include "jni_fake.hpp"
+#include "jvm.hpp"
+#include "ref_tracker.hpp"
+
+#include <jni.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <source_location>
+#include <sstream>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+template <class T>
+T unwrap_impl(std::optional<T>&& opt, const char* msg) {
+  if (!opt) {
+    std::cerr << "failed to unwrap: " << msg << std::endl;
+    std::abort();
+  }
+  return std::move(opt).value();
+}
+
+#define DPSG_UNWRAP(opt, msg) unwrap_impl(opt, msg)
+#define unwrap(...) DPSG_UNWRAP((__VA_ARGS__), #__VA_ARGS__)
+
+#define CHECK(...)                                                             \
+  if (!(__VA_ARGS__)) {                                                        \
+    std::cerr << __LINE__ << ": check failed: " #__VA_ARGS__ << std::endl;     \
+    return EXIT_FAILURE;                                                       \
+  }
+
+using Math = java_class_desc<"java/lang/Math">;
+using Unit = java_class_desc<"game/Unit">;
+using Direction = java_class_desc<"game/Direction">;
+using EngineA = java_class_desc<"engine/A">;
+using EngineB = java_class_desc<"engine/B">;
+
+enum class direction { north, south };
+
+int main() {
+  fake_jvm fake;
+  fake.define_class("java/lang/Math")
+      .static_method("max", "(II)I", [](fake_call &c) {
+        return jvalue{.i = std::max(c.args[0].i, c.args[1].i)};
+      });
+  fake.define_class("game/Unit")
+      .field("hp", "I")
+      .field("mp", "I")
+      .method("<init>", "(II)V")
+      .method("name", "()Ljava/lang/String;", [](fake_call &c) {
+        return jvalue{.l = c.jvm.new_string("knight")};
+      });
+  auto &dir = fake.define_class("game/Direction");
+  jobject north = fake.new_object("game/Direction");
+  jobject south = fake.new_object("game/Direction");
+  dir.static_field("NORTH", "Lgame/Direction;", jvalue{.l = north})
+      .static_field("SOUTH", "Lgame/Direction;", jvalue{.l = south})
+      .method("ordinal", "()I", [south](fake_call &c) {
+        return jvalue{.i = c.jvm.env().IsSameObject(c.self, south) ? 1 : 0};
+      });
+
+  // What class_loader_factory needs, loadClass resolves names globally
+  fake.define_class("java/net/URI")
+      .method("toURL", "()Ljava/net/URL;", [](fake_call &c) {
+        return jvalue{.l = c.jvm.new_object("java/net/URL")};
+      });
+  fake.define_class("java/net/URL");
+  fake.define_class("java/io/File")
+      .method("<init>", "(Ljava/lang/String;)V")
+      .method("toURI", "()Ljava/net/URI;", [](fake_call &c) {
+        return jvalue{.l = c.jvm.new_object("java/net/URI")};
+      });
+  fake.define_class("java/lang/ClassLoader")
+      .static_method("getPlatformClassLoader", "()Ljava/lang/ClassLoader;",
+                     [](fake_call &) { return jvalue{.l = nullptr}; })
+      .static_method("getSystemClassLoader", "()Ljava/lang/ClassLoader;",
+                     [](fake_call &) { return jvalue{.l = nullptr}; })
+      .method("loadClass", "(Ljava/lang/String;)Ljava/lang/Class;",
+              [](fake_call &c) {
+                auto name = c.jvm.utf8(c.args[0].l);
+                std::replace(name.begin(), name.end(), '.', '/');
+                return jvalue{.l = c.jvm.env().FindClass(name.c_str())};
+              });
+  fake.define_class("java/net/URLClassLoader", "java/lang/ClassLoader")
+      .method("<init>", "([Ljava/net/URL;Ljava/lang/ClassLoader;)V")
+      .method("close", "()V");
+  fake.define_class("engine/A").method("run", "()I");
+  fake.define_class("engine/B").method("run", "()I");
+
+#ifdef JNI_CPP20_TRACK_REFS
+  std::vector<ref_tracker::event> events;
+  ref_tracker::set_reporter(
+      [&](const ref_tracker::event &e) { events.push_back(e); });
+  // Outlives the JVM below, reported as a leak when it is destroyed
+  std::optional<java_ref<jobject, false>> leaked;
+  std::uint_least32_t leaked_line = 0;
+#endif
+
+  {
+    JVM jvm = fake.make_jvm();
+
+    // One crossing per call once the method is resolved
+    auto math = unwrap(jvm.find_class<Math>());
+    auto max = unwrap(math.get_static_method_id<"max", int(int, int)>());
+    auto before = fake.crossings();
+    CHECK(math.call(max, 3, 7) == 7);
+    CHECK(fake.crossings() - before == 1 &&
+          fake.count(fake_fn::CallStaticIntMethodA) == 1);
+
+#ifdef JNI_CPP20_PROFILE_CALLS
+    // A span for the wrapper and a nested one for the JNI function
+    call_profiler::clear();
+    math.call(max, 1, 2);
+    std::ostringstream trace;
+    call_profiler::write_chrome_trace(trace);
+    CHECK(call_profiler::size() == 2 &&
+          trace.str().find(R"("cat":"jni","name":"java/lang/Math.max(II)I")") !=
+              std::string::npos);
+#endif
+
+    // Failed lookups leave the exception pending
+    CHECK(!math.get_static_method_id<"min", int(int, int)>());
+    CHECK(fake.pending_exception().first == "java/lang/NoSuchMethodError");
+    jvm->ExceptionClear();
+
+    // Strings are released with their wrapper
+    auto unit = unwrap(jvm.find_class<Unit>());
+    auto name = unwrap(unit.get_method_id<"name", java::lang::String()>());
+    auto knight = unwrap(unit.instantiate(
+        unwrap(unit.get_constructor_id<int, int>()), 10, 20));
+    {
+      auto knight_name = unit.call(name, knight);
+      auto str = knight_name.get_raw_string();
+      CHECK(std::u16string_view{(const char16_t *)str.data(),
+                                (std::size_t)str.size()} == u"knight");
+      CHECK(fake.pinned() == 1);
+    }
+    CHECK(fake.pinned() == 0);
+
+    // Primitive arrays
+    auto array = make_java_array<jint>(*jvm, 4);
+    std::vector<jint> in{1, 2, 3, 4}, out(4);
+    array.set_region(0, std::span<const jint>{in});
+    array.get_region(0, std::span<jint>{out});
+    CHECK(in == out && array.size() == 4);
+
+    // Converting copies saturate like Java casts, NaN becoming 0
+    std::vector<double> unrepresentable{
+        1e10, -1e10, std::numeric_limits<double>::quiet_NaN(), -3.9};
+    CHECK(copy_to_java(std::span<const double>{unrepresentable}, array));
+    array.get_region(0, std::span<jint>{out});
+    CHECK(out == std::vector<jint>{std::numeric_limits<jint>::max(),
+                                   std::numeric_limits<jint>::min(), 0, -3});
+    auto shorts = make_java_array<jshort>(*jvm, 2);
+    std::vector<float> wide{1e10f, 65537.5f};
+    CHECK(copy_to_java(std::span<const float>{wide}, shorts));
+    std::vector<jshort> narrowed(2);
+    shorts.get_region(0, std::span<jshort>{narrowed});
+    CHECK(narrowed == std::vector<jshort>{-1, 1});
+
+    // Batches: one AllocObject and two field stores per element
+    struct stats {
+      int hp, mp;
+    };
+    std::vector<stats> units{{1, 2}, {3, 4}, {5, 6}};
+    before = fake.count(fake_fn::SetIntField);
+    auto allocated = unwrap(allocate_all(
+        unit, units,
+        std::tuple{unwrap(unit.get_field_id<"hp", int>()),
+                   unwrap(unit.get_field_id<"mp", int>())}));
+    // Only passed where an array of the same class is expected
+    static_assert(
+        is_jni_callable<void(java_array_desc<Unit>), decltype(allocated)> &&
+        !is_jni_callable<void(java_array_desc<Direction>),
+                         decltype(allocated)>);
+    CHECK(fake.count(fake_fn::AllocObject) == 3 &&
+          fake.count(fake_fn::SetIntField) - before == 6);
+    auto third = java_ref<jobject>{
+        jvm->GetObjectArrayElement(allocated.get(), 2), &*jvm};
+    CHECK(jvm->GetIntField(third.get(),
+                           unwrap(unit.get_field_id<"mp", int>()).id()) == 6);
+
+    // Enum constants compared by identity
+    auto dirs =
+        unwrap(java_enum<direction, Direction, "NORTH", "SOUTH">::create(jvm));
+    CHECK(dirs.from_java(*jvm, south) == direction::south &&
+          jvm->IsSameObject(dirs.to_java(direction::north).get(), north));
+
+    // Method IDs cached by a class loader are per class
+    {
+      auto loaders = unwrap(class_loader_factory::create(jvm));
+      auto loader = unwrap(loaders.create({"engines.jar"}));
+      auto a_run = unwrap(loader.get_method_id<EngineA, "run", int()>());
+      auto b_run = unwrap(loader.get_method_id<EngineB, "run", int()>());
+      auto b = unwrap(loader.find_class<EngineB>());
+      CHECK(a_run.id() != b_run.id() &&
+            b_run.id() == unwrap(b.get_method_id<"run", int()>()).id());
+    }
+
+#ifdef JNI_CPP20_TRACK_REFS
+    // Locals returned by calls are recorded where the method was resolved.
+    // The tracker counts the locals of the thread, outer frames included.
+    CHECK(jvm->PushLocalFrame(5) == JNI_OK);
+    auto capacity = ref_tracker::live_locals() + 5;
+    ref_tracker::set_local_capacity(capacity);
+    auto name_line = std::source_location::current().line() + 1;
+    auto named = unwrap(unit.get_method_id<"name", java::lang::String()>());
+    {
+      std::vector<decltype(unit.call(named, knight))> names;
+      for (int i = 0; i < 5; ++i) {
+        names.push_back(unit.call(named, knight));
+      }
+    }
+    jvm->PopLocalFrame(nullptr);
+    ref_tracker::set_local_capacity(ref_tracker::default_local_capacity);
+    CHECK(events.size() == 1 &&
+          events[0].what == ref_tracker::event::type::local_pressure &&
+          events[0].kind == ref_kind::local && events[0].capacity == capacity &&
+          events[0].live_locals >= capacity * ref_tracker::warning_ratio &&
+          events[0].site.line() == name_line &&
+          std::string_view{events[0].site.file_name()}.ends_with("fake.cpp"));
+    events.clear();
+
+    leaked_line = std::source_location::current().line() + 1;
+    leaked = knight.promote();
+#endif
+  }
+
+#ifdef JNI_CPP20_TRACK_REFS
+  // Only the promoted reference is still alive when the JVM is destroyed
+  CHECK(events.size() == 1 &&
+        events[0].what == ref_tracker::event::type::leak &&
+        events[0].kind == ref_kind::global &&
+        events[0].ref == (const void *)leaked->get() &&
+        events[0].site.line() == leaked_line);
+  leaked.reset();
+  ref_tracker::set_reporter(nullptr);
+#endif
+
+  // Every reference created by the wrappers was deleted
+  fake.collect();
+  CHECK(fake.global_refs() == 0 && fake.invalid_refs() == 0 &&
+        fake.unscripted() == 0);
+  CHECK(fake.count(fake_fn::DestroyJavaVM) == 1);
+  return EXIT_SUCCESS;
+}
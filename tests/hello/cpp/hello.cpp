@@ -1,9 +1,34 @@
+#include "hello_bindings.hpp"
+#include "hello_embedded.hpp"
+#include "call_plan.hpp"
+#include "critical_scheduler.hpp"
+#include "heap_monitor.hpp"
+#include "java_agent.hpp"
+#include "java_batch.hpp"
+#include "java_boxing.hpp"
+#include "java_bulk.hpp"
+#include "java_chunks.hpp"
+#include "java_enum.hpp"
+#include "java_exception.hpp"
+#include "java_mapped.hpp"
+#include "java_prefetch.hpp"
+#include "java_proxy.hpp"
+#include "java_ring.hpp"
+#include "java_weak_ref.hpp"
 #include "jvm.hpp"
 #include "result.hpp"
 
 #include <jni.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
 
 #ifndef JAVA_CLASSPATH
   #define JAVA_CLASSPATH "codingame.jar"
@@ -62,5 +87,294 @@ int main() {
     jvm->ExceptionDescribe();
     return EXIT_FAILURE;
   }
+
+  auto repeat_method = unwrap(hello_cls.get_static_method_id<"repeat", java::lang::String(int)>());
+  auto repeated = hello_cls.call(repeat_method, 1000);
+  if (jvm->ExceptionCheck()) {
+    jvm->ExceptionDescribe();
+    return EXIT_FAILURE;
+  }
+  std::string expected;
+  for (int i = 0; i < 1000; ++i) {
+    expected += "h\xc3\xa9llo \xf0\x9f\x98\x80 ";
+  }
+  // An odd chunk size splits some of the surrogate pairs across chunks
+  std::ostringstream streamed;
+  write_utf8(streamed, repeated, 7);
+  if (streamed.str() != expected) {
+    std::cerr << "chunked UTF-8 transcoding mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto plan = make_call_plan(hello_cls, hello_method, repeat_method);
+  auto planned = plan.run(hello_obj, std::tuple{}, std::tuple{2});
+  if (!dpsg::ok(planned)) {
+    std::cerr << "call plan failed at step " << dpsg::get_error(planned).step << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::ostringstream planned_utf8;
+  write_utf8(planned_utf8, dpsg::get_result(planned));
+  if (planned_utf8.str() != expected.substr(0, planned_utf8.str().size()) ||
+      planned_utf8.str().size() * 500 != expected.size()) {
+    std::cerr << "call plan result mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Strongly reachable through hello_obj, so it can't have been collected
+  weak_cache<std::string> cache;
+  cache.insert("hello", hello_obj);
+  auto cached = unwrap(cache.find("hello"));
+  if (!jvm->IsSameObject(cached.get(), hello_obj.get())) {
+    std::cerr << "weak cache returned another object" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  auto bindings = unwrap(Hello_bindings::resolve(jvm));
+  auto bound_obj = unwrap(bindings.cls.instantiate(bindings.ctor));
+  bindings.cls.call(bindings.hello, bound_obj);
+  bindings.cls.call(bindings.hello_static);
+  if (jvm->ExceptionCheck()) {
+    jvm->ExceptionDescribe();
+    return EXIT_FAILURE;
+  }
+
+  using Function = java_class_desc<"java/util/function/Function">;
+  auto proxies = unwrap(proxy_factory::create(jvm));
+  int runs = 0;
+  auto runnable = unwrap(proxies.create<java::lang::Runnable>(
+      proxy_method<"run", void()>([&](proxy_args) { ++runs; })));
+  auto identity = unwrap(proxies.create<Function>(
+      proxy_method<"apply", java::lang::Object(java::lang::Object)>(
+          [](proxy_args args) { return args[0]; })));
+  auto run_method = unwrap(hello_cls.get_static_method_id<"run", int(java::lang::Runnable, int)>());
+  auto apply_method = unwrap(hello_cls.get_static_method_id<"apply", java::lang::Object(Function, java::lang::String)>());
+  hello_cls.call(run_method, runnable.local(), 100);
+  auto applied = hello_cls.call(apply_method, identity.local(), repeated);
+  if (jvm->ExceptionCheck()) {
+    jvm->ExceptionDescribe();
+    return EXIT_FAILURE;
+  }
+  if (runs != 100 || !jvm->IsSameObject(applied.get(), repeated.get())) {
+    std::cerr << "proxy dispatch mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The string_view is converted to a temporary jstring for the call
+  static_assert(jni_call_cost_v<java::lang::Object(Function, java::lang::String),
+                                java_object<Function::name>, std::string_view> ==
+                conversion_cost::staged_copy);
+  auto converted = hello_cls.call(apply_method, identity.local(),
+                                  std::string_view{"converted argument"}.substr(0, 9));
+  auto converted_length = jvm->GetStringUTFLength((jstring)converted.get());
+  if (converted_length != 9) {
+    std::cerr << "converted argument mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  struct point {
+    float x, y;
+  };
+  std::vector<point> points{{1, 2}, {3, 4}, {5, 6}, {7, 8}, {9, 10}};
+  auto xs = make_java_array<jfloat>(*jvm, (jsize)points.size());
+  auto ys = make_java_array<jfloat>(*jvm, (jsize)points.size());
+  std::vector<point> round_trip(points.size());
+  if (!scatter(std::span<const point>{points}, field(&point::x, xs),
+               field(&point::y, ys)) ||
+      !gather(std::span<point>{round_trip}, field(&point::x, xs),
+              field(&point::y, ys)) ||
+      round_trip.back().x != 9 || round_trip.back().y != 10) {
+    std::cerr << "bulk scatter/gather mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  using Repeat = prefetch_static_method<"repeat", java::lang::String(int)>;
+  prefetcher startup{jvm, prefetch<java_class_desc<"Hello">, Repeat>()};
+  auto &prefetched = startup.get<java_class_desc<"Hello">>();
+  if (!prefetched) {
+    std::cerr << "prefetch failed: " << (int)prefetched.error() << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto prefetched_repeat = prefetched.value().get_class().call(
+      prefetched.value().static_method<"repeat", java::lang::String(int)>(), 2);
+  if (jvm->ExceptionCheck() || prefetched_repeat == nullptr) {
+    std::cerr << "prefetched call failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // C++ exception -> RuntimeException thrown by the proxy -> typed C++ exception
+  struct java_runtime_error : java_exception {
+    explicit java_runtime_error(java_exception e)
+        : java_exception(std::move(e)) {}
+  };
+  auto translator = unwrap(exception_translator::create(jvm));
+  translator.map<java_class_desc<"java/lang/RuntimeException">,
+                 java_runtime_error>();
+  auto throwing = unwrap(proxies.create<java::lang::Runnable>(
+      proxy_method<"run", void()>(
+          [](proxy_args) { throw std::runtime_error{"thrown from C++"}; })));
+  hello_cls.call(run_method, throwing.local(), 1);
+  try {
+    translator.check(*jvm);
+    std::cerr << "exception not translated" << std::endl;
+    return EXIT_FAILURE;
+  } catch (const java_runtime_error &e) {
+    if (e.class_name() != "java.lang.RuntimeException" ||
+        e.message() != "thrown from C++" || e.stack_trace().empty()) {
+      std::cerr << "exception metadata mismatch: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Java reads a view of memory mapped on the C++ side
+  auto mapping = unwrap(shared_mapping::anonymous(jvm, 16));
+  for (std::size_t i = 0; i < mapping.bytes().size(); ++i) {
+    mapping.bytes()[i] = (std::byte)(i + 1);
+  }
+  auto sum_method = unwrap(
+      hello_cls.get_static_method_id<"sum", int(java::nio::ByteBuffer)>());
+  auto view = unwrap(mapping.buffer(*jvm, 4, 8));
+  if (hello_cls.call(sum_method, view) != 5 + 6 + 7 + 8 + 9 + 10 + 11 + 12) {
+    std::cerr << "mapped buffer sum mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Pinned write, then copied read (over the byte budget)
+  auto counters = make_java_array<jint>(*jvm, 8);
+  critical_scheduler pinning{};
+  critical_scheduler copying{{.max_bytes = 0}};
+  auto pinned_path = pinning.with_elements(
+      counters, critical_access::read_write, [](std::span<jint> values) {
+        for (std::size_t i = 0; i < values.size(); ++i) {
+          values[i] = (jint)i;
+        }
+      });
+  jint total = 0;
+  auto copied_path = copying.with_elements(
+      counters, critical_access::read_only, [&](std::span<jint> values) {
+        for (auto v : values) {
+          total += v;
+        }
+      });
+  if (pinned_path != critical_path::pinned ||
+      copied_path != critical_path::copied || total != 28 ||
+      pinning.metrics().size() != 1) {
+    std::cerr << "critical scheduler mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Boxing through valueOf, bulk unboxing of an Integer[]
+  auto boxes = unwrap(boxing::create(jvm));
+  auto integer_cls = unwrap(jvm.find_class<java::lang::Integer>());
+  java_ref<jobjectArray> integers{
+      jvm->NewObjectArray(4, integer_cls.get(), nullptr), &*jvm};
+  for (jsize i = 0; i < 4; ++i) {
+    auto boxed = unwrap(boxes.box(*jvm, (int)i * 100));
+    jvm->SetObjectArrayElement(integers.get(), i, boxed.get());
+  }
+  auto unboxed = unwrap(boxes.unbox_all<int>(integers));
+  if (unboxed != std::vector<int>{0, 100, 200, 300} ||
+      boxes.unbox<double>(unwrap(boxes.box(*jvm, 1.5))) != 1.5) {
+    std::cerr << "boxing mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Classes defined from the bytecode embedded in the executable
+  auto embedded = unwrap(embedded_classes::define(jvm, hello_embedded_classes));
+  auto embedded_cls =
+      unwrap(embedded.find_class<java_class_desc<"Embedded">>());
+  auto answer = unwrap(embedded_cls.get_static_method_id<"answer", int()>());
+  if (embedded.size() != 2 || embedded_cls.call(answer) != 42) {
+    std::cerr << "embedded classes mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Arrays of objects built from aggregates, by constructor or field stores
+  using Move = java_class_desc<"Hello$Move">;
+  struct move {
+    int from, to;
+  };
+  std::vector<move> moves{{1, 4}, {2, 10}, {7, 8}};
+  auto move_cls = unwrap(jvm.find_class<Move>());
+  auto move_ctor = unwrap(move_cls.get_constructor_id<int, int>());
+  auto total_method = unwrap(
+      hello_cls.get_static_method_id<"total", int(java_array_desc<Move>)>());
+  auto constructed = unwrap(construct_all(move_cls, move_ctor, moves));
+  auto allocated = unwrap(
+      allocate_all(move_cls, std::vector<std::pair<int, int>>{{0, 5}, {5, 6}},
+                   std::tuple{unwrap(move_cls.get_field_id<"from", int>()),
+                              unwrap(move_cls.get_field_id<"to", int>())}));
+  if (hello_cls.call(total_method, constructed) != 3 + 8 + 1 ||
+      hello_cls.call(total_method, allocated) != 5 + 1) {
+    std::cerr << "batch construction mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Enum constants resolved once, compared by identity
+  using Direction = java_class_desc<"Hello$Direction">;
+  enum class direction { north, east, south, west };
+  using directions =
+      java_enum<direction, Direction, "NORTH", "EAST", "SOUTH", "WEST">;
+  auto dirs = unwrap(directions::create(jvm));
+  auto turn = unwrap(
+      hello_cls.get_static_method_id<"turn", Direction(Direction)>());
+  if (dirs.from_java(hello_cls.call(turn, dirs.to_java(direction::east))) !=
+          direction::south ||
+      dirs.from_java(hello_cls.call(turn, dirs.to_java(direction::west))) !=
+          direction::north) {
+    std::cerr << "enum mapping mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Messages through shared memory, one JNI call to let Java run
+  auto channel = unwrap(ring_channel::create(jvm, 4096));
+  auto echo = unwrap(hello_cls.get_static_method_id<
+                     "echo", int(dpsg::jni::RingBuffer, dpsg::jni::RingBuffer)>());
+  int sent = 0;
+  while (channel.writer().try_write(7, sent + 1)) {
+    ++sent;
+  }
+  channel.commit(*jvm);
+  int echoed = 0;
+  long sum = 0;
+  auto answered = hello_cls.call(echo, channel.java_reader(), channel.java_writer());
+  channel.reader().poll([&](const ring_message &m) {
+    echoed += m.type == 7;
+    sum += m.as<int>().value_or(0);
+  });
+  if (jvm->ExceptionCheck() || answered != sent || echoed != sent ||
+      sum != (long)sent * (sent + 1)) {
+    std::cerr << "ring channel mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // In-process agent: every batch of lines is answered with its line count
+  auto agents = unwrap(agent_host::create(jvm));
+  int turns = 0;
+  auto agent = unwrap(agents.add([&](std::string_view input, std::string &output) {
+    ++turns;
+    output += std::to_string(std::count(input.begin(), input.end(), '\n')) + '\n';
+  }));
+  auto play = unwrap(hello_cls.get_static_method_id<
+                     "play", java::lang::String(java::lang::Class, java::lang::String)>());
+  auto played = hello_cls.call(play, agent.java_class(), "3\n1 2\n3 4\n5 6\n");
+  if (jvm->ExceptionCheck() || turns != 1 ||
+      jvm->GetStringUTFLength((jstring)played.get()) != 2) {
+    std::cerr << "native agent mismatch" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Heap figures polled on a daemon thread, read without calling Java
+  {
+    auto heap = unwrap(heap_monitor::start(jvm, {.interval = std::chrono::milliseconds{10}}));
+    while (heap.snapshot().polls == 0) {
+      std::this_thread::yield();
+    }
+    auto figures = heap.snapshot();
+    if (figures.used <= 0 || figures.committed < figures.used ||
+        figures.gc_count < 0 || !heap.wait_admit(std::chrono::seconds{5})) {
+      std::cerr << "heap monitor mismatch" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
   return EXIT_SUCCESS;
 }
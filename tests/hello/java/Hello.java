@@ -1,8 +1,91 @@
+import dpsg.jni.RingBuffer;
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.InputStream;
+import java.io.PrintStream;
+import java.nio.charset.StandardCharsets;
+
 public class Hello {
+  static public enum Direction { NORTH, EAST, SOUTH, WEST }
+
+  static public class Move {
+    public int from;
+    public int to;
+
+    public Move(int from, int to) {
+      this.from = from;
+      this.to = to;
+    }
+  }
+
   static public void hello_static() {
     System.out.println("Hello, static method!");
   }
 
+  static public String repeat(int count) {
+    StringBuilder builder = new StringBuilder();
+    for (int i = 0; i < count; ++i) {
+      builder.append("h\u00e9llo \ud83d\ude00 ");
+    }
+    return builder.toString();
+  }
+
+  static public int run(Runnable runnable, int times) {
+    for (int i = 0; i < times; ++i) {
+      runnable.run();
+    }
+    return times;
+  }
+
+  static public Object apply(java.util.function.Function<Object, Object> f, String arg) {
+    return f.apply(arg);
+  }
+
+  static public int sum(java.nio.ByteBuffer bytes) {
+    int total = 0;
+    while (bytes.hasRemaining()) {
+      total += bytes.get();
+    }
+    return total;
+  }
+
+  static public int total(Move[] moves) {
+    int total = 0;
+    for (Move move : moves) {
+      total += move.to - move.from;
+    }
+    return total;
+  }
+
+  static public Direction turn(Direction direction) {
+    return Direction.values()[(direction.ordinal() + 1) % 4];
+  }
+
+  // Answers every int of in with its double on out
+  static public int echo(RingBuffer in, RingBuffer out) {
+    int count = in.poll((type, payload) -> out.offerInt(type, payload.getInt(0) * 2),
+                        Integer.MAX_VALUE);
+    out.commit();
+    return count;
+  }
+
+  // Runs the main method of agent with input as System.in, returns what it
+  // printed
+  static public String play(Class<?> agent, String input) throws Exception {
+    InputStream in = System.in;
+    PrintStream out = System.out;
+    ByteArrayOutputStream output = new ByteArrayOutputStream();
+    System.setIn(new ByteArrayInputStream(input.getBytes(StandardCharsets.UTF_8)));
+    System.setOut(new PrintStream(output, true, "UTF-8"));
+    try {
+      agent.getMethod("main", String[].class).invoke(null, (Object) new String[0]);
+    } finally {
+      System.setIn(in);
+      System.setOut(out);
+    }
+    return output.toString("UTF-8");
+  }
+
   public void hello() {
     System.out.println("Hello, instance method!");
   }
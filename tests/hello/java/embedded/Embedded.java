@@ -0,0 +1,13 @@
+// Embedded in hello_world, not in the class path. Embedded is defined before
+// the class it extends, its definition has to be retried.
+class EmbeddedBase {
+  static public int base() {
+    return 40;
+  }
+}
+
+public class Embedded extends EmbeddedBase {
+  static public int answer() {
+    return base() + 2;
+  }
+}
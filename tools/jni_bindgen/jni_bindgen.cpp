@@ -0,0 +1,521 @@
+// jni_bindgen: generates C++ bindings for this library from compiled Java
+// classes.
+//
+// Usage: jni_bindgen -o <header> [--guard <macro>] [--all-access] <input>...
+//
+// Every input is either a .class file or a directory that is scanned
+// recursively for .class files (jars are extracted to a directory by the
+// CMake helper before calling the tool). For every class the generated header
+// contains:
+//   + a java_class_desc alias in a namespace mirroring the Java package,
+//   + a <Class>_bindings struct with one java_method/java_static_method/
+//     java_constructor member per method, typed with the exact prototype
+//     read from the class file, and a static_assert checking that jni_desc
+//     produces the original descriptor,
+//   + a static resolve(JVM&) that looks the class up once, keeps a global
+//     reference to it and resolves every method ID, so that calls made
+//     through the bindings never perform a lookup.
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr std::uint16_t acc_public = 0x0001;
+constexpr std::uint16_t acc_static = 0x0008;
+constexpr std::uint16_t acc_bridge = 0x0040;
+constexpr std::uint16_t acc_synthetic = 0x1000;
+constexpr std::uint16_t acc_module = 0x8000;
+
+struct method_info {
+  std::uint16_t access;
+  std::string name;
+  std::string descriptor;
+};
+
+struct class_info {
+  std::uint16_t access;
+  std::string name; // internal form, e.g. com/example/Foo$Bar
+  std::vector<method_info> methods;
+};
+
+class class_reader {
+  const std::vector<unsigned char> &_data;
+  size_t _pos = 0;
+
+public:
+  explicit class_reader(const std::vector<unsigned char> &data)
+      : _data(data) {}
+
+  void require(size_t n) const {
+    if (_pos + n > _data.size()) {
+      throw std::runtime_error("truncated class file");
+    }
+  }
+  std::uint8_t u1() {
+    require(1);
+    return _data[_pos++];
+  }
+  std::uint16_t u2() {
+    require(2);
+    std::uint16_t v = (std::uint16_t)((_data[_pos] << 8) | _data[_pos + 1]);
+    _pos += 2;
+    return v;
+  }
+  std::uint32_t u4() {
+    std::uint32_t hi = u2();
+    return (hi << 16) | u2();
+  }
+  void skip(size_t n) {
+    require(n);
+    _pos += n;
+  }
+  std::string bytes(size_t n) {
+    require(n);
+    std::string s(_data.begin() + _pos, _data.begin() + _pos + n);
+    _pos += n;
+    return s;
+  }
+};
+
+class_info parse_class(const std::vector<unsigned char> &data) {
+  class_reader in{data};
+  if (in.u4() != 0xCAFEBABE) {
+    throw std::runtime_error("not a class file");
+  }
+  in.u2(); // minor_version
+  in.u2(); // major_version
+
+  std::uint16_t pool_count = in.u2();
+  std::vector<std::string> utf8(pool_count);
+  std::vector<std::uint16_t> class_names(pool_count);
+  for (std::uint16_t i = 1; i < pool_count; ++i) {
+    std::uint8_t tag = in.u1();
+    switch (tag) {
+    case 1: // Utf8
+      utf8[i] = in.bytes(in.u2());
+      break;
+    case 7: // Class
+      class_names[i] = in.u2();
+      break;
+    case 8:  // String
+    case 16: // MethodType
+    case 19: // Module
+    case 20: // Package
+      in.skip(2);
+      break;
+    case 15: // MethodHandle
+      in.skip(3);
+      break;
+    case 3:  // Integer
+    case 4:  // Float
+    case 9:  // Fieldref
+    case 10: // Methodref
+    case 11: // InterfaceMethodref
+    case 12: // NameAndType
+    case 17: // Dynamic
+    case 18: // InvokeDynamic
+      in.skip(4);
+      break;
+    case 5: // Long
+    case 6: // Double
+      in.skip(8);
+      ++i; // 8-byte constants take two slots
+      break;
+    default:
+      throw std::runtime_error("unknown constant pool tag " +
+                               std::to_string(tag));
+    }
+  }
+
+  auto pool_utf8 = [&](std::uint16_t index) -> const std::string & {
+    if (index == 0 || index >= pool_count) {
+      throw std::runtime_error("invalid constant pool index");
+    }
+    return utf8[index];
+  };
+
+  class_info cls;
+  cls.access = in.u2();
+  std::uint16_t this_class = in.u2();
+  if (this_class == 0 || this_class >= pool_count) {
+    throw std::runtime_error("invalid this_class index");
+  }
+  cls.name = pool_utf8(class_names[this_class]);
+  in.u2(); // super_class
+  in.skip(2 * (size_t)in.u2()); // interfaces
+
+  auto skip_attributes = [&] {
+    std::uint16_t count = in.u2();
+    for (std::uint16_t i = 0; i < count; ++i) {
+      in.u2();
+      in.skip(in.u4());
+    }
+  };
+
+  std::uint16_t fields_count = in.u2();
+  for (std::uint16_t i = 0; i < fields_count; ++i) {
+    in.skip(6);
+    skip_attributes();
+  }
+
+  std::uint16_t methods_count = in.u2();
+  for (std::uint16_t i = 0; i < methods_count; ++i) {
+    method_info m;
+    m.access = in.u2();
+    m.name = pool_utf8(in.u2());
+    m.descriptor = pool_utf8(in.u2());
+    skip_attributes();
+    cls.methods.push_back(std::move(m));
+  }
+  return cls;
+}
+
+// Converts a field descriptor starting at pos into the C++ type used in
+// prototypes.
+std::string cpp_type(std::string_view desc, size_t &pos) {
+  if (pos >= desc.size()) {
+    throw std::runtime_error("invalid descriptor");
+  }
+  switch (desc[pos++]) {
+  case 'Z':
+    return "bool";
+  case 'B':
+    return "signed char";
+  case 'C':
+    return "char";
+  case 'S':
+    return "short";
+  case 'I':
+    return "int";
+  case 'J':
+    return "long";
+  case 'F':
+    return "float";
+  case 'D':
+    return "double";
+  case 'V':
+    return "void";
+  case 'L': {
+    auto end = desc.find(';', pos);
+    if (end == std::string_view::npos) {
+      throw std::runtime_error("invalid descriptor");
+    }
+    auto name = desc.substr(pos, end - pos);
+    pos = end + 1;
+    return "java_class_desc<\"" + std::string{name} + "\">";
+  }
+  case '[':
+    return "java_array_desc<" + cpp_type(desc, pos) + ">";
+  default:
+    throw std::runtime_error("invalid descriptor");
+  }
+}
+
+struct prototype {
+  std::string ret;
+  std::vector<std::string> params;
+
+  std::string str() const {
+    std::string s = ret + "(";
+    for (size_t i = 0; i < params.size(); ++i) {
+      s += (i ? ", " : "") + params[i];
+    }
+    return s + ")";
+  }
+};
+
+prototype parse_method_descriptor(std::string_view desc) {
+  if (desc.empty() || desc[0] != '(') {
+    throw std::runtime_error("invalid method descriptor");
+  }
+  prototype p;
+  size_t pos = 1;
+  while (pos < desc.size() && desc[pos] != ')') {
+    p.params.push_back(cpp_type(desc, pos));
+  }
+  ++pos;
+  p.ret = cpp_type(desc, pos);
+  return p;
+}
+
+// C++ keywords, plus the names used by the members of the generated structs
+const std::set<std::string_view> reserved_names = {
+    "alignas",   "alignof",      "and",       "and_eq",     "asm",
+    "auto",      "bitand",       "bitor",     "bool",       "break",
+    "case",      "catch",        "char",      "char8_t",    "char16_t",
+    "char32_t",  "class",        "compl",     "concept",    "const",
+    "consteval", "constexpr",    "constinit", "const_cast", "continue",
+    "co_await",  "co_return",    "co_yield",  "decltype",   "default",
+    "delete",    "do",           "double",    "dynamic_cast", "else",
+    "enum",      "explicit",     "export",    "extern",     "false",
+    "float",     "for",          "friend",    "goto",       "if",
+    "inline",    "int",          "long",      "mutable",    "namespace",
+    "new",       "noexcept",     "not",       "not_eq",     "nullptr",
+    "operator",  "or",           "or_eq",     "private",    "protected",
+    "public",    "register",     "reinterpret_cast", "requires", "return",
+    "short",     "signed",       "sizeof",    "static",     "static_assert",
+    "static_cast", "struct",     "switch",    "template",   "this",
+    "thread_local", "throw",     "true",      "try",        "typedef",
+    "typeid",    "typename",     "union",     "unsigned",   "using",
+    "virtual",   "void",         "volatile",  "wchar_t",    "while",
+    "xor",       "xor_eq",
+    // Members and locals of the generated bindings
+    "cls",       "desc",         "resolve",   "local",      "global",
+    "jvm"};
+
+std::string identifier(std::string_view name) {
+  std::string id;
+  for (char c : name) {
+    bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                 (c >= '0' && c <= '9') || c == '_';
+    id += valid ? c : '_';
+  }
+  if (id.empty() || (id[0] >= '0' && id[0] <= '9')) {
+    id.insert(id.begin(), '_');
+  }
+  if (reserved_names.contains(id)) {
+    id += '_';
+  }
+  return id;
+}
+
+bool is_anonymous(std::string_view name) {
+  auto dollar = name.rfind('$');
+  return dollar != std::string_view::npos && dollar + 1 < name.size() &&
+         name[dollar + 1] >= '0' && name[dollar + 1] <= '9';
+}
+
+struct options {
+  std::string output;
+  std::string guard = "HEADER_GUARD_JNI_BINDGEN_GENERATED_HPP";
+  bool all_access = false;
+  std::vector<fs::path> inputs;
+};
+
+void emit_class(std::ostream &os, const class_info &cls, const options &opts) {
+  auto slash = cls.name.rfind('/');
+  std::string package =
+      slash == std::string::npos ? "" : cls.name.substr(0, slash);
+  std::string simple =
+      identifier(slash == std::string::npos ? cls.name
+                                            : cls.name.substr(slash + 1));
+
+  std::string ns;
+  for (size_t start = 0; start < package.size();) {
+    auto end = package.find('/', start);
+    if (end == std::string::npos) {
+      end = package.size();
+    }
+    ns += (ns.empty() ? "" : "::") +
+          identifier(std::string_view{package}.substr(start, end - start));
+    start = end + 1;
+  }
+
+  os << "\n// " << cls.name << "\n";
+  if (!ns.empty()) {
+    os << "namespace " << ns << " {\n";
+  }
+  os << "using " << simple << " = java_class_desc<\"" << cls.name << "\">;\n\n";
+  os << "struct " << simple << "_bindings {\n";
+  os << "  using desc = " << simple << ";\n\n";
+  os << "  java_class<desc::name, false> cls;\n";
+
+  struct member {
+    std::string name;
+    std::string kind; // java_method, java_static_method or java_constructor
+    std::string proto;
+    std::string java_name;
+    std::string descriptor;
+  };
+  std::vector<member> members;
+  std::map<std::string, int> overloads;
+  // Member names already taken, overload suffixes included
+  std::set<std::string> taken;
+
+  for (auto &m : cls.methods) {
+    bool is_public = (m.access & acc_public) != 0;
+    if ((!is_public && !opts.all_access) ||
+        (m.access & (acc_bridge | acc_synthetic)) || m.name == "<clinit>") {
+      continue;
+    }
+    auto proto = parse_method_descriptor(m.descriptor);
+    bool ctor = m.name == "<init>";
+    std::string base = ctor ? "ctor" : identifier(m.name);
+    member mem;
+    mem.name = base;
+    // Overloads get a suffix, bumped past the names of other methods (a Java
+    // method may be named foo_1)
+    while (taken.contains(mem.name)) {
+      int n = ++overloads[base];
+      mem.name = base + (base.ends_with('_') ? "" : "_") + std::to_string(n);
+    }
+    taken.insert(mem.name);
+    mem.java_name = m.name;
+    mem.descriptor = m.descriptor;
+    if (ctor) {
+      std::string params;
+      for (size_t i = 0; i < proto.params.size(); ++i) {
+        params += ", " + proto.params[i];
+      }
+      mem.kind = "java_constructor<desc::name" + params + ">";
+      mem.proto = proto.str();
+    } else if (m.access & acc_static) {
+      mem.kind = "java_static_method<desc::name, " + proto.str() + ">";
+      mem.proto = proto.str();
+    } else {
+      mem.kind = "java_method<desc::name, " + proto.str() + ">";
+      mem.proto = proto.str();
+    }
+    members.push_back(std::move(mem));
+  }
+
+  for (auto &m : members) {
+    os << "  " << m.kind << " " << m.name << ";\n";
+  }
+
+  os << "\n";
+  for (auto &m : members) {
+    os << "  static_assert(jni_desc<" << m.proto
+       << ">::name == meta::fixed_string{\"" << m.descriptor << "\"});\n";
+  }
+
+  os << "\n  /// Looks up the class and every method once. Returns std::nullopt "
+        "if any\n  /// lookup fails (a Java exception is then pending).\n";
+  os << "  static std::optional<" << simple
+     << "_bindings> resolve(JVM &jvm) {\n";
+  os << "    auto local = jvm.find_class<desc>();\n";
+  os << "    if (!local) {\n      return std::nullopt;\n    }\n";
+  os << "    auto global = local->promote();\n";
+  for (auto &m : members) {
+    os << "    auto " << m.name << " = global.";
+    if (m.java_name == "<init>") {
+      std::string params = m.kind.substr(std::string{"java_constructor<desc::name"}.size());
+      params.pop_back(); // '>'
+      if (!params.empty()) {
+        params = params.substr(2);
+      }
+      os << "get_constructor_id<" << params << ">();\n";
+    } else if (m.kind.starts_with("java_static_method")) {
+      os << "get_static_method_id<\"" << m.java_name << "\", "
+         << m.proto << ">();\n";
+    } else {
+      os << "get_method_id<\"" << m.java_name << "\", " << m.proto
+         << ">();\n";
+    }
+    os << "    if (!" << m.name << ") {\n      return std::nullopt;\n    }\n";
+  }
+  os << "    return " << simple << "_bindings{std::move(global)";
+  for (auto &m : members) {
+    os << ", *" << m.name;
+  }
+  os << "};\n  }\n};\n";
+  if (!ns.empty()) {
+    os << "} // namespace " << ns << "\n";
+  }
+}
+
+std::vector<unsigned char> read_file(const fs::path &path) {
+  std::ifstream in{path, std::ios::binary};
+  if (!in) {
+    throw std::runtime_error("cannot open " + path.string());
+  }
+  return {std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+void usage(const char *argv0) {
+  std::cerr << "usage: " << argv0
+            << " -o <header> [--guard <macro>] [--all-access] <class file or "
+               "directory>...\n";
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if ((arg == "-o" || arg == "--guard") && i + 1 < argc) {
+      (arg == "-o" ? opts.output : opts.guard) = argv[++i];
+    } else if (arg == "--all-access") {
+      opts.all_access = true;
+    } else if (arg.starts_with("-")) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    } else {
+      opts.inputs.emplace_back(arg);
+    }
+  }
+  if (opts.output.empty() || opts.inputs.empty()) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  std::vector<fs::path> files;
+  for (auto &input : opts.inputs) {
+    if (fs::is_directory(input)) {
+      for (auto &entry : fs::recursive_directory_iterator(input)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".class") {
+          files.push_back(entry.path());
+        }
+      }
+    } else {
+      files.push_back(input);
+    }
+  }
+
+  std::vector<class_info> classes;
+  for (auto &file : files) {
+    try {
+      auto cls = parse_class(read_file(file));
+      if ((cls.access & (acc_module | acc_synthetic)) ||
+          cls.name.ends_with("package-info") || is_anonymous(cls.name) ||
+          (!(cls.access & acc_public) && !opts.all_access)) {
+        continue;
+      }
+      classes.push_back(std::move(cls));
+    } catch (const std::exception &e) {
+      std::cerr << file.string() << ": " << e.what() << "\n";
+      return EXIT_FAILURE;
+    }
+  }
+  std::sort(classes.begin(), classes.end(),
+            [](auto &a, auto &b) { return a.name < b.name; });
+
+  std::ostringstream os;
+  os << "// Generated by jni_bindgen. Do not edit.\n";
+  os << "#ifndef " << opts.guard << "\n#define " << opts.guard << "\n\n";
+  os << "#include \"jvm.hpp\"\n\n#include <optional>\n#include <utility>\n";
+  for (auto &cls : classes) {
+    emit_class(os, cls, opts);
+  }
+  os << "\n#endif // " << opts.guard << "\n";
+
+  // Only touch the output when it changes to avoid needless rebuilds
+  auto content = os.str();
+  if (fs::exists(opts.output)) {
+    auto previous = read_file(opts.output);
+    if (std::string{previous.begin(), previous.end()} == content) {
+      return EXIT_SUCCESS;
+    }
+  }
+  if (auto parent = fs::path{opts.output}.parent_path(); !parent.empty()) {
+    fs::create_directories(parent);
+  }
+  std::ofstream out{opts.output, std::ios::binary};
+  out << content;
+  return out ? EXIT_SUCCESS : EXIT_FAILURE;
+}